@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2012, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INTERACTIVE_MARKERS_CLOCK
+#define INTERACTIVE_MARKERS_CLOCK
+
+#include <ros/time.h>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace interactive_markers
+{
+
+/// Time source used for timeouts, e.g. keep-alive checks, state durations and
+/// conflicting feedback detection. It measures time on a monotonic scale which
+/// is unrelated to ROS time, so it does not follow /clock in simulation.
+class Clock
+{
+public:
+  virtual ~Clock() {}
+
+  virtual ros::WallTime now() = 0;
+};
+
+typedef boost::shared_ptr<Clock> ClockPtr;
+
+/// Monotonic system clock. This is the default.
+class SteadyClock : public Clock
+{
+public:
+  virtual ros::WallTime now();
+};
+
+/// Clock which only advances when told to.
+/// Use this to drive timeouts deterministically in tests and benchmarks.
+class ManualClock : public Clock
+{
+public:
+  ManualClock( const ros::WallTime& start = ros::WallTime() );
+
+  virtual ros::WallTime now();
+
+  /// Set the current time
+  void set( const ros::WallTime& time );
+
+  /// Advance the current time by the given duration
+  void advance( const ros::WallDuration& duration );
+
+private:
+  boost::mutex mutex_;
+  ros::WallTime time_;
+};
+
+/// @return the SteadyClock instance used by default
+ClockPtr getDefaultClock();
+
+}
+
+#endif
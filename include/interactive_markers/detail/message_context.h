@@ -42,23 +42,76 @@
 #include <visualization_msgs/InteractiveMarkerInit.h>
 #include <visualization_msgs/InteractiveMarkerUpdate.h>
 
+#include <boost/unordered_map.hpp>
+
+#include "../tools.h"
+#include "../metrics.h"
+
 namespace interactive_markers
 {
 
+// Remembers the auto-completed controls of all markers of one server,
+// so that markers which are sent again without changes
+// (e.g. in every init message) need not be completed again.
+class AutoCompleteCache
+{
+public:
+  // If the marker with the given completion hash has been completed before,
+  // complete it from the cache and return true.
+  bool complete( uint64_t hash, visualization_msgs::InteractiveMarker& msg ) const;
+
+  // Store the result of autoComplete() for the given marker
+  void insert( uint64_t hash, const visualization_msgs::InteractiveMarker& msg );
+
+  void erase( const std::string& name );
+
+  // erase all entries that do not belong to any of the given markers
+  void retain( const std::vector<visualization_msgs::InteractiveMarker>& markers );
+
+  size_t size() const { return entries_.size(); }
+
+private:
+  struct Entry
+  {
+    uint64_t hash;
+    DetailLevel detail_level;
+    float scale;
+    std::vector<visualization_msgs::InteractiveMarkerControl> controls;
+  };
+
+  boost::unordered_map<std::string, Entry> entries_;
+};
+
 template<class MsgT>
 class MessageContext
 {
 public:
   MessageContext( tf::Transformer& tf,
       const std::string& target_frame,
-      const typename MsgT::ConstPtr& msg);
+      const typename MsgT::ConstPtr& msg,
+      AutoCompleteCache* completion_cache = NULL,
+      ClientMetrics* metrics = NULL,
+      uint32_t msg_size = 0 );
 
   MessageContext<MsgT>& operator=( const MessageContext<MsgT>& other );
 
   // transform all messages with timestamp into target frame
   void getTfTransforms();
 
-  typename MsgT::Ptr msg;
+  // The received message. It is only copied when it needs to be
+  // modified, i.e. for auto-completion or tf transformation.
+  typename MsgT::ConstPtr msg;
+
+  // definition hashes of msg->markers, computed before auto-completion
+  // (only filled in if a completion cache is used)
+  std::vector<uint64_t> marker_hashes;
+
+  // hashes of the parts of msg->markers that autoComplete() depends on
+  // (only filled in if a completion cache is used)
+  std::vector<uint64_t> completion_hashes;
+
+  // serialized size of the received message, 0 if it was not measured
+  uint32_t msg_size;
 
   // return true if tf info is complete
   bool isReady();
@@ -67,18 +120,52 @@ private:
 
   void init();
 
+  // copy msg if it is still shared with the sender and return the copy
+  MsgT& getWritableMsg();
+
+  // true if the pose needs to be transformed into the target frame
+  bool needsTransform( const std_msgs::Header& header ) const;
+
+  // call autoComplete() on all markers, using the cache where possible
+  void autoCompleteMarkers();
+
+  // return false if the transform for header is not available yet
+  bool isTransformAvailable( const std_msgs::Header& header, tf::StampedTransform& transform );
+
   bool getTransform( std_msgs::Header& header, geometry_msgs::Pose& pose_msg );
 
-  void getTfTransforms( std::vector<visualization_msgs::InteractiveMarker>& msg_vec, std::list<size_t>& indices );
-  void getTfTransforms( std::vector<visualization_msgs::InteractiveMarkerPose>& msg_vec, std::list<size_t>& indices );
+  // transform the markers / poses with the given indices
+  void getMarkerTransforms( std::list<size_t>& indices );
+  void getPoseTransforms( std::list<size_t>& indices );
+
+  // record how long we waited for the transform from the given frame.
+  // now is set on the first call, so that one pass over the message
+  // only reads the clock once.
+  void addTfWait( const std::string& frame_id, ros::WallTime& now );
 
   // array indices of marker/pose updates with missing tf info
   std::list<size_t> open_marker_idx_;
   std::list<size_t> open_pose_idx_;
   tf::Transformer& tf_;
   std::string target_frame_;
+  AutoCompleteCache* completion_cache_;
+  ClientMetrics* metrics_;
+  ros::WallTime receive_time_;
+
+  // set once msg has been copied
+  typename MsgT::Ptr writable_msg_;
 };
 
+// Compute a hash of everything in the interactive marker except header and pose,
+// i.e. of all content which does not change with a pose update.
+// buffer is used as scratch space for serialization.
+uint64_t hashMarkerDefinition( const visualization_msgs::InteractiveMarker& msg, std::vector<uint8_t>& buffer );
+
+// Same as above, but also return a hash of the content autoComplete() depends on
+// (name, scale and controls), which does not change with a menu update.
+uint64_t hashMarkerDefinition( const visualization_msgs::InteractiveMarker& msg, std::vector<uint8_t>& buffer,
+    uint64_t& completion_hash );
+
 class InitFailException: public tf::TransformException
 {
 public:
@@ -53,6 +53,7 @@
 
 #include "message_context.h"
 #include "state_machine.h"
+#include "status_tracker.h"
 #include "../interactive_marker_client.h"
 
 
@@ -67,7 +68,8 @@ public:
       const std::string& server_id,
       tf::Transformer& tf,
       const std::string& target_frame,
-      const InteractiveMarkerClient::CbCollection& callbacks );
+      const InteractiveMarkerClient::CbCollection& callbacks,
+      const ClockPtr& clock = getDefaultClock() );
 
   ~SingleClient();
 
@@ -83,6 +85,19 @@ public:
   // transform all messages with missing transforms
   void update();
 
+  // if enabled, errors will not reset the consumer. Instead, the next
+  // init message is compared to the last known state and only the
+  // differences are sent out as an update.
+  void setDifferentialResync( bool enable );
+
+  // also measure message sizes, update latency and tf waits
+  void setDetailedMetrics( bool enable );
+
+  void setClock( const ClockPtr& clock );
+
+  // return the metrics of this connection, including the current queue state
+  ClientMetrics getMetrics() const;
+
 private:
 
   // check if we can go from init state to normal operation
@@ -97,6 +112,9 @@ private:
     TF_ERROR
   };
 
+  typedef MessageContext<visualization_msgs::InteractiveMarkerUpdate> UpdateMessageContext;
+  typedef MessageContext<visualization_msgs::InteractiveMarkerInit> InitMessageContext;
+
   StateMachine<StateT> state_;
 
   // updateTf implementation (for one queue)
@@ -105,21 +123,57 @@ private:
 
   void pushUpdates();
 
-  void errorReset( std::string error_msg );
+  // metrics to be filled in by message contexts, NULL unless detailed
+  ClientMetrics* getContextMetrics();
+
+  // record the latency of all stamped markers and poses in the update
+  void addUpdateLatency( const visualization_msgs::InteractiveMarkerUpdate& update );
+
+  void errorReset( ClientMetrics::ResetCauseT cause, std::string error_msg );
+
+  // status codes, so we only need to format status messages
+  // when the status actually changes
+  enum StatusCodeT
+  {
+    WAITING_FOR_INIT,
+    INIT_RECEIVED,
+    WAITING_FOR_UPDATE,
+    WAITING_FOR_TF,
+    INIT_TF_ERROR,
+    RECEIVING_UPDATES,
+    NO_UPDATE_RECEIVED,
+    UPDATES_OK,
+    REINITIALIZING,
+    // one code per reset cause, so a reset for a different reason
+    // is always reported (see ClientMetrics::ResetCauseT)
+    SEQUENCE_ERROR,
+    RESET_TF_ERROR,
+    UNKNOWN_ERROR,
+    QUEUE_OVERFLOW
+  };
+
+  // call the status callback if the status has changed
+  void setStatus( InteractiveMarkerClient::StatusT status, StatusCodeT code, const char* msg );
+
+  // send out the difference between the last known state and the
+  // given init message as an update
+  void pushResyncUpdate( const InitMessageContext& init_context );
+
+  // keep track of the state the consumer has received
+  void updateScene( const InitMessageContext& init_context );
+  void updateScene( const UpdateMessageContext& update_context );
 
   // sequence number and time of first ever received update
   uint64_t first_update_seq_num_;
 
   // sequence number and time of last received update
   uint64_t last_update_seq_num_;
-  ros::Time last_update_time_;
+  ros::WallTime last_update_time_;
 
   // true if the last outgoing update is too long ago
   // and we've already sent a notification of that
   bool update_time_ok_;
 
-  typedef MessageContext<visualization_msgs::InteractiveMarkerUpdate> UpdateMessageContext;
-  typedef MessageContext<visualization_msgs::InteractiveMarkerInit> InitMessageContext;
 
   // Queue of Updates waiting for tf and numbering
   typedef std::deque< UpdateMessageContext > M_UpdateMessageContext;
@@ -134,11 +188,44 @@ private:
   tf::Transformer& tf_;
   std::string target_frame_;
 
+  // auto-completed controls of all markers of this server
+  AutoCompleteCache completion_cache_;
+
   const InteractiveMarkerClient::CbCollection& callbacks_;
 
   std::string server_id_;
 
   bool warn_keepalive_;
+
+  StatusTracker status_;
+
+  // last known state of one marker, as sent to the consumer
+  struct SceneEntry
+  {
+    uint64_t hash;
+    std_msgs::Header header;
+    geometry_msgs::Pose pose;
+  };
+  typedef boost::unordered_map< std::string, SceneEntry > M_SceneEntry;
+
+  // state of all markers as known by the consumer
+  // (only maintained if differential_resync_ is set)
+  M_SceneEntry scene_;
+
+  bool differential_resync_;
+
+  // true if scene_ reflects what the consumer currently displays
+  bool scene_valid_;
+
+  // true if the next init message needs to be sent as a difference to scene_
+  bool resync_pending_;
+
+  ClockPtr clock_;
+
+  // metrics are always measured in wall time, independent of clock_
+  ClockPtr metrics_clock_;
+  ClientMetrics metrics_;
+  bool detailed_metrics_;
 };
 
 }
@@ -40,29 +40,59 @@
 
 #include <ros/ros.h>
 
+#include <boost/thread/mutex.hpp>
+
+#include "../clock.h"
+#include "../metrics.h"
+
 namespace interactive_markers
 {
 
-// Helper class for state management
+// Helper class for state management.
+// Keeps the last TRACE_SIZE transitions in a ring buffer and the total
+// time spent in each state. The state must only be changed from the owner's
+// thread, but getTrace() can be called from any thread. Transitions are
+// rare, so guarding them with a mutex costs next to nothing.
 template<class StateT>
 class StateMachine
 {
 public:
-  StateMachine( std::string name, StateT init_state );
+  static const size_t TRACE_SIZE = 32;
+
+  StateMachine( std::string name, StateT init_state, ClockPtr clock = getDefaultClock() );
   StateMachine& operator=( StateT state );
   operator StateT();
-  ros::Duration getDuration();
+  ros::WallDuration getDuration();
+  void setClock( ClockPtr clock );
+
+  // fill in transitions, durations and the current state
+  // (state names are left to the caller)
+  void getTrace( StateTrace& trace ) const;
+
 private:
+  void addDuration( StateT state, const ros::WallDuration& duration );
+
   StateT state_;
-  ros::Time chg_time_;
+  ros::WallTime chg_time_;
   std::string name_;
+  ClockPtr clock_;
+
+  // guards everything written on transitions, for getTrace()
+  mutable boost::mutex mutex_;
+
+  StateTransition trace_[TRACE_SIZE];
+  uint64_t num_transitions_;
+  std::vector<ros::WallDuration> durations_;
 };
 
 template<class StateT>
-StateMachine<StateT>::StateMachine( std::string name, StateT init_state )
-: name_(name)
+StateMachine<StateT>::StateMachine( std::string name, StateT init_state, ClockPtr clock )
+: state_(init_state)
+, name_(name)
+, clock_(clock)
+, num_transitions_(0)
 {
-  operator=(init_state);
+  chg_time_ = clock_->now();
 };
 
 template<class StateT>
@@ -71,16 +101,69 @@ StateMachine<StateT>& StateMachine<StateT>::operator=( StateT state )
   if ( state_ != state )
   {
     ROS_DEBUG( "Setting state of %s to %lu", name_.c_str(), (int64_t)state );
+    boost::mutex::scoped_lock lock( mutex_ );
+    ros::WallTime now = clock_->now();
+    addDuration( state_, now-chg_time_ );
+
+    StateTransition& transition = trace_[ num_transitions_ % TRACE_SIZE ];
+    transition.from = state_;
+    transition.to = state;
+    transition.time = now;
+    num_transitions_++;
+
     state_ = state;
-    chg_time_=ros::Time::now();
+    chg_time_ = now;
   }
   return *this;
 }
 
 template<class StateT>
-ros::Duration StateMachine<StateT>::getDuration()
+ros::WallDuration StateMachine<StateT>::getDuration()
 {
-  return ros::Time::now()-chg_time_;
+  return clock_->now()-chg_time_;
+}
+
+template<class StateT>
+void StateMachine<StateT>::setClock( ClockPtr clock )
+{
+  // durations cannot be compared across clocks
+  boost::mutex::scoped_lock lock( mutex_ );
+  addDuration( state_, clock_->now()-chg_time_ );
+  clock_ = clock;
+  chg_time_ = clock_->now();
+}
+
+template<class StateT>
+void StateMachine<StateT>::getTrace( StateTrace& trace ) const
+{
+  boost::mutex::scoped_lock lock( mutex_ );
+  uint64_t num_stored = std::min<uint64_t>( num_transitions_, TRACE_SIZE );
+  trace.transitions.resize( num_stored );
+  for ( uint64_t i=0; i<num_stored; i++ )
+  {
+    trace.transitions[i] = trace_[ (num_transitions_-num_stored+i) % TRACE_SIZE ];
+  }
+  trace.num_transitions = num_transitions_;
+
+  trace.durations = durations_;
+  size_t state_idx = (size_t)state_;
+  if ( trace.durations.size() <= state_idx )
+  {
+    trace.durations.resize( state_idx+1 );
+  }
+  trace.durations[state_idx] += clock_->now()-chg_time_;
+  trace.state = state_;
+}
+
+template<class StateT>
+void StateMachine<StateT>::addDuration( StateT state, const ros::WallDuration& duration )
+{
+  size_t state_idx = (size_t)state;
+  if ( durations_.size() <= state_idx )
+  {
+    durations_.resize( state_idx+1 );
+  }
+  durations_[state_idx] += duration;
 }
 
 template<class StateT>
@@ -47,6 +47,11 @@
 #include <visualization_msgs/InteractiveMarkerUpdate.h>
 
 #include "detail/state_machine.h"
+#include "detail/status_tracker.h"
+#include "marker_store.h"
+#include "clock.h"
+#include "metrics.h"
+#include "transport.h"
 
 namespace interactive_markers
 {
@@ -88,6 +93,13 @@ public:
       const std::string& target_frame = "",
       const std::string &topic_ns = "" );
 
+  /// Same as above, but receive messages through the given transport
+  /// instead of ROS topics (see e.g. LoopbackTransport).
+  InteractiveMarkerClient( tf::Transformer& tf,
+      const ClientTransportPtr& transport,
+      const std::string& target_frame = "",
+      const std::string &topic_ns = "" );
+
   /// Will cause a 'reset' call for all server ids
   ~InteractiveMarkerClient();
 
@@ -115,14 +127,41 @@ public:
   /// Set callback for status updates
   void setStatusCb( const StatusCallback& cb );
 
+  /// If enabled, a connection error (e.g. message loss, tf failure) will not
+  /// cause a reset. Instead, the client keeps track of the last known state
+  /// of each server and sends the difference to the next init message
+  /// as a regular update, containing only added, changed and erased markers.
+  void setDifferentialResync( bool enable );
+
+  /// Maintain a materialized copy of the markers of all servers (see MarkerStore).
+  /// The store is updated right before the init, update and reset callbacks
+  /// are called. Enable this before subscribing.
+  void enableMarkerStore( bool enable );
+
+  /// @return the marker store, or an empty pointer if it is not enabled
+  MarkerStorePtr getMarkerStore() const;
+
+  /// Set the clock used for timeouts. Defaults to a monotonic system clock.
+  void setClock( const ClockPtr& clock );
+
+  typedef std::map<std::string, ClientMetrics> M_ClientMetrics;
+
+  /// Get the metrics of the connections to all servers, indexed by server id.
+  void getMetrics( M_ClientMetrics& metrics ) const;
+
+  /// Also measure message sizes, update latency and tf waits (see ClientMetrics).
+  /// This walks every received message once more, so it is off by default.
+  void setDetailedMetrics( bool enable );
+
+  /// Get the recent state changes of the client itself (IDLE, INIT, RUNNING).
+  StateTrace getStateTrace() const;
+
 private:
 
   // Process message from the init or update channel
   template<class MsgConstPtrT>
   void process( const MsgConstPtrT& msg );
 
-  ros::NodeHandle nh_;
-
   enum StateT
   {
     IDLE,
@@ -134,8 +173,7 @@ private:
 
   std::string topic_ns_;
 
-  ros::Subscriber update_sub_;
-  ros::Subscriber init_sub_;
+  ClientTransportPtr transport_;
 
   // subscribe to the init channel
   void subscribeInit();
@@ -145,6 +183,21 @@ private:
 
   void statusCb( StatusT status, const std::string& server_id, const std::string& msg );
 
+  // codes for the status not related to a specific server
+  enum GeneralStatusT
+  {
+    WAITING_FOR_MESSAGES,
+    RECEIVING_MESSAGES,
+    SUBSCRIBE_ERROR,
+    EMPTY_SERVER_ID,
+    SERVER_OFFLINE
+  };
+
+  // call the status callback for "General" if the status has changed
+  void setGeneralStatus( StatusT status, GeneralStatusT code, const char* msg );
+
+  StatusTracker general_status_;
+
   typedef boost::shared_ptr<SingleClient> SingleClientPtr;
   typedef boost::unordered_map<std::string, SingleClientPtr> M_SingleClient;
   M_SingleClient publisher_contexts_;
@@ -157,10 +210,13 @@ public:
   struct CbCollection
   {
     void initCb( const InitConstPtr& i ) const {
+      if (store_) store_->applyInit( i );
       if (init_cb_) init_cb_( i ); }
     void updateCb( const UpdateConstPtr& u ) const {
+      if (store_) store_->applyUpdate( u );
       if (update_cb_) update_cb_( u ); }
     void resetCb( const std::string& s ) const {
+      if (store_) store_->applyReset( s );
       if (reset_cb_) reset_cb_(s); }
     void statusCb( StatusT s, const std::string& id, const std::string& m ) const {
       if (status_cb_) status_cb_(s,id,m); }
@@ -177,12 +233,19 @@ public:
     void setStatusCb( StatusCallback status_cb ) {
       status_cb_ = status_cb;
     }
+    void setStore( MarkerStorePtr store ) {
+      store_ = store;
+    }
+    MarkerStorePtr getStore() const {
+      return store_;
+    }
 
   private:
     InitCallback init_cb_;
     UpdateCallback update_cb_;
     ResetCallback reset_cb_;
     StatusCallback status_cb_;
+    MarkerStorePtr store_;
   };
 
   // handle init message
@@ -199,6 +262,12 @@ private:
 
   // this allows us to detect if a server died (in most cases)
   int last_num_publishers_;
+
+  bool differential_resync_;
+
+  bool detailed_metrics_;
+
+  ClockPtr clock_;
 };
 
 
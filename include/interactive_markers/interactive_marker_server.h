@@ -46,6 +46,10 @@
 #include <boost/function.hpp>
 #include <boost/unordered_map.hpp>
 
+#include "clock.h"
+#include "metrics.h"
+#include "transport.h"
+
 namespace interactive_markers
 {
 
@@ -60,6 +64,8 @@ public:
   typedef visualization_msgs::InteractiveMarkerFeedbackConstPtr FeedbackConstPtr;
   typedef boost::function< void ( const FeedbackConstPtr& ) > FeedbackCallback;
 
+  typedef boost::shared_ptr< const std::vector<visualization_msgs::MenuEntry> > MenuEntriesConstPtr;
+
   static const uint8_t DEFAULT_FEEDBACK_CB = 255;
 
   /// @param topic_ns      The interface will use the topics topic_ns/update and
@@ -71,6 +77,13 @@ public:
   ///                      All callbacks will be called from that thread.
   InteractiveMarkerServer( const std::string &topic_ns, const std::string &server_id="", bool spin_thread = false );
 
+  /// Same as above, but communicate through the given transport instead of ROS topics
+  /// (see e.g. LoopbackTransport). No node handle is created, so this does not need
+  /// a ROS master. Feedback and keep-alives are handled in whatever thread the
+  /// transport calls back from, so there is no spin thread.
+  InteractiveMarkerServer( const std::string &topic_ns, const ServerTransportPtr &transport,
+      const std::string &server_id="" );
+
   /// Destruction of the interface will lead to all managed markers being cleared.
   ~InteractiveMarkerServer();
 
@@ -100,6 +113,35 @@ public:
       const geometry_msgs::Pose &pose,
       const std_msgs::Header &header=std_msgs::Header() );
 
+  /// Replace the menu entries of a marker with the specified name.
+  /// Unlike get() followed by insert(), this does not copy the marker.
+  /// Note: This change will not take effect until you call applyChanges()
+  /// @return true if a marker with that name exists
+  /// @param name          Name of the interactive marker
+  /// @param menu_entries  The new menu entries
+  bool setMenuEntries( const std::string &name,
+      const std::vector<visualization_msgs::MenuEntry> &menu_entries );
+
+  /// Replace the menu entries of several markers at once. The entries are
+  /// shared by all pending updates until applyChanges() is called.
+  /// Note: This change will not take effect until you call applyChanges()
+  /// @return true if all markers exist
+  /// @param names               Names of the interactive markers
+  /// @param menu_entries        The new menu entries
+  /// @param[out] missing_names  If given, receives the names of markers which don't exist
+  bool setMenuEntries( const std::vector<std::string> &names,
+      const MenuEntriesConstPtr &menu_entries,
+      std::vector<std::string> *missing_names = NULL );
+
+  /// Same as above, but with separate menu entries for each marker.
+  /// Markers can still share entries by passing the same pointer.
+  /// @param names               Names of the interactive markers
+  /// @param menu_entries        The new menu entries, one for each name
+  /// @param[out] missing_names  If given, receives the names of markers which don't exist
+  bool setMenuEntries( const std::vector<std::string> &names,
+      const std::vector<MenuEntriesConstPtr> &menu_entries,
+      std::vector<std::string> *missing_names = NULL );
+
   /// Erase the marker with the specified name
   /// Note: This change will not take effect until you call applyChanges().
   /// @return true if a marker with that name exists
@@ -133,11 +175,32 @@ public:
   /// @return true if a marker with that name exists
   bool get( std::string name, visualization_msgs::InteractiveMarker &int_marker ) const;
 
+  /// Process a message from the feedback channel: update the marker pose
+  /// and call the user callback. Normally called by the transport.
+  /// @param receive_time  when the transport received the feedback,
+  ///                      according to getDefaultClock()
+  void processFeedback( const FeedbackConstPtr& feedback, const ros::WallTime& receive_time );
+
+  /// @return a snapshot of the performance metrics collected so far
+  ServerMetrics getMetrics();
+
+  /// Also measure the serialized size of published messages (see ServerMetrics).
+  /// This walks every message once more, so it is off by default.
+  void setDetailedMetrics( bool enable );
+
+  /// Periodically publish the metrics on /diagnostics.
+  /// @param period  Publishing period in seconds. Pass 0 to stop publishing.
+  void setDiagnosticsPeriod( double period );
+
+  /// Set the clock used to arbitrate feedback from competing clients.
+  /// Defaults to a monotonic system clock.
+  void setClock( const ClockPtr& clock );
+
 private:
 
   struct MarkerContext
   {
-    ros::Time last_feedback;
+    ros::WallTime last_feedback;
     std::string last_client_id;
     FeedbackCallback default_feedback_cb;
     boost::unordered_map<uint8_t,FeedbackCallback> feedback_cbs;
@@ -152,32 +215,58 @@ private:
     enum {
       FULL_UPDATE,
       POSE_UPDATE,
+      MENU_UPDATE,
       ERASE
     } update_type;
     visualization_msgs::InteractiveMarker int_marker;
+    // new menu entries in case of MENU_UPDATE
+    MenuEntriesConstPtr menu_entries;
     FeedbackCallback default_feedback_cb;
     boost::unordered_map<uint8_t,FeedbackCallback> feedback_cbs;
   };
 
   typedef boost::unordered_map< std::string, UpdateContext > M_UpdateContext;
 
+  // locks mutex_ and records wait and hold times in metrics_
+  class ScopedLock
+  {
+  public:
+    ScopedLock( InteractiveMarkerServer& server );
+    ~ScopedLock();
+  private:
+    InteractiveMarkerServer& server_;
+    ros::WallTime start_time_;
+    boost::recursive_mutex::scoped_lock lock_;
+  };
+  friend class ScopedLock;
+
+  // set up transport, timers and thread. Called by the constructors.
+  void init( const std::string &server_id, bool spin_thread );
+
   // main loop when spinning our own thread
   // - process callbacks in our callback queue
   // - process pending goals
   void spinThread();
 
-  // update marker pose & call user callback
-  void processFeedback( const FeedbackConstPtr& feedback );
-
   // send an empty update to keep the client GUIs happy
   void keepAlive();
 
-  // increase sequence number & publish an update
-  void publish( visualization_msgs::InteractiveMarkerUpdate &update );
+  // increase sequence number & publish an update.
+  // The message must not be modified afterwards.
+  void publish( const visualization_msgs::InteractiveMarkerUpdatePtr &update );
 
   // publish the current complete state to the latched "init" topic.
   void publishInit();
 
+  // publish metrics_ on /diagnostics
+  void publishDiagnostics();
+
+  // turn a pending pose or menu update into a full update of the stored marker
+  void makeFullUpdate( M_UpdateContext::iterator update_it );
+
+  // Update menu entries, schedule update without locking
+  bool doSetMenuEntries( const std::string &name, const MenuEntriesConstPtr &menu_entries );
+
   // Update pose, schedule update without locking
   void doSetPose( M_UpdateContext::iterator update_it,
       const std::string &name,
@@ -197,20 +286,30 @@ private:
 
   // these are needed when spinning up a dedicated thread
   boost::scoped_ptr<boost::thread> spin_thread_;
-  ros::NodeHandle node_handle_;
   ros::CallbackQueue callback_queue_;
   volatile bool need_to_terminate_;
 
-  // this is needed when running in non-threaded mode
-  ros::Timer keep_alive_timer_;
+  // only created when using ROS, so that other transports work without a master
+  boost::scoped_ptr<ros::NodeHandle> node_handle_;
 
-  ros::Publisher init_pub_;
-  ros::Publisher update_pub_;
-  ros::Subscriber feedback_sub_;
+  ServerTransportPtr transport_;
 
   uint64_t seq_num_;
 
   std::string server_id_;
+
+  ClockPtr clock_;
+
+  // all metrics are protected by mutex_.
+  // they are always measured in real time, regardless of clock_.
+  ServerMetrics metrics_;
+  ClockPtr metrics_clock_;
+  bool detailed_metrics_;
+  unsigned lock_depth_;
+  ros::WallTime lock_time_;
+
+  ros::Publisher diagnostics_pub_;
+  ros::Timer diagnostics_timer_;
 };
 
 }
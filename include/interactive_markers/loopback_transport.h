@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2012, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INTERACTIVE_MARKERS_LOOPBACK_TRANSPORT
+#define INTERACTIVE_MARKERS_LOOPBACK_TRANSPORT
+
+#include "transport.h"
+
+namespace interactive_markers
+{
+
+/// In-process transport which connects servers and clients without
+/// network or roscore. All servers and clients created from the same
+/// LoopbackTransport are connected by their topic namespace.
+///
+/// Like with ROS, published messages are queued. They are delivered in
+/// order when calling spinOnce(), from the thread calling it. This makes
+/// delivery deterministic. Init messages are latched. Servers are also
+/// asked to send their keep-alives from spinOnce(), once their keep-alive
+/// period has passed in wall time.
+class LoopbackTransport
+{
+public:
+  LoopbackTransport();
+
+  /// Create a transport for one InteractiveMarkerServer
+  ServerTransportPtr createServerTransport();
+
+  /// Create a transport for one InteractiveMarkerClient
+  ClientTransportPtr createClientTransport();
+
+  /// Send feedback to the servers on the given topic namespace, as a GUI would.
+  void publishFeedback( const std::string& topic_ns,
+      const visualization_msgs::InteractiveMarkerFeedbackConstPtr& feedback );
+
+  /// Deliver all messages queued so far. Messages published from
+  /// within a callback are delivered on the next call.
+  /// @return the number of delivered messages
+  size_t spinOnce();
+
+  /// @return the number of queued messages
+  size_t getNumPending();
+
+private:
+  struct Hub;
+  class ServerEndpoint;
+  class ClientEndpoint;
+
+  // shared with all endpoints, which may outlive this
+  boost::shared_ptr<Hub> hub_;
+};
+
+typedef boost::shared_ptr<LoopbackTransport> LoopbackTransportPtr;
+
+}
+
+#endif
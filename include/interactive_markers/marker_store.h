@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2012, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INTERACTIVE_MARKER_STORE
+#define INTERACTIVE_MARKER_STORE
+
+#include <visualization_msgs/InteractiveMarkerInit.h>
+#include <visualization_msgs/InteractiveMarkerUpdate.h>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace interactive_markers
+{
+
+/// Materialized state of all interactive markers received by a client.
+///
+/// The store applies init messages, updates and resets incrementally and
+/// keeps a versioned log of per-marker events. Consumers (e.g. several render
+/// threads) can fetch only the changes since the last version they have seen,
+/// without rescanning whole messages. Marker definitions are not copied,
+/// but point into the messages they were received with.
+///
+/// All methods are thread-safe.
+class MarkerStore : boost::noncopyable
+{
+public:
+
+  enum EventT {
+    ADDED,
+    POSE_CHANGED,
+    REPLACED,
+    ERASED
+  };
+
+  typedef boost::shared_ptr<const visualization_msgs::InteractiveMarker> MarkerConstPtr;
+
+  /// Current state of one marker
+  struct Entry
+  {
+    std::string server_id;
+    /// The marker definition as last received
+    MarkerConstPtr marker;
+    /// Current header & pose. These are newer than marker->header and
+    /// marker->pose if pose updates have been received since.
+    std_msgs::Header header;
+    geometry_msgs::Pose pose;
+    /// Version of the last change to this marker
+    uint64_t version;
+  };
+
+  /// Change to one marker
+  struct Event
+  {
+    EventT type;
+    uint64_t version;
+    std::string server_id;
+    std::string name;
+    /// The marker definition. Empty for ERASED.
+    MarkerConstPtr marker;
+    /// The new header & pose. Not set for ERASED.
+    std_msgs::Header header;
+    geometry_msgs::Pose pose;
+  };
+
+  /// @param max_events  Number of events to keep for getChangesSince()
+  MarkerStore( size_t max_events = 10000 );
+
+  /// Replace the state of the sending server
+  void applyInit( const visualization_msgs::InteractiveMarkerInitConstPtr& msg );
+
+  /// Apply an incremental update from the sending server
+  void applyUpdate( const visualization_msgs::InteractiveMarkerUpdateConstPtr& msg );
+
+  /// Erase all markers of the given server
+  void applyReset( const std::string& server_id );
+
+  /// @return the version of the current state. It is increased by one for each event.
+  uint64_t getVersion() const;
+
+  /// Get all events with a version greater than the given one, in order.
+  /// @return false if not all of these events are available anymore.
+  ///         In that case, use getMarkers() to get the complete state.
+  bool getChangesSince( uint64_t version, std::vector<Event>& events ) const;
+
+  /// Get the current state of all markers
+  /// @return the version of the returned state
+  uint64_t getMarkers( std::vector<Entry>& entries ) const;
+
+  /// Get the current state of one marker
+  /// @return true if the marker exists
+  bool getMarker( const std::string& server_id, const std::string& name, Entry& entry ) const;
+
+private:
+
+  typedef boost::unordered_map< std::string, Entry > M_Entry;
+  typedef boost::unordered_map< std::string, M_Entry > M_ServerEntries;
+
+  // set the marker definition of an entry & record the event
+  void setMarker( M_Entry& entries, const std::string& server_id, const MarkerConstPtr& marker );
+
+  void pushEvent( EventT type, const Entry& entry, const std::string& name );
+
+  M_ServerEntries servers_;
+
+  std::deque<Event> events_;
+  size_t max_events_;
+
+  uint64_t version_;
+
+  mutable boost::mutex mutex_;
+};
+
+typedef boost::shared_ptr<MarkerStore> MarkerStorePtr;
+
+}
+
+#endif
@@ -38,6 +38,9 @@
 #include <boost/function.hpp>
 #include <boost/unordered_map.hpp>
 
+#include <set>
+#include <vector>
+
 namespace interactive_markers
 {
 
@@ -87,6 +90,25 @@ public:
   /// @return true if the entry exists
   bool getCheckState( EntryHandle handle, CheckState &check_state ) const;
 
+  /// Specify if an entry should be visible or hidden in the menu of one marker only.
+  /// Setting the same value as for all markers removes the override.
+  /// Note: This change will not take effect until you call apply() or reApply().
+  /// @return true if the entry exists
+  bool setVisible( const std::string &marker_name, EntryHandle handle, bool visible );
+
+  /// Specify the check state of an entry in the menu of one marker only.
+  /// Setting the same value as for all markers removes the override.
+  /// Note: This change will not take effect until you call apply() or reApply().
+  /// @return true if the entry exists
+  bool setCheckState( const std::string &marker_name, EntryHandle handle, CheckState check_state );
+
+  /// Get the state of an entry in the menu of the given marker
+  /// @return true if the entry exists
+  bool getCheckState( const std::string &marker_name, EntryHandle handle, CheckState &check_state ) const;
+
+  /// Remove all per-marker overrides for the given marker
+  void clearOverrides( const std::string &marker_name );
+
   /// Copy current menu state into the marker given by the specified name &
   /// divert callback for MENU_SELECT feedback to this manager
   bool apply( InteractiveMarkerServer &server, const std::string &marker_name );
@@ -111,17 +133,68 @@ private:
     FeedbackCallback feedback_cb;
   };
 
+  // per-marker state of one entry. -1 means "same as for all markers".
+  struct EntryOverride
+  {
+    EntryHandle handle;
+    int8_t visible;
+    int8_t check_state;
+
+    bool operator<( const EntryOverride& other ) const
+    {
+      if ( handle != other.handle ) return handle < other.handle;
+      if ( visible != other.visible ) return visible < other.visible;
+      return check_state < other.check_state;
+    }
+  };
+
+  // per-marker differences to the shared menu, sorted by handle.
+  // The flattened menu is only built when it is applied, so that
+  // overridden markers do not keep a copy of the whole menu around.
+  struct MarkerOverlay
+  {
+    std::vector<EntryOverride> overrides;
+  };
+
+  typedef boost::unordered_map<std::string, MarkerOverlay> M_MarkerOverlay;
+
   // Call registered callback functions for given feedback command
   void processFeedback( const visualization_msgs::InteractiveMarkerFeedbackConstPtr &feedback );
 
+  // Return the flattened menu, building it if the menu has changed
+  // since the last call
+  InteractiveMarkerServer::MenuEntriesConstPtr getMenuEntries();
+
+  // Same as above, taking the overrides of the given marker into account
+  InteractiveMarkerServer::MenuEntriesConstPtr getMenuEntries( const std::string &marker_name );
+
+  // Build the flattened menu. overlay may be NULL.
+  InteractiveMarkerServer::MenuEntriesConstPtr buildMenuEntries( const MarkerOverlay* overlay );
+
+  // Mark the shared menu as outdated
+  void invalidateMenu();
+
+  // Set one field of the override for the given marker & entry,
+  // removing overrides which are no longer needed
+  bool setOverride( const std::string &marker_name, EntryHandle handle,
+                    int8_t EntryOverride::*field, int8_t value );
+
+  const EntryOverride* findOverride( const MarkerOverlay* overlay, EntryHandle handle ) const;
+
   // Create and push MenuEntry objects from handles_in onto
   // entries_out.  Calls itself recursively to add the entire menu
-  // tree.
+  // tree. overlay may be NULL.
   bool pushMenuEntries( std::vector<EntryHandle>& handles_in,
                         std::vector<visualization_msgs::MenuEntry>& entries_out,
-                        EntryHandle parent_handle );
+                        EntryHandle parent_handle,
+                        const MarkerOverlay* overlay );
 
-  visualization_msgs::MenuEntry makeEntry( EntryContext& context, EntryHandle handle, EntryHandle parent_handle );
+  visualization_msgs::MenuEntry makeEntry( EntryContext& context, EntryHandle handle, EntryHandle parent_handle,
+                                           CheckState check_state );
+
+  // @return the context for the given handle, or NULL if it does not exist
+  EntryContext* getContext( EntryHandle handle );
+  const EntryContext* getContext( EntryHandle handle ) const;
 
   // Insert without adding a top-level entry
   EntryHandle doInsert( const std::string &title,
@@ -131,11 +204,17 @@ private:
 
   std::vector<EntryHandle> top_level_handles_;
 
-  boost::unordered_map<EntryHandle, EntryContext> entry_contexts_;
+  // entry contexts, indexed by handle-1
+  std::vector<EntryContext> entry_contexts_;
 
   EntryHandle current_handle_;
 
   std::set<std::string> managed_markers_;
+
+  // flattened menu shared by all markers (reset when the menu changes)
+  InteractiveMarkerServer::MenuEntriesConstPtr menu_entries_;
+
+  M_MarkerOverlay overlays_;
 };
 
 }
@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2012, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INTERACTIVE_MARKERS_METRICS
+#define INTERACTIVE_MARKERS_METRICS
+
+#include <ros/time.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace interactive_markers
+{
+
+/// Statistics of a repeatedly measured duration
+struct DurationStats
+{
+  DurationStats();
+
+  void add( const ros::WallDuration& duration );
+
+  /// @return the average duration in seconds
+  double mean() const;
+
+  uint64_t count;
+  ros::WallDuration total;
+  ros::WallDuration max;
+  ros::WallDuration last;
+};
+
+/// Histogram of a repeatedly measured duration with decadic buckets:
+/// <1ms, <10ms, <100ms, <1s, <10s and >=10s
+struct DurationHistogram
+{
+  static const unsigned NUM_BUCKETS = 6;
+
+  DurationHistogram();
+
+  void add( const ros::WallDuration& duration );
+
+  /// @return the upper limit of the given bucket in seconds
+  static double getBucketLimit( unsigned bucket );
+
+  DurationStats stats;
+  uint64_t buckets[NUM_BUCKETS];
+};
+
+/// Number and rate of events (or of bytes, messages etc.).
+/// The rate is updated about once per second.
+struct RateStats
+{
+  RateStats();
+
+  void add( const ros::WallTime& now, uint64_t amount = 1 );
+
+  uint64_t count;
+  /// events per second during the last complete window
+  double rate;
+
+  ros::WallTime window_start;
+  uint64_t window_count;
+};
+
+/// Performance metrics of an InteractiveMarkerServer
+struct ServerMetrics
+{
+  ServerMetrics();
+
+  /// time spent in applyChanges(), including publishInit()
+  DurationStats apply_changes;
+  /// time spent building and publishing the init message
+  DurationStats publish_init;
+
+  /// time spent waiting for the server mutex
+  DurationStats lock_wait;
+  /// time the server mutex was held, including user feedback callbacks
+  DurationStats lock_hold;
+
+  /// number of update messages sent, including keep-alives
+  uint64_t updates;
+  /// total number of markers, poses and erases sent in updates
+  uint64_t markers;
+  uint64_t poses;
+  uint64_t erases;
+
+  /// contents of the last update sent by applyChanges()
+  uint32_t last_update_markers;
+  uint32_t last_update_poses;
+  uint32_t last_update_erases;
+
+  /// serialized size of all updates and of the last update
+  /// (only measured with InteractiveMarkerServer::setDetailedMetrics())
+  uint64_t update_bytes;
+  uint32_t last_update_bytes;
+
+  /// number of init messages sent and serialized size of the last one
+  /// (size only measured with InteractiveMarkerServer::setDetailedMetrics())
+  uint64_t inits;
+  uint32_t last_init_bytes;
+
+  /// received feedback messages
+  RateStats feedback;
+  /// time from the transport receiving the feedback, including the time
+  /// it waited in the queue, to calling the user callback
+  DurationStats feedback_latency;
+  /// feedback for markers which do not exist
+  uint64_t feedback_unknown;
+  /// feedback rejected because another client sent feedback for the same
+  /// marker during the last second
+  uint64_t feedback_rejected;
+
+  /// number of markers currently published
+  uint32_t markers_published;
+  /// number of markers with changes which have not been applied yet
+  uint32_t pending_updates;
+};
+
+/// One change of state of a connection
+struct StateTransition
+{
+  int32_t from;
+  int32_t to;
+  ros::WallTime time;
+};
+
+/// Recent state changes of a connection and the time spent in each state
+struct StateTrace
+{
+  StateTrace();
+
+  /// @return the name of the given state, or its number if unknown
+  std::string getStateName( int32_t state ) const;
+
+  /// the most recent transitions, oldest first
+  std::vector<StateTransition> transitions;
+
+  /// number of transitions since construction (including the ones
+  /// which have dropped out of the trace)
+  uint64_t num_transitions;
+
+  /// total time spent in each state, including the current one
+  std::vector<ros::WallDuration> durations;
+
+  int32_t state;
+  std::vector<std::string> state_names;
+};
+
+/// Performance metrics of the connection of an InteractiveMarkerClient to one server
+struct ClientMetrics
+{
+  enum ResetCauseT
+  {
+    RESET_SEQUENCE_ERROR,
+    RESET_TF_ERROR,
+    RESET_UNKNOWN_ERROR,
+    RESET_QUEUE_OVERFLOW,
+    NUM_RESET_CAUSES
+  };
+
+  ClientMetrics();
+
+  /// messages waiting for tf or for their predecessors. The sizes in bytes,
+  /// as well as bytes, tf_wait and update_latency below, are only measured
+  /// with InteractiveMarkerClient::setDetailedMetrics().
+  uint32_t update_queue_size;
+  uint64_t update_queue_bytes;
+  uint32_t init_queue_size;
+  uint64_t init_queue_bytes;
+
+  /// received init and update messages, and their serialized size
+  RateStats messages;
+  RateStats bytes;
+
+  /// time from receiving a message until the transform of a marker or
+  /// pose became available, by its original frame
+  std::map<std::string, DurationHistogram> tf_wait;
+
+  /// number of connection resets, indexed by ResetCauseT
+  uint64_t resets[NUM_RESET_CAUSES];
+
+  /// time from the header stamp of markers and poses to passing them
+  /// to the update callback (only for non-zero stamps, in ROS time)
+  DurationStats update_latency;
+
+  /// state changes of the connection (INIT, RECEIVING, TF_ERROR)
+  StateTrace state;
+};
+
+}
+
+#endif
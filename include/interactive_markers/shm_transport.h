@@ -0,0 +1,288 @@
+/*
+ * Copyright (c) 2012, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INTERACTIVE_MARKERS_SHM_TRANSPORT
+#define INTERACTIVE_MARKERS_SHM_TRANSPORT
+
+#include "transport.h"
+
+#include <ros/wall_timer.h>
+
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <map>
+
+namespace interactive_markers
+{
+
+/// Shared memory segment holding a ring buffer of serialized init and
+/// update messages. Written by one server, read by any number of clients
+/// on the same host. See ShmServerTransport.
+class ShmSegment : boost::noncopyable
+{
+public:
+  ShmSegment();
+  ~ShmSegment();
+
+  /// Create the segment for the given topic namespace.
+  /// Takes over segments left behind by servers which are not running anymore.
+  /// @return false if the segment is in use by a different server or cannot be created
+  bool create( const std::string& topic_ns, size_t capacity );
+
+  /// Map an existing segment for reading. Readers only write their heartbeat
+  /// into it, but still need write access.
+  /// @return false if there is no valid segment for the given topic namespace
+  bool open( const std::string& topic_ns );
+
+  /// Unmap, and unlink if we created the segment
+  void close();
+
+  bool isOpen() const { return header_ != 0; }
+
+  /// @return true if the server which created the segment is still running
+  bool isWriterAlive() const;
+
+  /// @return the server id of the writer, or an empty string if it has not been set yet
+  std::string getWriterId() const;
+
+  /// Set the server id of the writer once (writer only)
+  void setWriterId( const std::string& server_id );
+
+  /// Tell the writer that a reader of this node is attached (reader only).
+  /// Needs to be called at least once per second, otherwise another
+  /// reader can take over the slot.
+  /// @return false if all reader slots are taken
+  bool setReaderHeartbeat();
+
+  /// @return true if any reader has called setReaderHeartbeat() within the last second
+  bool hasReaders() const;
+
+  /// @return the number of readers of the given node which have called
+  ///         setReaderHeartbeat() within the last second
+  unsigned getNumReaders( const std::string& node_name ) const;
+
+  /// Serialize a message into the ring buffer (writer only).
+  /// @return false if the message does not fit
+  bool write( const visualization_msgs::InteractiveMarkerInit& init );
+  bool write( const visualization_msgs::InteractiveMarkerUpdate& update );
+
+  /// Tell readers to receive all further messages via ROS (writer only).
+  bool writeFallback();
+
+  /// Make readers which attach from now on wait for the next init message
+  /// instead of starting with the last one (writer only).
+  void clearInit();
+
+  enum ReadResultT
+  {
+    READ_NONE,     // no new message
+    READ_INIT,
+    READ_UPDATE,
+    READ_OVERRUN,  // the writer has overwritten messages we have not read yet
+    READ_FALLBACK  // the writer has stopped using the segment, see writeFallback()
+  };
+
+  /// @return the position of the newest init message, or of the end of
+  ///         the buffer if it has been overwritten
+  uint64_t getStartPosition() const;
+
+  /// Read the message at pos and advance pos to the next one.
+  /// Init (update) messages are only deserialized if init (update) is not null.
+  /// After an overrun, pos is set to getStartPosition().
+  ReadResultT read( uint64_t& pos,
+      visualization_msgs::InteractiveMarkerInitPtr* init,
+      visualization_msgs::InteractiveMarkerUpdatePtr* update ) const;
+
+  /// Read the newest init message if it is stored before the given position.
+  /// @return false if there is none
+  bool readLatestInit( uint64_t before_pos, visualization_msgs::InteractiveMarkerInitPtr& init ) const;
+
+  /// @return the name of the segment for the given topic namespace and the current ROS master
+  static std::string getName( const std::string& topic_ns );
+
+private:
+  struct Header;
+
+  template<class MsgT>
+  bool write( uint32_t type, const MsgT& msg );
+
+  // reserve space for a record and return its position
+  bool reserve( uint64_t record_size, uint64_t& pos );
+
+  // true if the data starting at pos has not been overwritten
+  bool isValid( uint64_t pos ) const;
+
+  std::string name_;
+  bool owner_;
+  size_t mapped_size_;
+  Header* header_;
+  uint8_t* data_;
+
+  // the slot claimed by setReaderHeartbeat() and the last heartbeat written to it
+  int reader_slot_;
+  uint64_t reader_heartbeat_;
+};
+
+/// Publishes init and update messages into a POSIX shared memory segment.
+/// Clients on the same host using ShmClientTransport read them from there,
+/// which avoids sending large init messages through the TCPROS loopback
+/// connection.
+///
+/// Messages are only written while a client is attached to the segment.
+/// They are only published on the ROS topics while a subscriber does not
+/// read the segment, e.g. a client using RosClientTransport. Clients reading
+/// the segment then receive them twice and drop the ROS copy.
+/// Since the init topic cannot be latched, new subscribers which do not
+/// read the segment are sent the last init message when they connect.
+///
+/// There can be only one shared memory server per topic namespace and
+/// ROS master. Additional servers on the same namespace only use ROS;
+/// clients reading from shared memory receive their messages via ROS.
+class ShmServerTransport : public ServerTransport
+{
+public:
+  /// @param node_handle  Node handle to use for the ROS topics
+  /// @param capacity     Size of the ring buffer in bytes. If a message
+  ///                     does not fit into half of it, the transport stops
+  ///                     using shared memory and all clients switch to ROS.
+  ShmServerTransport( const ros::NodeHandle& node_handle = ros::NodeHandle(),
+      size_t capacity = 64*1024*1024 );
+
+  virtual void advertise( const std::string& topic_ns, const FeedbackCallback& feedback_cb );
+
+  virtual void publish( const visualization_msgs::InteractiveMarkerInitConstPtr& init );
+  virtual void publish( const visualization_msgs::InteractiveMarkerUpdateConstPtr& update );
+
+  virtual void setKeepAlive( double period, const KeepAliveCallback& keep_alive_cb );
+
+  virtual void shutdown();
+
+  /// @return true if messages are written to shared memory
+  bool isUsingSharedMemory() const { return segment_.isOpen(); }
+
+private:
+  // check if there are readers and keep track of skipped messages
+  bool hasSegmentReaders();
+
+  // true if a node subscribed to the topic does not read all messages from the segment
+  bool hasRosSubscribers( const std::map<std::string,unsigned>& subscribers ) const;
+
+  // called from the callback queue when a node subscribes to the init or update topic
+  void subscriberConnected( const ros::SingleSubscriberPublisher& pub );
+  void subscriberDisconnected( const ros::SingleSubscriberPublisher& pub );
+
+  // write to the segment and fall back to ROS if the message is too large
+  template<class MsgT>
+  void writeSegment( const MsgT& msg );
+
+  ros::NodeHandle node_handle_;
+  RosServerTransport ros_transport_;
+  size_t capacity_;
+
+  // protects all members below, as subscribers connect from the callback queue
+  boost::mutex mutex_;
+  ShmSegment segment_;
+
+  // the newest init message and whether it is missing in the segment
+  visualization_msgs::InteractiveMarkerInitConstPtr last_init_;
+  bool skipped_init_;
+
+  // number of connections per subscribed node
+  std::string init_topic_;
+  std::map<std::string,unsigned> init_subscribers_;
+  std::map<std::string,unsigned> update_subscribers_;
+};
+
+/// Reads init and update messages from the shared memory segment of a
+/// ShmServerTransport on the same host. This saves the transfer through
+/// the TCPROS socket, but messages are still deserialized into a copy.
+///
+/// Messages of all other servers on the topic namespace (or of all servers
+/// if there is no segment) are received via ROS. The server writing the
+/// segment does not publish via ROS as long as all of its subscribers read
+/// the segment. If it does, because of other clients, its ROS messages are
+/// dropped.
+///
+/// The segment is polled from a timer in the callback queue of the node
+/// handle, so callbacks are called from the same thread as with ROS.
+class ShmClientTransport : public ClientTransport
+{
+public:
+  /// @param node_handle  Node handle to use for ROS topics and the polling timer
+  /// @param poll_period  Period in seconds for checking the segment for new messages.
+  ///                     Must be well below one second, see ShmSegment::setReaderHeartbeat().
+  ShmClientTransport( const ros::NodeHandle& node_handle = ros::NodeHandle(),
+      double poll_period = 0.01 );
+  ~ShmClientTransport();
+
+  virtual void subscribeInit( const std::string& topic_ns, const InitCallback& init_cb );
+  virtual void subscribeUpdate( const std::string& topic_ns, const UpdateCallback& update_cb );
+
+  virtual void unsubscribeInit();
+  virtual void unsubscribeUpdate();
+
+  virtual uint32_t getNumPublishers();
+
+  /// @return true if messages are read from shared memory
+  bool isUsingSharedMemory() const { return segment_.isOpen(); }
+
+  /// @return the number of messages received via ROS from the server
+  ///         writing the segment, which have been dropped
+  uint64_t getNumDroppedRosMessages() const { return dropped_ros_messages_; }
+
+  /// Read all new messages from the segment and call the callbacks.
+  /// Called periodically from the timer.
+  void poll();
+
+private:
+  void processRosInit( const visualization_msgs::InteractiveMarkerInitConstPtr& init );
+  void processRosUpdate( const visualization_msgs::InteractiveMarkerUpdateConstPtr& update );
+
+  // true if the message has been or will be received via shared memory
+  bool isFromSegment( const std::string& server_id );
+
+  ros::NodeHandle node_handle_;
+  RosClientTransport ros_transport_;
+  double poll_period_;
+
+  ShmSegment segment_;
+  uint64_t read_pos_;
+  bool deliver_latched_init_;
+  ros::WallTimer poll_timer_;
+
+  InitCallback init_cb_;
+  UpdateCallback update_cb_;
+
+  uint64_t dropped_ros_messages_;
+};
+
+}
+
+#endif
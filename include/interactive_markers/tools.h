@@ -35,21 +35,74 @@
 namespace interactive_markers
 {
 
+/// Level of detail of the default control geometry generated by autoComplete()
+enum DetailLevel
+{
+  /// choose the level based on InteractiveMarker::scale
+  DETAIL_AUTO,
+  /// 12 segments per disc
+  DETAIL_LOW,
+  /// 24 segments per disc
+  DETAIL_MEDIUM,
+  /// 36 segments per disc (default)
+  DETAIL_HIGH
+};
+
+/// @brief set the level of detail used by all subsequent calls to autoComplete().
+/// This is a process-wide setting and should be set before completing any markers.
+void setDetailLevel( DetailLevel level );
+
+/// @return the current level of detail
+DetailLevel getDetailLevel();
+
 /** @brief fill in default values & insert default controls when none are specified.
  *
  * This also calls uniqueifyControlNames().
  * @param msg      interactive marker to be completed */
 void autoComplete( visualization_msgs::InteractiveMarker &msg );
 
+/** @brief autoComplete() a batch of interactive markers.
+ *
+ * Large batches are split across all available cores. The result is
+ * identical to calling autoComplete() on each marker in order.
+ * @param msgs     interactive markers to be completed */
+void autoComplete( std::vector<visualization_msgs::InteractiveMarker> &msgs );
+
+/// @brief autoComplete() a batch of interactive markers, given by pointer.
+/// @param msgs     interactive markers to be completed
+void autoComplete( const std::vector<visualization_msgs::InteractiveMarker*> &msgs );
+
 /// @brief fill in default values & insert default controls when none are specified
 /// @param msg      interactive marker which contains the control
-/// @param control  the control to be completed
+/// @param control  the control to be completed. If it is not part of msg.controls,
+///                 marker ids are chosen as if it was appended to it.
 void autoComplete( const visualization_msgs::InteractiveMarker &msg,
     visualization_msgs::InteractiveMarkerControl &control );
 
+/// number of controls per interactive marker for which makeMarkerId() is unique
+const unsigned MAX_ID_CONTROLS = 0x8000;
+/// number of markers per control for which makeMarkerId() is unique
+const unsigned MAX_ID_MARKERS = 0x10000;
+
+/** @brief Compute the id autoComplete() assigns to a marker.
+ *
+ * Ids only depend on the position of the marker within the interactive
+ * marker, so completing the same message always yields the same ids.
+ * They are unique for up to MAX_ID_CONTROLS controls with up to
+ * MAX_ID_MARKERS markers each; autoComplete() warns when these are exceeded.
+ * @param control_index  index of the control in InteractiveMarker::controls
+ * @param marker_index   index of the marker in InteractiveMarkerControl::markers */
+inline int32_t makeMarkerId( unsigned control_index, unsigned marker_index )
+{
+  return (int32_t)( ( control_index << 16 ) | ( marker_index & 0xffff ) );
+}
+
 /** @brief Make sure all the control names are unique within the given msg.
  *
- * Appends _u0 _u1 etc to repeated names (not including the first of each).
+ * Appends _u0 _u1 etc to repeated names (not including the first of each),
+ * counting across all names, so three controls named "a" become "a", "a_u0"
+ * and "a_u1". If a suffixed name is taken as well, another suffix is appended
+ * to it, e.g. "a_u0_u1".
  * This is called by autoComplete( visualization_msgs::InteractiveMarker &msg ). */
 void uniqueifyControlNames( visualization_msgs::InteractiveMarker& msg );
 
@@ -69,6 +122,7 @@ void makeArrow( const visualization_msgs::InteractiveMarker &msg,
     visualization_msgs::InteractiveMarkerControl &control, float pos );
 
 /// @brief make a default-style disc marker (e.g for rotating) based on the properties of the given interactive marker
+/// The number of segments depends on the current detail level (see setDetailLevel()).
 /// @param msg      the interactive marker that this will go into
 /// @param width    width of the disc, relative to its inner radius
 void makeDisc( const visualization_msgs::InteractiveMarker &msg,
@@ -78,7 +132,7 @@ void makeDisc( const visualization_msgs::InteractiveMarker &msg,
 /// @param msg      the interactive marker that this will go into
 /// @param text     the text to display
 void makeViewFacingButton( const visualization_msgs::InteractiveMarker &msg,
-    visualization_msgs::InteractiveMarkerControl &control, std::string text );
+    visualization_msgs::InteractiveMarkerControl &control, const std::string &text );
 
 /// assign an RGB value to the given marker based on the given orientation
 void assignDefaultColor(visualization_msgs::Marker &marker, const geometry_msgs::Quaternion &quat );
@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2012, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INTERACTIVE_MARKERS_TRANSPORT
+#define INTERACTIVE_MARKERS_TRANSPORT
+
+#include <visualization_msgs/InteractiveMarkerInit.h>
+#include <visualization_msgs/InteractiveMarkerUpdate.h>
+#include <visualization_msgs/InteractiveMarkerFeedback.h>
+
+#include <ros/message_event.h>
+#include <ros/node_handle.h>
+#include <ros/publisher.h>
+#include <ros/subscriber.h>
+
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <string>
+
+namespace interactive_markers
+{
+
+/// The channels of one InteractiveMarkerServer: it publishes init and
+/// update messages and receives feedback from the GUIs.
+class ServerTransport
+{
+public:
+  /// receive_time is the time, according to getDefaultClock(), at which
+  /// the transport received the message, i.e. before it waited in any queue
+  typedef boost::function< void ( const visualization_msgs::InteractiveMarkerFeedbackConstPtr&,
+      const ros::WallTime& receive_time ) > FeedbackCallback;
+  typedef boost::function< void () > KeepAliveCallback;
+
+  virtual ~ServerTransport() {}
+
+  /// Open the channels of the given topic namespace.
+  /// The last init message must be delivered to clients that connect later on.
+  virtual void advertise( const std::string& topic_ns, const FeedbackCallback& feedback_cb ) = 0;
+
+  /// Messages are passed by pointer, so they can be delivered to
+  /// subscribers in the same process without copying or serialization.
+  virtual void publish( const visualization_msgs::InteractiveMarkerInitConstPtr& init ) = 0;
+  virtual void publish( const visualization_msgs::InteractiveMarkerUpdateConstPtr& update ) = 0;
+
+  /// Call keep_alive_cb every period seconds, from the same thread as the
+  /// feedback callback, until shutdown() is called. The server uses this
+  /// to publish keep-alive messages while there are no updates.
+  virtual void setKeepAlive( double period, const KeepAliveCallback& keep_alive_cb ) = 0;
+
+  /// Close all channels. The feedback and keep-alive callbacks must not
+  /// be called afterwards.
+  virtual void shutdown() = 0;
+};
+
+typedef boost::shared_ptr<ServerTransport> ServerTransportPtr;
+
+/// The channels of one InteractiveMarkerClient, receiving init and update
+/// messages from any number of servers.
+class ClientTransport
+{
+public:
+  typedef boost::function< void ( const visualization_msgs::InteractiveMarkerInitConstPtr& ) > InitCallback;
+  typedef boost::function< void ( const visualization_msgs::InteractiveMarkerUpdateConstPtr& ) > UpdateCallback;
+
+  virtual ~ClientTransport() {}
+
+  virtual void subscribeInit( const std::string& topic_ns, const InitCallback& init_cb ) = 0;
+  virtual void subscribeUpdate( const std::string& topic_ns, const UpdateCallback& update_cb ) = 0;
+
+  virtual void unsubscribeInit() = 0;
+  virtual void unsubscribeUpdate() = 0;
+
+  /// @return the number of servers publishing on the update channel
+  virtual uint32_t getNumPublishers() = 0;
+};
+
+typedef boost::shared_ptr<ClientTransport> ClientTransportPtr;
+
+/// Uses the topics topic_ns/update, topic_ns/update_full and topic_ns/feedback.
+/// This is the default.
+class RosServerTransport : public ServerTransport
+{
+public:
+  /// @param node_handle  Node handle (and thereby callback queue) to use
+  RosServerTransport( const ros::NodeHandle& node_handle = ros::NodeHandle() );
+
+  virtual void advertise( const std::string& topic_ns, const FeedbackCallback& feedback_cb );
+
+  virtual void publish( const visualization_msgs::InteractiveMarkerInitConstPtr& init );
+  virtual void publish( const visualization_msgs::InteractiveMarkerUpdateConstPtr& update );
+
+  /// Uses a ros::Timer in the callback queue of the node handle
+  virtual void setKeepAlive( double period, const KeepAliveCallback& keep_alive_cb );
+
+  virtual void shutdown();
+
+  /// Call connect_cb (disconnect_cb) from the callback queue of the node
+  /// handle when a node subscribes to (unsubscribes from) the init or
+  /// update topic. The init topic is not latched then, connect_cb has to
+  /// send the current init message to new subscribers instead.
+  /// Must be called before advertise().
+  void setSubscriberCallbacks( const ros::SubscriberStatusCallback& connect_cb,
+      const ros::SubscriberStatusCallback& disconnect_cb );
+
+private:
+  void processFeedback( const ros::MessageEvent<visualization_msgs::InteractiveMarkerFeedback const>& event );
+
+  ros::NodeHandle node_handle_;
+  ros::Publisher init_pub_;
+  ros::Publisher update_pub_;
+  ros::Subscriber feedback_sub_;
+  FeedbackCallback feedback_cb_;
+  ros::Timer keep_alive_timer_;
+  ros::SubscriberStatusCallback connect_cb_;
+  ros::SubscriberStatusCallback disconnect_cb_;
+};
+
+/// Uses the topics topic_ns/update and topic_ns/update_full.
+/// This is the default.
+class RosClientTransport : public ClientTransport
+{
+public:
+  /// @param node_handle  Node handle (and thereby callback queue) to use
+  RosClientTransport( const ros::NodeHandle& node_handle = ros::NodeHandle() );
+
+  /// throws ros::Exception on failure
+  virtual void subscribeInit( const std::string& topic_ns, const InitCallback& init_cb );
+  virtual void subscribeUpdate( const std::string& topic_ns, const UpdateCallback& update_cb );
+
+  virtual void unsubscribeInit();
+  virtual void unsubscribeUpdate();
+
+  virtual uint32_t getNumPublishers();
+
+private:
+  ros::NodeHandle node_handle_;
+  ros::Subscriber init_sub_;
+  ros::Subscriber update_sub_;
+};
+
+}
+
+#endif
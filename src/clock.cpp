@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2012, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "interactive_markers/clock.h"
+
+#include <time.h>
+
+namespace interactive_markers
+{
+
+ros::WallTime SteadyClock::now()
+{
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ros::WallTime( ts.tv_sec, ts.tv_nsec );
+}
+
+ManualClock::ManualClock( const ros::WallTime& start )
+: time_(start)
+{
+}
+
+ros::WallTime ManualClock::now()
+{
+  boost::mutex::scoped_lock lock( mutex_ );
+  return time_;
+}
+
+void ManualClock::set( const ros::WallTime& time )
+{
+  boost::mutex::scoped_lock lock( mutex_ );
+  time_ = time;
+}
+
+void ManualClock::advance( const ros::WallDuration& duration )
+{
+  boost::mutex::scoped_lock lock( mutex_ );
+  time_ = time_ + duration;
+}
+
+ClockPtr getDefaultClock()
+{
+  static ClockPtr clock( new SteadyClock() );
+  return clock;
+}
+
+}
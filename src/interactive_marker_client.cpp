@@ -47,8 +47,33 @@ InteractiveMarkerClient::InteractiveMarkerClient(
     const std::string& target_frame,
     const std::string &topic_ns )
 : state_("InteractiveMarkerClient",IDLE)
+, transport_(new RosClientTransport())
 , tf_(tf)
 , last_num_publishers_(0)
+, differential_resync_(false)
+, detailed_metrics_(false)
+, clock_(getDefaultClock())
+{
+  target_frame_ = target_frame;
+  if ( !topic_ns.empty() )
+  {
+    subscribe( topic_ns );
+  }
+  callbacks_.setStatusCb( boost::bind( &InteractiveMarkerClient::statusCb, this, _1, _2, _3 ) );
+}
+
+InteractiveMarkerClient::InteractiveMarkerClient(
+    tf::Transformer& tf,
+    const ClientTransportPtr& transport,
+    const std::string& target_frame,
+    const std::string &topic_ns )
+: state_("InteractiveMarkerClient",IDLE)
+, transport_(transport)
+, tf_(tf)
+, last_num_publishers_(0)
+, differential_resync_(false)
+, detailed_metrics_(false)
+, clock_(getDefaultClock())
 {
   target_frame_ = target_frame;
   if ( !topic_ns.empty() )
@@ -91,6 +116,75 @@ void InteractiveMarkerClient::setStatusCb( const StatusCallback& cb )
   status_cb_ = cb;
 }
 
+void InteractiveMarkerClient::setDifferentialResync( bool enable )
+{
+  differential_resync_ = enable;
+  M_SingleClient::iterator it;
+  for ( it = publisher_contexts_.begin(); it!=publisher_contexts_.end(); ++it )
+  {
+    it->second->setDifferentialResync( enable );
+  }
+}
+
+void InteractiveMarkerClient::setDetailedMetrics( bool enable )
+{
+  detailed_metrics_ = enable;
+  M_SingleClient::iterator it;
+  for ( it = publisher_contexts_.begin(); it!=publisher_contexts_.end(); ++it )
+  {
+    it->second->setDetailedMetrics( enable );
+  }
+}
+
+void InteractiveMarkerClient::enableMarkerStore( bool enable )
+{
+  if ( !enable )
+  {
+    callbacks_.setStore( MarkerStorePtr() );
+  }
+  else if ( !callbacks_.getStore() )
+  {
+    callbacks_.setStore( boost::make_shared<MarkerStore>() );
+  }
+}
+
+MarkerStorePtr InteractiveMarkerClient::getMarkerStore() const
+{
+  return callbacks_.getStore();
+}
+
+void InteractiveMarkerClient::setClock( const ClockPtr& clock )
+{
+  clock_ = clock;
+  state_.setClock( clock );
+  M_SingleClient::iterator it;
+  for ( it = publisher_contexts_.begin(); it!=publisher_contexts_.end(); ++it )
+  {
+    it->second->setClock( clock );
+  }
+}
+
+void InteractiveMarkerClient::getMetrics( M_ClientMetrics& metrics ) const
+{
+  metrics.clear();
+  M_SingleClient::const_iterator it;
+  for ( it = publisher_contexts_.begin(); it!=publisher_contexts_.end(); ++it )
+  {
+    metrics[it->first] = it->second->getMetrics();
+  }
+}
+
+StateTrace InteractiveMarkerClient::getStateTrace() const
+{
+  StateTrace trace;
+  state_.getTrace( trace );
+  trace.state_names.resize( 3 );
+  trace.state_names[IDLE] = "IDLE";
+  trace.state_names[INIT] = "INIT";
+  trace.state_names[RUNNING] = "RUNNING";
+  return trace;
+}
+
 void InteractiveMarkerClient::setTargetFrame( std::string target_frame )
 {
   target_frame_ = target_frame;
@@ -120,8 +214,8 @@ void InteractiveMarkerClient::shutdown()
   case INIT:
   case RUNNING:
     publisher_contexts_.clear();
-    init_sub_.shutdown();
-    update_sub_.shutdown();
+    transport_->unsubscribeInit();
+    transport_->unsubscribeUpdate();
     last_num_publishers_=0;
     state_=IDLE;
     break;
@@ -134,16 +228,19 @@ void InteractiveMarkerClient::subscribeUpdate()
   {
     try
     {
-      update_sub_ = nh_.subscribe( topic_ns_+"/update", 100, &InteractiveMarkerClient::processUpdate, this );
+      transport_->subscribeUpdate( topic_ns_, boost::bind( &InteractiveMarkerClient::processUpdate, this, _1 ) );
       DBG_MSG( "Subscribed to update topic: %s", (topic_ns_+"/update").c_str() );
     }
     catch( ros::Exception& e )
     {
-      callbacks_.statusCb( ERROR, "General", "Error subscribing: " + std::string(e.what()) );
+      if ( general_status_.changed( ERROR, SUBSCRIBE_ERROR ) )
+      {
+        callbacks_.statusCb( ERROR, "General", "Error subscribing: " + std::string(e.what()) );
+      }
       return;
     }
   }
-  callbacks_.statusCb( OK, "General", "Waiting for messages.");
+  setGeneralStatus( OK, WAITING_FOR_MESSAGES, "Waiting for messages." );
 }
 
 void InteractiveMarkerClient::subscribeInit()
@@ -152,13 +249,16 @@ void InteractiveMarkerClient::subscribeInit()
   {
     try
     {
-      init_sub_ = nh_.subscribe( topic_ns_+"/update_full", 100, &InteractiveMarkerClient::processInit, this );
+      transport_->subscribeInit( topic_ns_, boost::bind( &InteractiveMarkerClient::processInit, this, _1 ) );
       DBG_MSG( "Subscribed to init topic: %s", (topic_ns_+"/update_full").c_str() );
       state_ = INIT;
     }
     catch( ros::Exception& e )
     {
-      callbacks_.statusCb( ERROR, "General", "Error subscribing: " + std::string(e.what()) );
+      if ( general_status_.changed( ERROR, SUBSCRIBE_ERROR ) )
+      {
+        callbacks_.statusCb( ERROR, "General", "Error subscribing: " + std::string(e.what()) );
+      }
     }
   }
 }
@@ -166,15 +266,15 @@ void InteractiveMarkerClient::subscribeInit()
 template<class MsgConstPtrT>
 void InteractiveMarkerClient::process( const MsgConstPtrT& msg )
 {
-  callbacks_.statusCb( OK, "General", "Receiving messages.");
-
   // get caller ID of the sending entity
   if ( msg->server_id.empty() )
   {
-    callbacks_.statusCb( ERROR, "General", "Received message with empty server_id!");
+    setGeneralStatus( ERROR, EMPTY_SERVER_ID, "Received message with empty server_id!" );
     return;
   }
 
+  setGeneralStatus( OK, RECEIVING_MESSAGES, "Receiving messages." );
+
   M_SingleClient::iterator context_it = publisher_contexts_.find(msg->server_id);
 
   // If we haven't seen this publisher before, we need to reset the
@@ -184,7 +284,9 @@ void InteractiveMarkerClient::process( const MsgConstPtrT& msg )
   {
     DBG_MSG( "New publisher detected: %s", msg->server_id.c_str() );
 
-    SingleClientPtr pc(new SingleClient( msg->server_id, tf_, target_frame_, callbacks_ ));
+    SingleClientPtr pc(new SingleClient( msg->server_id, tf_, target_frame_, callbacks_, clock_ ));
+    pc->setDifferentialResync( differential_resync_ );
+    pc->setDetailedMetrics( detailed_metrics_ );
     context_it = publisher_contexts_.insert( std::make_pair(msg->server_id,pc) ).first;
 
     // we need to subscribe to the init topic again
@@ -216,15 +318,15 @@ void InteractiveMarkerClient::update()
   case RUNNING:
   {
     // check if one publisher has gone offline
-    if ( update_sub_.getNumPublishers() < last_num_publishers_ )
+    if ( transport_->getNumPublishers() < last_num_publishers_ )
     {
-      callbacks_.statusCb( ERROR, "General", "Server is offline. Resetting." );
+      setGeneralStatus( ERROR, SERVER_OFFLINE, "Server is offline. Resetting." );
       shutdown();
       subscribeUpdate();
       subscribeInit();
       return;
     }
-    last_num_publishers_ = update_sub_.getNumPublishers();
+    last_num_publishers_ = transport_->getNumPublishers();
 
     // check if all single clients are finished with the init channels
     bool initialized = true;
@@ -239,7 +341,7 @@ void InteractiveMarkerClient::update()
     }
     if ( state_ == INIT && initialized )
     {
-      init_sub_.shutdown();
+      transport_->unsubscribeInit();
       state_ = RUNNING;
     }
     if ( state_ == RUNNING && !initialized )
@@ -251,6 +353,14 @@ void InteractiveMarkerClient::update()
   }
 }
 
+void InteractiveMarkerClient::setGeneralStatus( StatusT status, GeneralStatusT code, const char* msg )
+{
+  if ( general_status_.changed( status, code ) )
+  {
+    callbacks_.statusCb( status, "General", msg );
+  }
+}
+
 void InteractiveMarkerClient::statusCb( StatusT status, const std::string& server_id, const std::string& msg )
 {
   switch ( status )
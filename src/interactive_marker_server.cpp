@@ -33,22 +33,50 @@
 
 #include <visualization_msgs/InteractiveMarkerInit.h>
 
+#include <diagnostic_msgs/DiagnosticArray.h>
+
 #include <boost/bind.hpp>
 #include <boost/make_shared.hpp>
 
+#include <sstream>
+
 namespace interactive_markers
 {
 
 InteractiveMarkerServer::InteractiveMarkerServer( const std::string &topic_ns, const std::string &server_id, bool spin_thread ) :
     topic_ns_(topic_ns),
-    seq_num_(0)
+    seq_num_(0),
+    clock_(getDefaultClock()),
+    metrics_clock_(getDefaultClock()),
+    detailed_metrics_(false),
+    lock_depth_(0)
 {
+  node_handle_.reset( new ros::NodeHandle() );
   if ( spin_thread )
   {
     // if we're spinning our own thread, we'll also need our own callback queue
-    node_handle_.setCallbackQueue( &callback_queue_ );
+    node_handle_->setCallbackQueue( &callback_queue_ );
   }
 
+  transport_.reset( new RosServerTransport( *node_handle_ ) );
+  init( server_id, spin_thread );
+}
+
+InteractiveMarkerServer::InteractiveMarkerServer( const std::string &topic_ns, const ServerTransportPtr &transport,
+    const std::string &server_id ) :
+    topic_ns_(topic_ns),
+    transport_(transport),
+    seq_num_(0),
+    clock_(getDefaultClock()),
+    metrics_clock_(getDefaultClock()),
+    detailed_metrics_(false),
+    lock_depth_(0)
+{
+  init( server_id, false );
+}
+
+void InteractiveMarkerServer::init( const std::string &server_id, bool spin_thread )
+{
   if (!server_id.empty())
   {
     server_id_ = ros::this_node::getName() + "/" + server_id;
@@ -58,15 +86,9 @@ InteractiveMarkerServer::InteractiveMarkerServer( const std::string &topic_ns, c
     server_id_ = ros::this_node::getName();
   }
 
-  std::string update_topic = topic_ns + "/update";
-  std::string init_topic = update_topic + "_full";
-  std::string feedback_topic = topic_ns + "/feedback";
+  transport_->advertise( topic_ns_, boost::bind( &InteractiveMarkerServer::processFeedback, this, _1, _2 ) );
 
-  init_pub_ = node_handle_.advertise<visualization_msgs::InteractiveMarkerInit>( init_topic, 100, true );
-  update_pub_ = node_handle_.advertise<visualization_msgs::InteractiveMarkerUpdate>( update_topic, 100 );
-  feedback_sub_ = node_handle_.subscribe( feedback_topic, 100, &InteractiveMarkerServer::processFeedback, this );
-
-  keep_alive_timer_ =  node_handle_.createTimer(ros::Duration(0.5f), boost::bind( &InteractiveMarkerServer::keepAlive, this ) );
+  transport_->setKeepAlive( 0.5, boost::bind( &InteractiveMarkerServer::keepAlive, this ) );
 
   if ( spin_thread )
   {
@@ -86,17 +108,19 @@ InteractiveMarkerServer::~InteractiveMarkerServer()
     spin_thread_->join();
   }
 
-  if ( node_handle_.ok() )
+  if ( !node_handle_ || node_handle_->ok() )
   {
     clear();
     applyChanges();
   }
+
+  transport_->shutdown();
 }
 
 
 void InteractiveMarkerServer::spinThread()
 {
-  while (node_handle_.ok())
+  while (node_handle_->ok())
   {
     if (need_to_terminate_)
     {
@@ -109,16 +133,21 @@ void InteractiveMarkerServer::spinThread()
 
 void InteractiveMarkerServer::applyChanges()
 {
-  boost::recursive_mutex::scoped_lock lock( mutex_ );
+  ScopedLock lock( *this );
 
   if ( pending_updates_.empty() )
   {
     return;
   }
 
+  ros::WallTime start_time = metrics_clock_->now();
+
   M_UpdateContext::iterator update_it;
 
-  visualization_msgs::InteractiveMarkerUpdate update;
+  // published by pointer, so subscribers in the same process
+  // receive it without serialization
+  visualization_msgs::InteractiveMarkerUpdatePtr update_msg( new visualization_msgs::InteractiveMarkerUpdate() );
+  visualization_msgs::InteractiveMarkerUpdate& update = *update_msg;
   update.type = visualization_msgs::InteractiveMarkerUpdate::UPDATE;
 
   update.markers.reserve( marker_contexts_.size() );
@@ -169,6 +198,23 @@ void InteractiveMarkerServer::applyChanges()
         break;
       }
 
+      case UpdateContext::MENU_UPDATE:
+      {
+        if ( marker_context_it == marker_contexts_.end() )
+        {
+          ROS_ERROR( "Pending menu update for non-existing marker found. This is a bug in InteractiveMarkerInterface." );
+        }
+        else
+        {
+          marker_context_it->second.int_marker.menu_entries = *update_it->second.menu_entries;
+
+          // the update message has no field for menus only, so the
+          // marker still goes out in full
+          update.markers.push_back( marker_context_it->second.int_marker );
+        }
+        break;
+      }
+
       case UpdateContext::ERASE:
       {
         if ( marker_context_it != marker_contexts_.end() )
@@ -183,15 +229,24 @@ void InteractiveMarkerServer::applyChanges()
 
   seq_num_++;
 
-  publish( update );
+  metrics_.last_update_markers = update.markers.size();
+  metrics_.last_update_poses = update.poses.size();
+  metrics_.last_update_erases = update.erases.size();
+  metrics_.markers += update.markers.size();
+  metrics_.poses += update.poses.size();
+  metrics_.erases += update.erases.size();
+
+  publish( update_msg );
   publishInit();
   pending_updates_.clear();
+
+  metrics_.apply_changes.add( metrics_clock_->now() - start_time );
 }
 
 
 bool InteractiveMarkerServer::erase( const std::string &name )
 {
-  boost::recursive_mutex::scoped_lock lock( mutex_ );
+  ScopedLock lock( *this );
 
   pending_updates_[name].update_type = UpdateContext::ERASE;
   return true;
@@ -211,7 +266,7 @@ void InteractiveMarkerServer::clear()
 
 bool InteractiveMarkerServer::setPose( const std::string &name, const geometry_msgs::Pose &pose, const std_msgs::Header &header )
 {
-  boost::recursive_mutex::scoped_lock lock( mutex_ );
+  ScopedLock lock( *this );
 
   M_MarkerContext::iterator marker_context_it = marker_contexts_.find( name );
   M_UpdateContext::iterator update_it = pending_updates_.find( name );
@@ -235,9 +290,61 @@ bool InteractiveMarkerServer::setPose( const std::string &name, const geometry_m
   return true;
 }
 
+bool InteractiveMarkerServer::setMenuEntries( const std::string &name,
+    const std::vector<visualization_msgs::MenuEntry> &menu_entries )
+{
+  ScopedLock lock( *this );
+
+  return doSetMenuEntries( name, boost::make_shared< std::vector<visualization_msgs::MenuEntry> >( menu_entries ) );
+}
+
+bool InteractiveMarkerServer::setMenuEntries( const std::vector<std::string> &names,
+    const MenuEntriesConstPtr &menu_entries,
+    std::vector<std::string> *missing_names )
+{
+  ScopedLock lock( *this );
+
+  bool success = true;
+  for ( unsigned i=0; i<names.size(); i++ )
+  {
+    if ( !doSetMenuEntries( names[i], menu_entries ) )
+    {
+      success = false;
+      if ( missing_names )
+      {
+        missing_names->push_back( names[i] );
+      }
+    }
+  }
+  return success;
+}
+
+bool InteractiveMarkerServer::setMenuEntries( const std::vector<std::string> &names,
+    const std::vector<MenuEntriesConstPtr> &menu_entries,
+    std::vector<std::string> *missing_names )
+{
+  ROS_ASSERT( names.size() == menu_entries.size() );
+
+  ScopedLock lock( *this );
+
+  bool success = true;
+  for ( unsigned i=0; i<names.size(); i++ )
+  {
+    if ( !doSetMenuEntries( names[i], menu_entries[i] ) )
+    {
+      success = false;
+      if ( missing_names )
+      {
+        missing_names->push_back( names[i] );
+      }
+    }
+  }
+  return success;
+}
+
 bool InteractiveMarkerServer::setCallback( const std::string &name, FeedbackCallback feedback_cb, uint8_t feedback_type  )
 {
-  boost::recursive_mutex::scoped_lock lock( mutex_ );
+  ScopedLock lock( *this );
 
   M_MarkerContext::iterator marker_context_it = marker_contexts_.find( name );
   M_UpdateContext::iterator update_it = pending_updates_.find( name );
@@ -293,7 +400,7 @@ bool InteractiveMarkerServer::setCallback( const std::string &name, FeedbackCall
 
 void InteractiveMarkerServer::insert( const visualization_msgs::InteractiveMarker &int_marker )
 {
-  boost::recursive_mutex::scoped_lock lock( mutex_ );
+  ScopedLock lock( *this );
 
   M_UpdateContext::iterator update_it = pending_updates_.find( int_marker.name );
   if ( update_it == pending_updates_.end() )
@@ -347,6 +454,18 @@ bool InteractiveMarkerServer::get( std::string name, visualization_msgs::Interac
       return true;
     }
 
+    case UpdateContext::MENU_UPDATE:
+    {
+      M_MarkerContext::const_iterator marker_context_it = marker_contexts_.find( name );
+      if ( marker_context_it == marker_contexts_.end() )
+      {
+        return false;
+      }
+      int_marker = marker_context_it->second.int_marker;
+      int_marker.menu_entries = *update_it->second.menu_entries;
+      return true;
+    }
+
     case UpdateContext::FULL_UPDATE:
       int_marker = update_it->second.int_marker;
       return true;
@@ -355,11 +474,20 @@ bool InteractiveMarkerServer::get( std::string name, visualization_msgs::Interac
   return false;
 }
 
+void InteractiveMarkerServer::setClock( const ClockPtr& clock )
+{
+  ScopedLock lock( *this );
+  clock_ = clock;
+}
+
 void InteractiveMarkerServer::publishInit()
 {
-  boost::recursive_mutex::scoped_lock lock( mutex_ );
+  ScopedLock lock( *this );
 
-  visualization_msgs::InteractiveMarkerInit init;
+  ros::WallTime start_time = metrics_clock_->now();
+
+  visualization_msgs::InteractiveMarkerInitPtr init_msg( new visualization_msgs::InteractiveMarkerInit() );
+  visualization_msgs::InteractiveMarkerInit& init = *init_msg;
   init.server_id = server_id_;
   init.seq_num = seq_num_;
   init.markers.reserve( marker_contexts_.size() );
@@ -371,32 +499,159 @@ void InteractiveMarkerServer::publishInit()
     init.markers.push_back( it->second.int_marker );
   }
 
-  init_pub_.publish( init );
+  metrics_.inits++;
+  if ( detailed_metrics_ )
+  {
+    metrics_.last_init_bytes = ros::serialization::serializationLength( init );
+  }
+
+  transport_->publish( init_msg );
+
+  metrics_.publish_init.add( metrics_clock_->now() - start_time );
+}
+
+ServerMetrics InteractiveMarkerServer::getMetrics()
+{
+  ScopedLock lock( *this );
+  metrics_.markers_published = marker_contexts_.size();
+  metrics_.pending_updates = pending_updates_.size();
+  return metrics_;
+}
+
+void InteractiveMarkerServer::setDetailedMetrics( bool enable )
+{
+  ScopedLock lock( *this );
+  detailed_metrics_ = enable;
+}
+
+void InteractiveMarkerServer::setDiagnosticsPeriod( double period )
+{
+  ScopedLock lock( *this );
+
+  diagnostics_timer_.stop();
+  if ( period <= 0 )
+  {
+    return;
+  }
+
+  if ( !node_handle_ )
+  {
+    // diagnostics always go out over ROS, even with a custom transport
+    node_handle_.reset( new ros::NodeHandle() );
+  }
+  if ( !diagnostics_pub_ )
+  {
+    diagnostics_pub_ = node_handle_->advertise<diagnostic_msgs::DiagnosticArray>( "/diagnostics", 1 );
+  }
+  diagnostics_timer_ = node_handle_->createTimer( ros::Duration( period ),
+      boost::bind( &InteractiveMarkerServer::publishDiagnostics, this ) );
+}
+
+namespace
+{
+
+template<class T>
+void addValue( diagnostic_msgs::DiagnosticStatus& status, const std::string& key, const T& value )
+{
+  std::ostringstream s;
+  s << value;
+  diagnostic_msgs::KeyValue key_value;
+  key_value.key = key;
+  key_value.value = s.str();
+  status.values.push_back( key_value );
+}
+
+void addValue( diagnostic_msgs::DiagnosticStatus& status, const std::string& key, const DurationStats& value )
+{
+  addValue( status, key + " mean [s]", value.mean() );
+  addValue( status, key + " max [s]", value.max.toSec() );
+}
+
+}
+
+void InteractiveMarkerServer::publishDiagnostics()
+{
+  ServerMetrics metrics = getMetrics();
+
+  diagnostic_msgs::DiagnosticStatus status;
+  status.level = diagnostic_msgs::DiagnosticStatus::OK;
+  status.name = "interactive_markers: " + server_id_;
+  status.message = "OK";
+
+  addValue( status, "Markers", metrics.markers_published );
+  addValue( status, "Pending updates", metrics.pending_updates );
+  addValue( status, "Updates", metrics.updates );
+  addValue( status, "Last update markers", metrics.last_update_markers );
+  addValue( status, "Last update poses", metrics.last_update_poses );
+  addValue( status, "Last update erases", metrics.last_update_erases );
+  addValue( status, "Update bytes", metrics.update_bytes );
+  addValue( status, "Last update bytes", metrics.last_update_bytes );
+  addValue( status, "Last init bytes", metrics.last_init_bytes );
+  addValue( status, "applyChanges", metrics.apply_changes );
+  addValue( status, "publishInit", metrics.publish_init );
+  addValue( status, "Lock wait", metrics.lock_wait );
+  addValue( status, "Lock hold", metrics.lock_hold );
+  addValue( status, "Feedback messages", metrics.feedback.count );
+  addValue( status, "Feedback rate [Hz]", metrics.feedback.rate );
+  addValue( status, "Feedback latency", metrics.feedback_latency );
+  addValue( status, "Feedback for unknown markers", metrics.feedback_unknown );
+  addValue( status, "Rejected feedback", metrics.feedback_rejected );
+
+  diagnostic_msgs::DiagnosticArray diagnostics;
+  diagnostics.header.stamp = ros::Time::now();
+  diagnostics.status.push_back( status );
+  diagnostics_pub_.publish( diagnostics );
+}
+
+InteractiveMarkerServer::ScopedLock::ScopedLock( InteractiveMarkerServer& server )
+: server_(server)
+, start_time_(server.metrics_clock_->now())
+, lock_(server.mutex_)
+{
+  // only the outermost lock of the recursive mutex counts
+  if ( server_.lock_depth_++ == 0 )
+  {
+    server_.lock_time_ = server_.metrics_clock_->now();
+    server_.metrics_.lock_wait.add( server_.lock_time_ - start_time_ );
+  }
+}
+
+InteractiveMarkerServer::ScopedLock::~ScopedLock()
+{
+  if ( --server_.lock_depth_ == 0 )
+  {
+    server_.metrics_.lock_hold.add( server_.metrics_clock_->now() - server_.lock_time_ );
+  }
 }
 
-void InteractiveMarkerServer::processFeedback( const FeedbackConstPtr& feedback )
+void InteractiveMarkerServer::processFeedback( const FeedbackConstPtr& feedback, const ros::WallTime& receive_time )
 {
-  boost::recursive_mutex::scoped_lock lock( mutex_ );
+  ScopedLock lock( *this );
+
+  metrics_.feedback.add( metrics_clock_->now() );
 
   M_MarkerContext::iterator marker_context_it = marker_contexts_.find( feedback->marker_name );
 
   // ignore feedback for non-existing markers
   if ( marker_context_it == marker_contexts_.end() )
   {
+    metrics_.feedback_unknown++;
     return;
   }
 
   MarkerContext &marker_context = marker_context_it->second;
+  ros::WallTime now = clock_->now();
 
   // if two callers try to modify the same marker, reject (timeout= 1 sec)
   if ( marker_context.last_client_id != feedback->client_id &&
-      (ros::Time::now() - marker_context.last_feedback).toSec() < 1.0 )
+      (now - marker_context.last_feedback).toSec() < 1.0 )
   {
     ROS_DEBUG( "Rejecting feedback for %s: conflicting feedback from separate clients.", feedback->marker_name.c_str() );
+    metrics_.feedback_rejected++;
     return;
   }
 
-  marker_context.last_feedback = ros::Time::now();
+  marker_context.last_feedback = now;
   marker_context.last_client_id = feedback->client_id;
 
   if ( feedback->event_type == visualization_msgs::InteractiveMarkerFeedback::POSE_UPDATE )
@@ -417,11 +672,13 @@ void InteractiveMarkerServer::processFeedback( const FeedbackConstPtr& feedback
   if ( feedback_cb_it != marker_context.feedback_cbs.end() && feedback_cb_it->second )
   {
     // call type-specific callback
+    metrics_.feedback_latency.add( metrics_clock_->now() - receive_time );
     feedback_cb_it->second( feedback );
   }
   else if ( marker_context.default_feedback_cb )
   {
     // call default callback
+    metrics_.feedback_latency.add( metrics_clock_->now() - receive_time );
     marker_context.default_feedback_cb(  feedback );
   }
 }
@@ -429,20 +686,104 @@ void InteractiveMarkerServer::processFeedback( const FeedbackConstPtr& feedback
 
 void InteractiveMarkerServer::keepAlive()
 {
-  visualization_msgs::InteractiveMarkerUpdate empty_update;
-  empty_update.type = visualization_msgs::InteractiveMarkerUpdate::KEEP_ALIVE;
+  ScopedLock lock( *this );
+
+  visualization_msgs::InteractiveMarkerUpdatePtr empty_update( new visualization_msgs::InteractiveMarkerUpdate() );
+  empty_update->type = visualization_msgs::InteractiveMarkerUpdate::KEEP_ALIVE;
   publish( empty_update );
 }
 
 
-void InteractiveMarkerServer::publish( visualization_msgs::InteractiveMarkerUpdate &update )
+void InteractiveMarkerServer::publish( const visualization_msgs::InteractiveMarkerUpdatePtr &update )
 {
-  update.server_id = server_id_;
-  update.seq_num = seq_num_;
-  update_pub_.publish( update );
+  update->server_id = server_id_;
+  update->seq_num = seq_num_;
+
+  metrics_.updates++;
+  if ( detailed_metrics_ )
+  {
+    uint32_t bytes = ros::serialization::serializationLength( *update );
+    metrics_.update_bytes += bytes;
+    metrics_.last_update_bytes = bytes;
+  }
+
+  transport_->publish( update );
 }
 
 
+void InteractiveMarkerServer::makeFullUpdate( M_UpdateContext::iterator update_it )
+{
+  M_MarkerContext::iterator marker_context_it = marker_contexts_.find( update_it->first );
+  if ( marker_context_it == marker_contexts_.end() )
+  {
+    ROS_ERROR( "Pending update for non-existing marker found. This is a bug in InteractiveMarkerInterface." );
+    return;
+  }
+
+  visualization_msgs::InteractiveMarker& pending = update_it->second.int_marker;
+
+  switch ( update_it->second.update_type )
+  {
+    case UpdateContext::POSE_UPDATE:
+    {
+      geometry_msgs::Pose pose = pending.pose;
+      std_msgs::Header header = pending.header;
+      pending = marker_context_it->second.int_marker;
+      pending.pose = pose;
+      pending.header = header;
+      break;
+    }
+
+    case UpdateContext::MENU_UPDATE:
+      pending = marker_context_it->second.int_marker;
+      pending.menu_entries = *update_it->second.menu_entries;
+      update_it->second.menu_entries.reset();
+      break;
+
+    default:
+      return;
+  }
+
+  update_it->second.update_type = UpdateContext::FULL_UPDATE;
+}
+
+bool InteractiveMarkerServer::doSetMenuEntries( const std::string &name, const MenuEntriesConstPtr &menu_entries )
+{
+  M_UpdateContext::iterator update_it = pending_updates_.find( name );
+
+  if ( update_it == pending_updates_.end() )
+  {
+    if ( marker_contexts_.find( name ) == marker_contexts_.end() )
+    {
+      return false;
+    }
+    update_it = pending_updates_.insert( std::make_pair( name, UpdateContext() ) ).first;
+    update_it->second.update_type = UpdateContext::MENU_UPDATE;
+  }
+
+  switch ( update_it->second.update_type )
+  {
+    case UpdateContext::ERASE:
+      return false;
+
+    case UpdateContext::MENU_UPDATE:
+      update_it->second.menu_entries = menu_entries;
+      break;
+
+    case UpdateContext::POSE_UPDATE:
+      // pose and menu both changed
+      makeFullUpdate( update_it );
+      update_it->second.int_marker.menu_entries = *menu_entries;
+      break;
+
+    case UpdateContext::FULL_UPDATE:
+      update_it->second.int_marker.menu_entries = *menu_entries;
+      break;
+  }
+
+  return true;
+}
+
 void InteractiveMarkerServer::doSetPose( M_UpdateContext::iterator update_it, const std::string &name, const geometry_msgs::Pose &pose, const std_msgs::Header &header )
 {
   if ( update_it == pending_updates_.end() )
@@ -450,6 +791,11 @@ void InteractiveMarkerServer::doSetPose( M_UpdateContext::iterator update_it, co
     update_it = pending_updates_.insert( std::make_pair( name, UpdateContext() ) ).first;
     update_it->second.update_type = UpdateContext::POSE_UPDATE;
   }
+  else if ( update_it->second.update_type == UpdateContext::MENU_UPDATE )
+  {
+    // pose and menu both changed
+    makeFullUpdate( update_it );
+  }
   else if ( update_it->second.update_type != UpdateContext::FULL_UPDATE )
   {
     update_it->second.update_type = UpdateContext::POSE_UPDATE;
@@ -0,0 +1,340 @@
+/*
+ * Copyright (c) 2012, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "interactive_markers/loopback_transport.h"
+#include "interactive_markers/clock.h"
+
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/weak_ptr.hpp>
+
+#include <deque>
+#include <list>
+#include <vector>
+
+namespace interactive_markers
+{
+
+namespace
+{
+
+using visualization_msgs::InteractiveMarkerInit;
+using visualization_msgs::InteractiveMarkerUpdate;
+using visualization_msgs::InteractiveMarkerFeedback;
+
+template<class MsgT>
+struct Subscription
+{
+  std::string topic_ns;
+  boost::function< void ( const typename MsgT::ConstPtr& ) > callback;
+};
+
+typedef Subscription<InteractiveMarkerInit> InitSubscription;
+typedef Subscription<InteractiveMarkerUpdate> UpdateSubscription;
+
+// feedback together with the time it was published
+struct FeedbackEvent
+{
+  InteractiveMarkerFeedback::ConstPtr feedback;
+  ros::WallTime receive_time;
+};
+
+// an advertising server
+struct ServerEntry
+{
+  std::string topic_ns;
+  boost::function< void ( const FeedbackEvent& ) > callback;
+
+  InteractiveMarkerInit::ConstPtr latched_init;
+
+  ServerTransport::KeepAliveCallback keep_alive_cb;
+  ros::WallDuration keep_alive_period;
+  ros::WallTime next_keep_alive;
+};
+
+void callFeedbackCb( const ServerTransport::FeedbackCallback& feedback_cb, const FeedbackEvent& event )
+{
+  feedback_cb( event.feedback, event.receive_time );
+}
+
+void keepAlive( const boost::weak_ptr<ServerEntry>& weak_server )
+{
+  boost::shared_ptr<ServerEntry> server = weak_server.lock();
+  if ( server )
+  {
+    server->keep_alive_cb();
+  }
+}
+
+template<class SubscriptionT, class MsgConstPtrT>
+void deliver( const boost::weak_ptr<SubscriptionT>& weak_subscription, const MsgConstPtrT& msg )
+{
+  // the subscription might have been shut down in the meantime
+  boost::shared_ptr<SubscriptionT> subscription = weak_subscription.lock();
+  if ( subscription )
+  {
+    subscription->callback( msg );
+  }
+}
+
+}
+
+struct LoopbackTransport::Hub
+{
+  // queue delivery of msg to all subscriptions on topic_ns
+  // and remove the ones which have been shut down.
+  template<class SubscriptionT, class MsgConstPtrT>
+  void enqueue( std::list< boost::weak_ptr<SubscriptionT> >& subscriptions,
+      const std::string& topic_ns, const MsgConstPtrT& msg )
+  {
+    typename std::list< boost::weak_ptr<SubscriptionT> >::iterator it;
+    for ( it = subscriptions.begin(); it != subscriptions.end(); )
+    {
+      boost::shared_ptr<SubscriptionT> subscription = it->lock();
+      if ( !subscription )
+      {
+        it = subscriptions.erase( it );
+        continue;
+      }
+      if ( subscription->topic_ns == topic_ns )
+      {
+        queue.push_back( boost::bind( &deliver<SubscriptionT,MsgConstPtrT>, *it, msg ) );
+      }
+      ++it;
+    }
+  }
+
+  boost::mutex mutex;
+  std::deque< boost::function< void () > > queue;
+
+  std::list< boost::weak_ptr<ServerEntry> > servers;
+  std::list< boost::weak_ptr<InitSubscription> > init_subscriptions;
+  std::list< boost::weak_ptr<UpdateSubscription> > update_subscriptions;
+};
+
+class LoopbackTransport::ServerEndpoint : public ServerTransport
+{
+public:
+  ServerEndpoint( const boost::shared_ptr<Hub>& hub )
+  : hub_(hub)
+  {
+  }
+
+  virtual void advertise( const std::string& topic_ns, const FeedbackCallback& feedback_cb )
+  {
+    boost::mutex::scoped_lock lock( hub_->mutex );
+    entry_ = boost::make_shared<ServerEntry>();
+    entry_->topic_ns = topic_ns;
+    entry_->callback = boost::bind( &callFeedbackCb, feedback_cb, _1 );
+    hub_->servers.push_back( entry_ );
+  }
+
+  virtual void publish( const InteractiveMarkerInit::ConstPtr& init )
+  {
+    boost::mutex::scoped_lock lock( hub_->mutex );
+    if ( entry_ )
+    {
+      entry_->latched_init = init;
+      hub_->enqueue( hub_->init_subscriptions, entry_->topic_ns, init );
+    }
+  }
+
+  virtual void publish( const InteractiveMarkerUpdate::ConstPtr& update )
+  {
+    boost::mutex::scoped_lock lock( hub_->mutex );
+    if ( entry_ )
+    {
+      hub_->enqueue( hub_->update_subscriptions, entry_->topic_ns, update );
+    }
+  }
+
+  virtual void setKeepAlive( double period, const KeepAliveCallback& keep_alive_cb )
+  {
+    boost::mutex::scoped_lock lock( hub_->mutex );
+    if ( entry_ )
+    {
+      entry_->keep_alive_cb = keep_alive_cb;
+      entry_->keep_alive_period = ros::WallDuration( period );
+      entry_->next_keep_alive = ros::WallTime::now() + entry_->keep_alive_period;
+    }
+  }
+
+  virtual void shutdown()
+  {
+    boost::mutex::scoped_lock lock( hub_->mutex );
+    entry_.reset();
+  }
+
+private:
+  boost::shared_ptr<Hub> hub_;
+  boost::shared_ptr<ServerEntry> entry_;
+};
+
+class LoopbackTransport::ClientEndpoint : public ClientTransport
+{
+public:
+  ClientEndpoint( const boost::shared_ptr<Hub>& hub )
+  : hub_(hub)
+  {
+  }
+
+  virtual void subscribeInit( const std::string& topic_ns, const InitCallback& init_cb )
+  {
+    boost::mutex::scoped_lock lock( hub_->mutex );
+    init_subscription_ = boost::make_shared<InitSubscription>();
+    init_subscription_->topic_ns = topic_ns;
+    init_subscription_->callback = init_cb;
+    hub_->init_subscriptions.push_back( init_subscription_ );
+
+    // deliver latched init messages
+    std::list< boost::weak_ptr<ServerEntry> >::iterator it;
+    for ( it = hub_->servers.begin(); it != hub_->servers.end(); ++it )
+    {
+      boost::shared_ptr<ServerEntry> server = it->lock();
+      if ( server && server->topic_ns == topic_ns && server->latched_init )
+      {
+        hub_->queue.push_back( boost::bind( &deliver<InitSubscription,InteractiveMarkerInit::ConstPtr>,
+            boost::weak_ptr<InitSubscription>( init_subscription_ ), server->latched_init ) );
+      }
+    }
+  }
+
+  virtual void subscribeUpdate( const std::string& topic_ns, const UpdateCallback& update_cb )
+  {
+    boost::mutex::scoped_lock lock( hub_->mutex );
+    update_subscription_ = boost::make_shared<UpdateSubscription>();
+    update_subscription_->topic_ns = topic_ns;
+    update_subscription_->callback = update_cb;
+    hub_->update_subscriptions.push_back( update_subscription_ );
+  }
+
+  virtual void unsubscribeInit()
+  {
+    boost::mutex::scoped_lock lock( hub_->mutex );
+    init_subscription_.reset();
+  }
+
+  virtual void unsubscribeUpdate()
+  {
+    boost::mutex::scoped_lock lock( hub_->mutex );
+    update_subscription_.reset();
+  }
+
+  virtual uint32_t getNumPublishers()
+  {
+    boost::mutex::scoped_lock lock( hub_->mutex );
+    if ( !update_subscription_ )
+    {
+      return 0;
+    }
+    uint32_t num_publishers = 0;
+    std::list< boost::weak_ptr<ServerEntry> >::iterator it;
+    for ( it = hub_->servers.begin(); it != hub_->servers.end(); ++it )
+    {
+      boost::shared_ptr<ServerEntry> server = it->lock();
+      if ( server && server->topic_ns == update_subscription_->topic_ns )
+      {
+        num_publishers++;
+      }
+    }
+    return num_publishers;
+  }
+
+private:
+  boost::shared_ptr<Hub> hub_;
+  boost::shared_ptr<InitSubscription> init_subscription_;
+  boost::shared_ptr<UpdateSubscription> update_subscription_;
+};
+
+LoopbackTransport::LoopbackTransport()
+: hub_( new Hub() )
+{
+}
+
+ServerTransportPtr LoopbackTransport::createServerTransport()
+{
+  return ServerTransportPtr( new ServerEndpoint( hub_ ) );
+}
+
+ClientTransportPtr LoopbackTransport::createClientTransport()
+{
+  return ClientTransportPtr( new ClientEndpoint( hub_ ) );
+}
+
+void LoopbackTransport::publishFeedback( const std::string& topic_ns,
+    const visualization_msgs::InteractiveMarkerFeedbackConstPtr& feedback )
+{
+  FeedbackEvent event;
+  event.feedback = feedback;
+  event.receive_time = getDefaultClock()->now();
+  boost::mutex::scoped_lock lock( hub_->mutex );
+  hub_->enqueue( hub_->servers, topic_ns, event );
+}
+
+size_t LoopbackTransport::spinOnce()
+{
+  std::deque< boost::function< void () > > queue;
+  std::vector< boost::weak_ptr<ServerEntry> > keep_alives;
+  {
+    boost::mutex::scoped_lock lock( hub_->mutex );
+    queue.swap( hub_->queue );
+
+    ros::WallTime now = ros::WallTime::now();
+    std::list< boost::weak_ptr<ServerEntry> >::iterator it;
+    for ( it = hub_->servers.begin(); it != hub_->servers.end(); ++it )
+    {
+      boost::shared_ptr<ServerEntry> server = it->lock();
+      if ( server && server->keep_alive_cb && now >= server->next_keep_alive )
+      {
+        server->next_keep_alive = now + server->keep_alive_period;
+        keep_alives.push_back( server );
+      }
+    }
+  }
+
+  // call back without holding the lock, so callbacks can publish
+  for ( size_t i=0; i<queue.size(); i++ )
+  {
+    queue[i]();
+  }
+  for ( size_t i=0; i<keep_alives.size(); i++ )
+  {
+    keepAlive( keep_alives[i] );
+  }
+  return queue.size();
+}
+
+size_t LoopbackTransport::getNumPending()
+{
+  boost::mutex::scoped_lock lock( hub_->mutex );
+  return hub_->queue.size();
+}
+
+}
@@ -0,0 +1,239 @@
+/*
+ * Copyright (c) 2012, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "interactive_markers/marker_store.h"
+
+#include <boost/unordered_set.hpp>
+
+namespace interactive_markers
+{
+
+MarkerStore::MarkerStore( size_t max_events )
+: max_events_(max_events)
+, version_(0)
+{
+}
+
+void MarkerStore::applyInit( const visualization_msgs::InteractiveMarkerInitConstPtr& msg )
+{
+  boost::mutex::scoped_lock lock( mutex_ );
+
+  M_Entry& entries = servers_[msg->server_id];
+
+  boost::unordered_set<std::string> names;
+  for ( size_t i=0; i<msg->markers.size(); i++ )
+  {
+    names.insert( msg->markers[i].name );
+    // share ownership with the message, so we don't need to copy the marker
+    setMarker( entries, msg->server_id, MarkerConstPtr( msg, &msg->markers[i] ) );
+  }
+
+  // erase all markers that are not part of the init message
+  M_Entry::iterator it = entries.begin();
+  while ( it != entries.end() )
+  {
+    if ( names.find( it->first ) == names.end() )
+    {
+      pushEvent( ERASED, it->second, it->first );
+      it = entries.erase( it );
+    }
+    else
+    {
+      ++it;
+    }
+  }
+}
+
+void MarkerStore::applyUpdate( const visualization_msgs::InteractiveMarkerUpdateConstPtr& msg )
+{
+  if ( msg->type == visualization_msgs::InteractiveMarkerUpdate::KEEP_ALIVE )
+  {
+    return;
+  }
+
+  boost::mutex::scoped_lock lock( mutex_ );
+
+  M_Entry& entries = servers_[msg->server_id];
+
+  for ( size_t i=0; i<msg->markers.size(); i++ )
+  {
+    setMarker( entries, msg->server_id, MarkerConstPtr( msg, &msg->markers[i] ) );
+  }
+
+  for ( size_t i=0; i<msg->poses.size(); i++ )
+  {
+    const visualization_msgs::InteractiveMarkerPose& pose = msg->poses[i];
+    M_Entry::iterator it = entries.find( pose.name );
+    if ( it == entries.end() )
+    {
+      continue;
+    }
+    it->second.header = pose.header;
+    it->second.pose = pose.pose;
+    it->second.version = version_+1;
+    pushEvent( POSE_CHANGED, it->second, it->first );
+  }
+
+  for ( size_t i=0; i<msg->erases.size(); i++ )
+  {
+    M_Entry::iterator it = entries.find( msg->erases[i] );
+    if ( it == entries.end() )
+    {
+      continue;
+    }
+    pushEvent( ERASED, it->second, it->first );
+    entries.erase( it );
+  }
+}
+
+void MarkerStore::applyReset( const std::string& server_id )
+{
+  boost::mutex::scoped_lock lock( mutex_ );
+
+  M_ServerEntries::iterator server_it = servers_.find( server_id );
+  if ( server_it == servers_.end() )
+  {
+    return;
+  }
+
+  M_Entry::iterator it;
+  for ( it = server_it->second.begin(); it != server_it->second.end(); ++it )
+  {
+    pushEvent( ERASED, it->second, it->first );
+  }
+  servers_.erase( server_it );
+}
+
+uint64_t MarkerStore::getVersion() const
+{
+  boost::mutex::scoped_lock lock( mutex_ );
+  return version_;
+}
+
+bool MarkerStore::getChangesSince( uint64_t version, std::vector<Event>& events ) const
+{
+  boost::mutex::scoped_lock lock( mutex_ );
+
+  if ( version >= version_ )
+  {
+    return true;
+  }
+
+  // versions are consecutive, so we can directly compute the position
+  // of the first requested event in the log
+  if ( events_.empty() || events_.front().version > version+1 )
+  {
+    return false;
+  }
+
+  std::deque<Event>::const_iterator it = events_.begin() + ( version+1 - events_.front().version );
+  events.insert( events.end(), it, events_.end() );
+  return true;
+}
+
+uint64_t MarkerStore::getMarkers( std::vector<Entry>& entries ) const
+{
+  boost::mutex::scoped_lock lock( mutex_ );
+
+  M_ServerEntries::const_iterator server_it;
+  for ( server_it = servers_.begin(); server_it != servers_.end(); ++server_it )
+  {
+    M_Entry::const_iterator it;
+    for ( it = server_it->second.begin(); it != server_it->second.end(); ++it )
+    {
+      entries.push_back( it->second );
+    }
+  }
+  return version_;
+}
+
+bool MarkerStore::getMarker( const std::string& server_id, const std::string& name, Entry& entry ) const
+{
+  boost::mutex::scoped_lock lock( mutex_ );
+
+  M_ServerEntries::const_iterator server_it = servers_.find( server_id );
+  if ( server_it == servers_.end() )
+  {
+    return false;
+  }
+  M_Entry::const_iterator it = server_it->second.find( name );
+  if ( it == server_it->second.end() )
+  {
+    return false;
+  }
+  entry = it->second;
+  return true;
+}
+
+void MarkerStore::setMarker( M_Entry& entries, const std::string& server_id, const MarkerConstPtr& marker )
+{
+  M_Entry::iterator it = entries.find( marker->name );
+  EventT type = REPLACED;
+  if ( it == entries.end() )
+  {
+    it = entries.insert( std::make_pair( marker->name, Entry() ) ).first;
+    it->second.server_id = server_id;
+    type = ADDED;
+  }
+
+  it->second.marker = marker;
+  it->second.header = marker->header;
+  it->second.pose = marker->pose;
+  it->second.version = version_+1;
+  pushEvent( type, it->second, it->first );
+}
+
+void MarkerStore::pushEvent( EventT type, const Entry& entry, const std::string& name )
+{
+  version_++;
+
+  if ( max_events_ == 0 )
+  {
+    return;
+  }
+  if ( events_.size() >= max_events_ )
+  {
+    events_.pop_front();
+  }
+
+  events_.push_back( Event() );
+  Event& event = events_.back();
+  event.type = type;
+  event.version = version_;
+  event.server_id = entry.server_id;
+  event.name = name;
+  if ( type != ERASED )
+  {
+    event.marker = entry.marker;
+    event.header = entry.header;
+    event.pose = entry.pose;
+  }
+}
+
+}
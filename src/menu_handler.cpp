@@ -34,6 +34,8 @@
 #include <boost/bind.hpp>
 #include <boost/make_shared.hpp>
 
+#include <map>
+
 namespace interactive_markers
 {
 
@@ -48,6 +50,7 @@ MenuHandler::EntryHandle MenuHandler::insert( const std::string &title,
 {
   EntryHandle handle = doInsert( title, visualization_msgs::MenuEntry::FEEDBACK, "", feedback_cb );
   top_level_handles_.push_back( handle );
+  invalidateMenu();
   return handle;
 }
 
@@ -57,6 +60,7 @@ MenuHandler::EntryHandle MenuHandler::insert( const std::string &title,
 {
   EntryHandle handle = doInsert( title, command_type, command, FeedbackCallback() );
   top_level_handles_.push_back( handle );
+  invalidateMenu();
   return handle;
 }
 
@@ -64,13 +68,12 @@ MenuHandler::EntryHandle MenuHandler::insert( const std::string &title,
 MenuHandler::EntryHandle MenuHandler::insert( EntryHandle parent, const std::string &title,
     const FeedbackCallback &feedback_cb )
 {
-  boost::unordered_map<EntryHandle, EntryContext>::iterator parent_context =
-      entry_contexts_.find( parent );
-
-  ROS_ASSERT_MSG ( parent_context != entry_contexts_.end(), "Parent menu entry %u not found.", parent );
+  ROS_ASSERT_MSG ( getContext( parent ), "Parent menu entry %u not found.", parent );
 
+  // inserting may move the parent context, so look it up afterwards
   EntryHandle handle = doInsert( title, visualization_msgs::MenuEntry::FEEDBACK, "", feedback_cb );
-  parent_context->second.sub_entries.push_back( handle );
+  getContext( parent )->sub_entries.push_back( handle );
+  invalidateMenu();
   return handle;
 }
 
@@ -79,79 +82,205 @@ MenuHandler::EntryHandle MenuHandler::insert( EntryHandle parent, const std::str
                                               const uint8_t command_type,
                                               const std::string &command )
 {
-  boost::unordered_map<EntryHandle, EntryContext>::iterator parent_context =
-      entry_contexts_.find( parent );
-
-  ROS_ASSERT_MSG ( parent_context != entry_contexts_.end(), "Parent menu entry %u not found.", parent );
+  ROS_ASSERT_MSG ( getContext( parent ), "Parent menu entry %u not found.", parent );
 
+  // inserting may move the parent context, so look it up afterwards
   EntryHandle handle = doInsert( title, command_type, command, FeedbackCallback() );
-  parent_context->second.sub_entries.push_back( handle );
+  getContext( parent )->sub_entries.push_back( handle );
+  invalidateMenu();
   return handle;
 }
 
 
 bool MenuHandler::setVisible( EntryHandle handle, bool visible )
 {
-  boost::unordered_map<EntryHandle, EntryContext>::iterator context =
-      entry_contexts_.find( handle );
+  EntryContext* context = getContext( handle );
 
-  if ( context == entry_contexts_.end() )
+  if ( !context )
   {
     return false;
   }
 
-  context->second.visible = visible;
+  if ( context->visible != visible )
+  {
+    context->visible = visible;
+    invalidateMenu();
+  }
   return true;
 }
 
 
 bool MenuHandler::setCheckState( EntryHandle handle, CheckState check_state )
 {
-  boost::unordered_map<EntryHandle, EntryContext>::iterator context =
-      entry_contexts_.find( handle );
+  EntryContext* context = getContext( handle );
 
-  if ( context == entry_contexts_.end() )
+  if ( !context )
   {
     return false;
   }
 
-  context->second.check_state = check_state;
+  if ( context->check_state != check_state )
+  {
+    context->check_state = check_state;
+    invalidateMenu();
+  }
   return true;
 }
 
 
 bool MenuHandler::getCheckState( EntryHandle handle, CheckState &check_state ) const
 {
-  boost::unordered_map<EntryHandle, EntryContext>::const_iterator context =
-      entry_contexts_.find( handle );
+  const EntryContext* context = getContext( handle );
 
-  if ( context == entry_contexts_.end() )
+  if ( !context )
   {
     check_state = NO_CHECKBOX;
     return false;
   }
 
-  check_state = context->second.check_state;
+  check_state = context->check_state;
+  return true;
+}
+
+
+bool MenuHandler::setVisible( const std::string &marker_name, EntryHandle handle, bool visible )
+{
+  const EntryContext* context = getContext( handle );
+
+  if ( !context )
+  {
+    return false;
+  }
+
+  return setOverride( marker_name, handle, &EntryOverride::visible,
+      context->visible == visible ? -1 : int8_t(visible) );
+}
+
+
+bool MenuHandler::setCheckState( const std::string &marker_name, EntryHandle handle, CheckState check_state )
+{
+  const EntryContext* context = getContext( handle );
+
+  if ( !context )
+  {
+    return false;
+  }
+
+  return setOverride( marker_name, handle, &EntryOverride::check_state,
+      context->check_state == check_state ? -1 : int8_t(check_state) );
+}
+
+
+bool MenuHandler::getCheckState( const std::string &marker_name, EntryHandle handle, CheckState &check_state ) const
+{
+  if ( !getCheckState( handle, check_state ) )
+  {
+    return false;
+  }
+
+  M_MarkerOverlay::const_iterator overlay_it = overlays_.find( marker_name );
+  if ( overlay_it != overlays_.end() )
+  {
+    const EntryOverride* entry_override = findOverride( &overlay_it->second, handle );
+    if ( entry_override && entry_override->check_state != -1 )
+    {
+      check_state = CheckState( entry_override->check_state );
+    }
+  }
+  return true;
+}
+
+
+void MenuHandler::clearOverrides( const std::string &marker_name )
+{
+  overlays_.erase( marker_name );
+}
+
+
+bool MenuHandler::setOverride( const std::string &marker_name, EntryHandle handle,
+                               int8_t EntryOverride::*field, int8_t value )
+{
+  M_MarkerOverlay::iterator overlay_it = overlays_.find( marker_name );
+  if ( overlay_it == overlays_.end() )
+  {
+    if ( value == -1 )
+    {
+      return true;
+    }
+    overlay_it = overlays_.insert( std::make_pair( marker_name, MarkerOverlay() ) ).first;
+  }
+
+  MarkerOverlay& overlay = overlay_it->second;
+  std::vector<EntryOverride>& overrides = overlay.overrides;
+
+  // keep overrides sorted, so markers with the same overrides can share a menu
+  unsigned i = 0;
+  while ( i < overrides.size() && overrides[i].handle < handle )
+  {
+    i++;
+  }
+
+  if ( i == overrides.size() || overrides[i].handle != handle )
+  {
+    if ( value == -1 )
+    {
+      return true;
+    }
+    EntryOverride entry_override;
+    entry_override.handle = handle;
+    entry_override.visible = -1;
+    entry_override.check_state = -1;
+    overrides.insert( overrides.begin() + i, entry_override );
+  }
+  else if ( overrides[i].*field == value )
+  {
+    return true;
+  }
+
+  overrides[i].*field = value;
+
+  // only keep what differs from the shared menu
+  if ( overrides[i].visible == -1 && overrides[i].check_state == -1 )
+  {
+    overrides.erase( overrides.begin() + i );
+    if ( overrides.empty() )
+    {
+      overlays_.erase( overlay_it );
+    }
+  }
   return true;
 }
 
 
+const MenuHandler::EntryOverride* MenuHandler::findOverride( const MarkerOverlay* overlay, EntryHandle handle ) const
+{
+  if ( !overlay )
+  {
+    return NULL;
+  }
+  for ( unsigned i = 0; i < overlay->overrides.size(); i++ )
+  {
+    if ( overlay->overrides[i].handle == handle )
+    {
+      return &overlay->overrides[i];
+    }
+  }
+  return NULL;
+}
+
+
 bool MenuHandler::apply( InteractiveMarkerServer &server, const std::string &marker_name )
 {
-  visualization_msgs::InteractiveMarker int_marker;
+  std::vector<std::string> names( 1, marker_name );
 
-  if ( !server.get( marker_name, int_marker ) )
+  if ( !server.setMenuEntries( names, getMenuEntries( marker_name ) ) )
   {
     // This marker has been deleted on the server, so forget it.
     managed_markers_.erase( marker_name );
+    overlays_.erase( marker_name );
     return false;
   }
 
-  int_marker.menu_entries.clear();
-
-  pushMenuEntries( top_level_handles_, int_marker.menu_entries, 0 );
-
-  server.insert( int_marker );
   server.setCallback( marker_name, boost::bind( &MenuHandler::processFeedback, this, _1 ), visualization_msgs::InteractiveMarkerFeedback::MENU_SELECT );
   managed_markers_.insert( marker_name );
   return true;
@@ -159,29 +288,45 @@ bool MenuHandler::apply( InteractiveMarkerServer &server, const std::string &mar
 
 bool MenuHandler::pushMenuEntries( std::vector<EntryHandle>& handles_in,
                                    std::vector<visualization_msgs::MenuEntry>& entries_out,
-                                   EntryHandle parent_handle )
+                                   EntryHandle parent_handle,
+                                   const MarkerOverlay* overlay )
 {
   for ( unsigned t = 0; t < handles_in.size(); t++ )
   {
     EntryHandle handle = handles_in[t];
-    boost::unordered_map<EntryHandle, EntryContext>::iterator context_it =
-        entry_contexts_.find( handle );
+    EntryContext* context_ptr = getContext( handle );
 
-    if ( context_it == entry_contexts_.end() )
+    if ( !context_ptr )
     {
       ROS_ERROR( "Internal error: context handle not found! This is a bug in MenuHandler." );
       return false;
     }
 
-    EntryContext& context = context_it->second;
+    EntryContext& context = *context_ptr;
+
+    bool visible = context.visible;
+    CheckState check_state = context.check_state;
 
-    if ( !context.visible )
+    const EntryOverride* entry_override = findOverride( overlay, handle );
+    if ( entry_override )
+    {
+      if ( entry_override->visible != -1 )
+      {
+        visible = entry_override->visible;
+      }
+      if ( entry_override->check_state != -1 )
+      {
+        check_state = CheckState( entry_override->check_state );
+      }
+    }
+
+    if ( !visible )
     {
       continue;
     }
 
-    entries_out.push_back( makeEntry( context, handle, parent_handle ));
-    if( false == pushMenuEntries( context.sub_entries, entries_out, handle ))
+    entries_out.push_back( makeEntry( context, handle, parent_handle, check_state ));
+    if( false == pushMenuEntries( context.sub_entries, entries_out, handle, overlay ))
     {
       return false;
     }
@@ -191,20 +336,85 @@ bool MenuHandler::pushMenuEntries( std::vector<EntryHandle>& handles_in,
 
 bool MenuHandler::reApply( InteractiveMarkerServer &server )
 {
-  bool success = true;
-  std::set<std::string>::iterator it = managed_markers_.begin();
-  while ( it != managed_markers_.end() )
+  // markers with the same overrides share one menu, and all markers
+  // are updated with a single call to the server
+  typedef std::map< std::vector<EntryOverride>, InteractiveMarkerServer::MenuEntriesConstPtr > M_OverlayMenu;
+  M_OverlayMenu overlay_menus;
+
+  std::vector<std::string> names;
+  std::vector<InteractiveMarkerServer::MenuEntriesConstPtr> menus;
+  names.reserve( managed_markers_.size() );
+  menus.reserve( managed_markers_.size() );
+
+  std::set<std::string>::iterator it;
+  for ( it = managed_markers_.begin(); it != managed_markers_.end(); ++it )
+  {
+    names.push_back( *it );
+
+    M_MarkerOverlay::iterator overlay_it = overlays_.find( *it );
+    if ( overlay_it == overlays_.end() )
+    {
+      menus.push_back( getMenuEntries() );
+      continue;
+    }
+
+    InteractiveMarkerServer::MenuEntriesConstPtr& menu = overlay_menus[ overlay_it->second.overrides ];
+    if ( !menu )
+    {
+      menu = buildMenuEntries( &overlay_it->second );
+    }
+    menus.push_back( menu );
+  }
+
+  std::vector<std::string> missing_names;
+  bool success = server.setMenuEntries( names, menus, &missing_names );
+
+  // These markers have been deleted on the server, so forget them.
+  for ( unsigned i=0; i<missing_names.size(); i++ )
   {
-    // apply() may delete the entry "it" is pointing to, so
-    // pre-compute the next iterator.
-    std::set<std::string>::iterator next_it = it;
-    next_it++;
-    success = apply( server, *it ) && success;
-    it = next_it;
+    managed_markers_.erase( missing_names[i] );
+    overlays_.erase( missing_names[i] );
+  }
+
+  for ( it = managed_markers_.begin(); it != managed_markers_.end(); ++it )
+  {
+    server.setCallback( *it, boost::bind( &MenuHandler::processFeedback, this, _1 ), visualization_msgs::InteractiveMarkerFeedback::MENU_SELECT );
   }
   return success;
 }
 
+InteractiveMarkerServer::MenuEntriesConstPtr MenuHandler::getMenuEntries()
+{
+  if ( !menu_entries_ )
+  {
+    menu_entries_ = buildMenuEntries( NULL );
+  }
+  return menu_entries_;
+}
+
+InteractiveMarkerServer::MenuEntriesConstPtr MenuHandler::getMenuEntries( const std::string &marker_name )
+{
+  M_MarkerOverlay::iterator overlay_it = overlays_.find( marker_name );
+  if ( overlay_it == overlays_.end() )
+  {
+    return getMenuEntries();
+  }
+  return buildMenuEntries( &overlay_it->second );
+}
+
+InteractiveMarkerServer::MenuEntriesConstPtr MenuHandler::buildMenuEntries( const MarkerOverlay* overlay )
+{
+  boost::shared_ptr< std::vector<visualization_msgs::MenuEntry> > menu_entries =
+      boost::make_shared< std::vector<visualization_msgs::MenuEntry> >();
+  pushMenuEntries( top_level_handles_, *menu_entries, 0, overlay );
+  return menu_entries;
+}
+
+void MenuHandler::invalidateMenu()
+{
+  menu_entries_.reset();
+}
+
 MenuHandler::EntryHandle MenuHandler::doInsert( const std::string &title,
                                                 const uint8_t command_type,
                                                 const std::string &command,
@@ -213,7 +423,9 @@ MenuHandler::EntryHandle MenuHandler::doInsert( const std::string &title,
   EntryHandle handle = current_handle_;
   current_handle_++;
 
-  EntryContext context;
+  // handles are consecutive, starting at 1
+  entry_contexts_.push_back( EntryContext() );
+  EntryContext& context = entry_contexts_.back();
   context.title = title;
   context.command = command;
   context.command_type = command_type;
@@ -221,15 +433,15 @@ MenuHandler::EntryHandle MenuHandler::doInsert( const std::string &title,
   context.check_state = NO_CHECKBOX;
   context.feedback_cb = feedback_cb;
 
-  entry_contexts_[handle] = context;
   return handle;
 }
 
-visualization_msgs::MenuEntry MenuHandler::makeEntry( EntryContext& context, EntryHandle handle, EntryHandle parent_handle )
+visualization_msgs::MenuEntry MenuHandler::makeEntry( EntryContext& context, EntryHandle handle, EntryHandle parent_handle,
+                                                     CheckState check_state )
 {
   visualization_msgs::MenuEntry menu_entry;
 
-  switch ( context.check_state )
+  switch ( check_state )
   {
     case NO_CHECKBOX:
       menu_entry.title = context.title;
@@ -253,29 +465,62 @@ visualization_msgs::MenuEntry MenuHandler::makeEntry( EntryContext& context, Ent
 
 void MenuHandler::processFeedback( const visualization_msgs::InteractiveMarkerFeedbackConstPtr &feedback )
 {
-  boost::unordered_map<EntryHandle, EntryContext>::iterator context =
-    entry_contexts_.find( (EntryHandle) feedback->menu_entry_id );
+  EntryHandle handle = (EntryHandle) feedback->menu_entry_id;
+  EntryContext* context = getContext( handle );
 
-  if ( context != entry_contexts_.end() && context->second.feedback_cb )
+  if ( !context )
   {
-    context->second.feedback_cb( feedback );
+    return;
+  }
+
+  // ignore selections of entries which are hidden for this marker
+  M_MarkerOverlay::const_iterator overlay_it = overlays_.find( feedback->marker_name );
+  if ( overlay_it != overlays_.end() )
+  {
+    const EntryOverride* entry_override = findOverride( &overlay_it->second, handle );
+    if ( entry_override && entry_override->visible == 0 )
+    {
+      return;
+    }
+  }
+
+  if ( context->feedback_cb )
+  {
+    context->feedback_cb( feedback );
   }
 }
 
 bool MenuHandler::getTitle( EntryHandle handle, std::string &title ) const
 {
-  boost::unordered_map<EntryHandle, EntryContext>::const_iterator context =
-      entry_contexts_.find( handle );
+  const EntryContext* context = getContext( handle );
 
-  if ( context == entry_contexts_.end() )
+  if ( !context )
   {
     return false;
   }
 
-  title = context->second.title;
+  title = context->title;
   return true;
 }
 
+MenuHandler::EntryContext* MenuHandler::getContext( EntryHandle handle )
+{
+  if ( handle == 0 || handle > entry_contexts_.size() )
+  {
+    return NULL;
+  }
+  return &entry_contexts_[handle-1];
+}
+
+const MenuHandler::EntryContext* MenuHandler::getContext( EntryHandle handle ) const
+{
+  if ( handle == 0 || handle > entry_contexts_.size() )
+  {
+    return NULL;
+  }
+  return &entry_contexts_[handle-1];
+}
+
 
 
 }
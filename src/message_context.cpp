@@ -31,6 +31,9 @@
 
 #include "interactive_markers/detail/message_context.h"
 #include "interactive_markers/tools.h"
+#include "interactive_markers/clock.h"
+
+#include <ros/serialization.h>
 
 #include <boost/make_shared.hpp>
 
@@ -44,12 +47,35 @@ template<class MsgT>
 MessageContext<MsgT>::MessageContext(
     tf::Transformer& tf,
     const std::string& target_frame,
-    const typename MsgT::ConstPtr& _msg)
-: tf_(tf)
+    const typename MsgT::ConstPtr& _msg,
+    AutoCompleteCache* completion_cache,
+    ClientMetrics* metrics,
+    uint32_t _msg_size )
+: msg_size( _msg_size )
+, tf_(tf)
 , target_frame_(target_frame)
+, completion_cache_(completion_cache)
+, metrics_(metrics)
 {
-  // copy message, as we will be modifying it
-  msg = boost::make_shared<MsgT>( *_msg );
+  if ( metrics_ )
+  {
+    receive_time_ = getDefaultClock()->now();
+  }
+
+  msg = _msg;
+
+  if ( completion_cache_ )
+  {
+    // the hashes need to be computed on the original content,
+    // before auto-completion and tf have been applied
+    std::vector<uint8_t> buffer;
+    marker_hashes.resize( msg->markers.size() );
+    completion_hashes.resize( msg->markers.size() );
+    for ( size_t i=0; i<msg->markers.size(); i++ )
+    {
+      marker_hashes[i] = hashMarkerDefinition( msg->markers[i], buffer, completion_hashes[i] );
+    }
+  }
 
   init();
 }
@@ -60,34 +86,112 @@ MessageContext<MsgT>& MessageContext<MsgT>::operator=( const MessageContext<MsgT
   open_marker_idx_ = other.open_marker_idx_;
   open_pose_idx_ = other.open_pose_idx_;
   target_frame_ = other.target_frame_;
+  marker_hashes = other.marker_hashes;
+  completion_hashes = other.completion_hashes;
+  completion_cache_ = other.completion_cache_;
+  metrics_ = other.metrics_;
+  receive_time_ = other.receive_time_;
+  msg_size = other.msg_size;
+  msg = other.msg;
+  writable_msg_ = other.writable_msg_;
   return *this;
 }
 
 template<class MsgT>
-bool MessageContext<MsgT>::getTransform( std_msgs::Header& header, geometry_msgs::Pose& pose_msg )
+MsgT& MessageContext<MsgT>::getWritableMsg()
 {
-  try
+  if ( !writable_msg_ )
   {
-    if ( header.frame_id != target_frame_ )
-    {
-      // get transform
-      tf::StampedTransform transform;
-      tf_.lookupTransform( target_frame_, header.frame_id, header.stamp, transform );
-      DBG_MSG( "Transform %s -> %s at time %f is ready.", header.frame_id.c_str(), target_frame_.c_str(), header.stamp.toSec() );
+    writable_msg_ = boost::make_shared<MsgT>( *msg );
+    msg = writable_msg_;
+  }
+  return *writable_msg_;
+}
 
-      // if timestamp is given, transform message into target frame
-      if ( header.stamp != ros::Time(0) )
-      {
-        tf::Pose pose;
-        tf::poseMsgToTF( pose_msg, pose );
-        pose = transform * pose;
-        // store transformed pose in original message
-        tf::poseTFToMsg( pose, pose_msg );
-        ROS_DEBUG_STREAM("Changing " << header.frame_id << " to "<< target_frame_);
-        header.frame_id = target_frame_;
-      }
+template<class MsgT>
+void MessageContext<MsgT>::autoCompleteMarkers()
+{
+  if ( msg->markers.empty() )
+  {
+    return;
+  }
+
+  std::vector<visualization_msgs::InteractiveMarker>& markers = getWritableMsg().markers;
+
+  if ( !completion_cache_ )
+  {
+    autoComplete( markers );
+    return;
+  }
+
+  // complete everything the cache does not know about in one batch
+  std::vector<unsigned> missing_idx;
+  std::vector<visualization_msgs::InteractiveMarker*> missing;
+  for( unsigned i=0; i<markers.size(); i++ )
+  {
+    visualization_msgs::InteractiveMarker& marker = markers[i];
+    if ( !completion_cache_->complete( completion_hashes[i], marker ) )
+    {
+      missing_idx.push_back( i );
+      missing.push_back( &marker );
     }
   }
+
+  autoComplete( missing );
+
+  for( unsigned i=0; i<missing_idx.size(); i++ )
+  {
+    completion_cache_->insert( completion_hashes[missing_idx[i]], *missing[i] );
+  }
+}
+
+template<class MsgT>
+bool MessageContext<MsgT>::needsTransform( const std_msgs::Header& header ) const
+{
+  return header.frame_id != target_frame_ && header.stamp != ros::Time(0);
+}
+
+template<class MsgT>
+bool MessageContext<MsgT>::getTransform( std_msgs::Header& header, geometry_msgs::Pose& pose_msg )
+{
+  if ( header.frame_id == target_frame_ )
+  {
+    return true;
+  }
+
+  tf::StampedTransform transform;
+  if ( !isTransformAvailable( header, transform ) )
+  {
+    return false;
+  }
+
+  // if timestamp is given, transform message into target frame
+  if ( header.stamp != ros::Time(0) )
+  {
+    tf::Pose pose;
+    tf::poseMsgToTF( pose_msg, pose );
+    pose = transform * pose;
+    // store transformed pose in original message
+    tf::poseTFToMsg( pose, pose_msg );
+    ROS_DEBUG_STREAM("Changing " << header.frame_id << " to "<< target_frame_);
+    header.frame_id = target_frame_;
+  }
+  return true;
+}
+
+template<class MsgT>
+bool MessageContext<MsgT>::isTransformAvailable( const std_msgs::Header& header, tf::StampedTransform& transform )
+{
+  if ( header.frame_id == target_frame_ )
+  {
+    return true;
+  }
+
+  try
+  {
+    tf_.lookupTransform( target_frame_, header.frame_id, header.stamp, transform );
+    DBG_MSG( "Transform %s -> %s at time %f is ready.", header.frame_id.c_str(), target_frame_.c_str(), header.stamp.toSec() );
+  }
   catch ( tf::ExtrapolationException& e )
   {
     ros::Time latest_time;
@@ -112,12 +216,36 @@ bool MessageContext<MsgT>::getTransform( std_msgs::Header& header, geometry_msgs
 }
 
 template<class MsgT>
-void MessageContext<MsgT>::getTfTransforms( std::vector<visualization_msgs::InteractiveMarker>& msg_vec, std::list<size_t>& indices )
+void MessageContext<MsgT>::addTfWait( const std::string& frame_id, ros::WallTime& now )
+{
+  if ( metrics_ )
+  {
+    if ( now.isZero() )
+    {
+      now = getDefaultClock()->now();
+    }
+    metrics_->tf_wait[frame_id].add( now - receive_time_ );
+  }
+}
+
+template<class MsgT>
+void MessageContext<MsgT>::getMarkerTransforms( std::list<size_t>& indices )
 {
+  if ( indices.empty() )
+  {
+    return;
+  }
+
+  // markers have been copied for auto-completion anyway
+  std::vector<visualization_msgs::InteractiveMarker>& msg_vec = getWritableMsg().markers;
+  ros::WallTime now;
+
   std::list<size_t>::iterator idx_it;
   for ( idx_it = indices.begin(); idx_it != indices.end(); )
   {
     visualization_msgs::InteractiveMarker& im_msg = msg_vec[ *idx_it ];
+    // getTransform() changes the frame on success
+    std::string frame_id = im_msg.header.frame_id;
     // transform interactive marker
     bool success = getTransform( im_msg.header, im_msg.pose );
     // transform regular markers
@@ -135,6 +263,7 @@ void MessageContext<MsgT>::getTfTransforms( std::vector<visualization_msgs::Inte
 
     if ( success )
     {
+      addTfWait( frame_id, now );
       idx_it = indices.erase(idx_it);
     }
     else
@@ -145,20 +274,38 @@ void MessageContext<MsgT>::getTfTransforms( std::vector<visualization_msgs::Inte
   }
 }
 
-template<class MsgT>
-void MessageContext<MsgT>::getTfTransforms( std::vector<visualization_msgs::InteractiveMarkerPose>& msg_vec, std::list<size_t>& indices )
+// only update messages contain poses
+template<>
+void MessageContext<visualization_msgs::InteractiveMarkerUpdate>::getPoseTransforms( std::list<size_t>& indices )
 {
+  ros::WallTime now;
   std::list<size_t>::iterator idx_it;
   for ( idx_it = indices.begin(); idx_it != indices.end(); )
   {
-    visualization_msgs::InteractiveMarkerPose& msg = msg_vec[ *idx_it ];
-    if ( getTransform( msg.header, msg.pose ) )
+    const visualization_msgs::InteractiveMarkerPose& pose_msg = msg->poses[ *idx_it ];
+    std::string frame_id = pose_msg.header.frame_id;
+
+    // only copy the message if we need to change it
+    bool success;
+    if ( needsTransform( pose_msg.header ) )
     {
+      visualization_msgs::InteractiveMarkerPose& writable_pose = getWritableMsg().poses[ *idx_it ];
+      success = getTransform( writable_pose.header, writable_pose.pose );
+    }
+    else
+    {
+      tf::StampedTransform transform;
+      success = isTransformAvailable( pose_msg.header, transform );
+    }
+
+    if ( success )
+    {
+      addTfWait( frame_id, now );
       idx_it = indices.erase(idx_it);
     }
     else
     {
-      DBG_MSG( "Transform %s -> %s at time %f is not ready.", msg.header.frame_id.c_str(), target_frame_.c_str(), msg.header.stamp.toSec() );
+      DBG_MSG( "Transform %s -> %s at time %f is not ready.", frame_id.c_str(), target_frame_.c_str(), msg->poses[ *idx_it ].header.stamp.toSec() );
       ++idx_it;
     }
   }
@@ -182,17 +329,14 @@ void MessageContext<visualization_msgs::InteractiveMarkerUpdate>::init()
   {
     open_pose_idx_.push_back( i );
   }
-  for( unsigned i=0; i<msg->markers.size(); i++ )
-  {
-    autoComplete( msg->markers[i] );
-  }
+  autoCompleteMarkers();
   for( unsigned i=0; i<msg->poses.size(); i++ )
   {
     // correct empty orientation
     if ( msg->poses[i].pose.orientation.w == 0 && msg->poses[i].pose.orientation.x == 0 &&
         msg->poses[i].pose.orientation.y == 0 && msg->poses[i].pose.orientation.z == 0 )
     {
-      msg->poses[i].pose.orientation.w = 1;
+      getWritableMsg().poses[i].pose.orientation.w = 1;
     }
   }
 }
@@ -205,17 +349,14 @@ void MessageContext<visualization_msgs::InteractiveMarkerInit>::init()
   {
     open_marker_idx_.push_back( i );
   }
-  for( unsigned i=0; i<msg->markers.size(); i++ )
-  {
-    autoComplete( msg->markers[i] );
-  }
+  autoCompleteMarkers();
 }
 
 template<>
 void MessageContext<visualization_msgs::InteractiveMarkerUpdate>::getTfTransforms( )
 {
-  getTfTransforms( msg->markers, open_marker_idx_ );
-  getTfTransforms( msg->poses, open_pose_idx_ );
+  getMarkerTransforms( open_marker_idx_ );
+  getPoseTransforms( open_pose_idx_ );
   if ( isReady() )
   {
     DBG_MSG( "Update message with seq_num=%lu is ready.", msg->seq_num );
@@ -225,13 +366,133 @@ void MessageContext<visualization_msgs::InteractiveMarkerUpdate>::getTfTransform
 template<>
 void MessageContext<visualization_msgs::InteractiveMarkerInit>::getTfTransforms( )
 {
-  getTfTransforms( msg->markers, open_marker_idx_ );
+  getMarkerTransforms( open_marker_idx_ );
   if ( isReady() )
   {
     DBG_MSG( "Init message with seq_num=%lu is ready.", msg->seq_num );
   }
 }
 
+bool AutoCompleteCache::complete( uint64_t hash, visualization_msgs::InteractiveMarker& msg ) const
+{
+  boost::unordered_map<std::string, Entry>::const_iterator it = entries_.find( msg.name );
+  if ( it == entries_.end() || it->second.hash != hash ||
+      it->second.detail_level != getDetailLevel() )
+  {
+    return false;
+  }
+
+  msg.scale = it->second.scale;
+  msg.controls = it->second.controls;
+
+  // the pose is not part of the hash, so we still need to
+  // correct empty orientation & normalize
+  if ( msg.pose.orientation.w == 0 && msg.pose.orientation.x == 0 &&
+      msg.pose.orientation.y == 0 && msg.pose.orientation.z == 0 )
+  {
+    msg.pose.orientation.w = 1;
+  }
+  tf::Quaternion int_marker_orientation( msg.pose.orientation.x, msg.pose.orientation.y,
+      msg.pose.orientation.z, msg.pose.orientation.w );
+  int_marker_orientation.normalize();
+  msg.pose.orientation.x = int_marker_orientation.x();
+  msg.pose.orientation.y = int_marker_orientation.y();
+  msg.pose.orientation.z = int_marker_orientation.z();
+  msg.pose.orientation.w = int_marker_orientation.w();
+  return true;
+}
+
+void AutoCompleteCache::insert( uint64_t hash, const visualization_msgs::InteractiveMarker& msg )
+{
+  // this is a 'delete' message, autoComplete() does nothing
+  if ( msg.controls.empty() )
+  {
+    return;
+  }
+  Entry& entry = entries_[msg.name];
+  entry.hash = hash;
+  entry.detail_level = getDetailLevel();
+  entry.scale = msg.scale;
+  entry.controls = msg.controls;
+}
+
+void AutoCompleteCache::erase( const std::string& name )
+{
+  entries_.erase( name );
+}
+
+void AutoCompleteCache::retain( const std::vector<visualization_msgs::InteractiveMarker>& markers )
+{
+  boost::unordered_map<std::string, Entry> retained;
+  for ( size_t i=0; i<markers.size(); i++ )
+  {
+    boost::unordered_map<std::string, Entry>::iterator it = entries_.find( markers[i].name );
+    if ( it != entries_.end() )
+    {
+      Entry& entry = retained[it->first];
+      entry.hash = it->second.hash;
+      entry.detail_level = it->second.detail_level;
+      entry.scale = it->second.scale;
+      entry.controls.swap( it->second.controls );
+    }
+  }
+  entries_.swap( retained );
+}
+
+namespace
+{
+
+// 64 bit FNV-1a
+const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+
+uint64_t hashBytes( const std::vector<uint8_t>& buffer, uint32_t length, uint64_t hash )
+{
+  for ( uint32_t i=0; i<length; i++ )
+  {
+    hash ^= buffer[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+}
+
+uint64_t hashMarkerDefinition( const visualization_msgs::InteractiveMarker& msg, std::vector<uint8_t>& buffer )
+{
+  uint64_t completion_hash;
+  return hashMarkerDefinition( msg, buffer, completion_hash );
+}
+
+uint64_t hashMarkerDefinition( const visualization_msgs::InteractiveMarker& msg, std::vector<uint8_t>& buffer,
+    uint64_t& completion_hash )
+{
+  namespace ser = ros::serialization;
+
+  // hash the content autoComplete() depends on first,
+  // then continue with the rest of the definition
+  uint32_t length = ser::serializationLength( msg.name ) +
+      ser::serializationLength( msg.scale ) +
+      ser::serializationLength( msg.controls );
+
+  buffer.resize( length );
+  ser::OStream stream( &buffer[0], length );
+  stream.next( msg.name );
+  stream.next( msg.scale );
+  stream.next( msg.controls );
+
+  completion_hash = hashBytes( buffer, length, FNV_OFFSET_BASIS );
+
+  length = ser::serializationLength( msg.description ) +
+      ser::serializationLength( msg.menu_entries );
+
+  buffer.resize( length );
+  ser::OStream menu_stream( &buffer[0], length );
+  menu_stream.next( msg.description );
+  menu_stream.next( msg.menu_entries );
+
+  return hashBytes( buffer, length, completion_hash );
+}
+
 // explicit template instantiation
 template class MessageContext<visualization_msgs::InteractiveMarkerUpdate>;
 template class MessageContext<visualization_msgs::InteractiveMarkerInit>;
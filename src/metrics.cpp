@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2012, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "interactive_markers/metrics.h"
+
+#include <math.h>
+#include <sstream>
+
+namespace interactive_markers
+{
+
+DurationStats::DurationStats()
+: count(0)
+{
+}
+
+void DurationStats::add( const ros::WallDuration& duration )
+{
+  count++;
+  total += duration;
+  last = duration;
+  if ( duration > max )
+  {
+    max = duration;
+  }
+}
+
+double DurationStats::mean() const
+{
+  return count > 0 ? total.toSec() / double(count) : 0.0;
+}
+
+DurationHistogram::DurationHistogram()
+{
+  for ( unsigned i=0; i<NUM_BUCKETS; i++ )
+  {
+    buckets[i] = 0;
+  }
+}
+
+void DurationHistogram::add( const ros::WallDuration& duration )
+{
+  stats.add( duration );
+
+  double seconds = duration.toSec();
+  unsigned bucket = 0;
+  while ( bucket < NUM_BUCKETS-1 && seconds >= getBucketLimit( bucket ) )
+  {
+    bucket++;
+  }
+  buckets[bucket]++;
+}
+
+double DurationHistogram::getBucketLimit( unsigned bucket )
+{
+  static const double limits[NUM_BUCKETS] = { 0.001, 0.01, 0.1, 1.0, 10.0, HUGE_VAL };
+  return bucket < NUM_BUCKETS ? limits[bucket] : HUGE_VAL;
+}
+
+RateStats::RateStats()
+: count(0)
+, rate(0)
+, window_count(0)
+{
+}
+
+void RateStats::add( const ros::WallTime& now, uint64_t amount )
+{
+  count += amount;
+  window_count += amount;
+
+  if ( window_start.isZero() )
+  {
+    window_start = now;
+    return;
+  }
+
+  double elapsed = (now - window_start).toSec();
+  if ( elapsed >= 1.0 )
+  {
+    rate = double(window_count) / elapsed;
+    window_start = now;
+    window_count = 0;
+  }
+}
+
+ServerMetrics::ServerMetrics()
+: updates(0)
+, markers(0)
+, poses(0)
+, erases(0)
+, last_update_markers(0)
+, last_update_poses(0)
+, last_update_erases(0)
+, update_bytes(0)
+, last_update_bytes(0)
+, inits(0)
+, last_init_bytes(0)
+, feedback_unknown(0)
+, feedback_rejected(0)
+, markers_published(0)
+, pending_updates(0)
+{
+}
+
+StateTrace::StateTrace()
+: num_transitions(0)
+, state(0)
+{
+}
+
+std::string StateTrace::getStateName( int32_t state ) const
+{
+  if ( state >= 0 && (size_t)state < state_names.size() )
+  {
+    return state_names[state];
+  }
+  std::ostringstream s;
+  s << state;
+  return s.str();
+}
+
+ClientMetrics::ClientMetrics()
+: update_queue_size(0)
+, update_queue_bytes(0)
+, init_queue_size(0)
+, init_queue_bytes(0)
+{
+  for ( unsigned i=0; i<NUM_RESET_CAUSES; i++ )
+  {
+    resets[i] = 0;
+  }
+}
+
+}
@@ -0,0 +1,933 @@
+/*
+ * Copyright (c) 2012, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "interactive_markers/shm_transport.h"
+
+#include <ros/console.h>
+#include <ros/master.h>
+#include <ros/serialization.h>
+#include <ros/this_node.h>
+
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/static_assert.hpp>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <sstream>
+
+namespace interactive_markers
+{
+
+namespace
+{
+
+const uint32_t SHM_MAGIC = 0x494d5348; // "IMSH"
+const uint32_t SHM_VERSION = 3;
+
+// the data section starts at this offset in the segment
+const size_t DATA_OFFSET = 1024;
+
+const size_t MAX_WRITER_ID_LENGTH = 255;
+
+const unsigned MAX_READERS = 32;
+
+// readers are considered gone if they do not send a heartbeat for this long
+const uint64_t READER_TIMEOUT_NSEC = 1000000000ULL;
+
+// heartbeat of a slot which a reader is about to take over
+const uint64_t CLAIMED_SLOT = 1;
+
+enum RecordTypeT
+{
+  PADDING = 0,
+  INIT = 1,
+  UPDATE = 2,
+  FALLBACK = 3
+};
+
+struct RecordHeader
+{
+  uint32_t length;
+  uint32_t type;
+};
+
+uint64_t alignRecord( uint64_t size )
+{
+  return ( size + 7 ) & ~uint64_t(7);
+}
+
+// FNV-1a
+uint64_t hashString( const std::string& str )
+{
+  uint64_t hash = 14695981039346656037ULL;
+  for ( size_t i=0; i<str.size(); i++ )
+  {
+    hash ^= (uint8_t)str[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+bool isReaderAlive( uint64_t heartbeat, uint64_t now )
+{
+  return heartbeat > CLAIMED_SLOT && now < heartbeat + READER_TIMEOUT_NSEC;
+}
+
+// The segment is shared between processes, so we cannot use mutexes.
+// There is only one writer, so full barriers between writing data and
+// publishing positions (and between reading them on the other side) suffice.
+inline void memoryBarrier()
+{
+  __sync_synchronize();
+}
+
+}
+
+// Positions count bytes since creation of the segment and only ever
+// increase. The data of position p is stored at offset p % capacity.
+// The writer first announces the region it is about to overwrite in
+// reserve_pos, then writes, then advances write_pos. A reader can check
+// that the data it has read was not overwritten in the meantime by
+// comparing its position to reserve_pos afterwards.
+// The reader slots are the only fields written by readers. A reader claims
+// a slot whose heartbeat has timed out with an atomic compare-and-swap.
+struct ShmSegment::Header
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t capacity;
+  int32_t writer_pid;
+  uint32_t reserved;
+  volatile uint64_t reserve_pos;
+  volatile uint64_t write_pos;
+  volatile uint64_t init_pos;
+  volatile uint64_t has_init;
+  struct
+  {
+    volatile uint64_t heartbeat;
+    volatile uint64_t node_hash;
+  } readers[MAX_READERS];
+  char writer_id[MAX_WRITER_ID_LENGTH+1];
+};
+
+ShmSegment::ShmSegment()
+: owner_(false)
+, mapped_size_(0)
+, header_(0)
+, data_(0)
+, reader_slot_(-1)
+, reader_heartbeat_(0)
+{
+}
+
+ShmSegment::~ShmSegment()
+{
+  close();
+}
+
+std::string ShmSegment::getName( const std::string& topic_ns )
+{
+  // segments are global to the host, so separate different ROS masters
+  uint64_t master_hash = hashString( ros::master::getURI() );
+
+  std::ostringstream s;
+  s << "/interactive_markers_" << std::hex << master_hash << "_";
+  for ( size_t i=0; i<topic_ns.size(); i++ )
+  {
+    s << ( topic_ns[i] == '/' ? '_' : topic_ns[i] );
+  }
+  return s.str();
+}
+
+bool ShmSegment::create( const std::string& topic_ns, size_t capacity )
+{
+  close();
+
+  std::string name = getName( topic_ns );
+  int fd = shm_open( name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644 );
+  if ( fd < 0 && errno == EEXIST )
+  {
+    // take over the segment if its writer is gone
+    ShmSegment existing;
+    if ( existing.open( topic_ns ) && existing.isWriterAlive() )
+    {
+      return false;
+    }
+    existing.close();
+    shm_unlink( name.c_str() );
+    fd = shm_open( name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644 );
+  }
+  if ( fd < 0 )
+  {
+    ROS_WARN( "Cannot create shared memory segment %s: %s", name.c_str(), strerror( errno ) );
+    return false;
+  }
+
+  // keep records 8-byte aligned across wrap-arounds
+  capacity &= ~size_t(7);
+  size_t size = DATA_OFFSET + capacity;
+  void* addr = MAP_FAILED;
+  if ( ftruncate( fd, size ) == 0 )
+  {
+    addr = mmap( 0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+  }
+  ::close( fd );
+
+  if ( addr == MAP_FAILED )
+  {
+    ROS_WARN( "Cannot map shared memory segment %s: %s", name.c_str(), strerror( errno ) );
+    shm_unlink( name.c_str() );
+    return false;
+  }
+
+  name_ = name;
+  owner_ = true;
+  mapped_size_ = size;
+  header_ = static_cast<Header*>( addr );
+  data_ = static_cast<uint8_t*>( addr ) + DATA_OFFSET;
+
+  BOOST_STATIC_ASSERT( sizeof(Header) <= DATA_OFFSET );
+  header_->version = SHM_VERSION;
+  header_->capacity = capacity;
+  header_->writer_pid = getpid();
+  header_->reserve_pos = 0;
+  header_->write_pos = 0;
+  header_->init_pos = 0;
+  header_->has_init = 0;
+  memset( (void*)header_->readers, 0, sizeof(header_->readers) );
+  header_->writer_id[0] = 0;
+  memoryBarrier();
+  // readers check the magic number last
+  header_->magic = SHM_MAGIC;
+  return true;
+}
+
+bool ShmSegment::open( const std::string& topic_ns )
+{
+  close();
+
+  std::string name = getName( topic_ns );
+  // readers need write access for their heartbeat
+  int fd = shm_open( name.c_str(), O_RDWR, 0 );
+  if ( fd < 0 )
+  {
+    return false;
+  }
+
+  struct stat st;
+  void* addr = MAP_FAILED;
+  if ( fstat( fd, &st ) == 0 && (size_t)st.st_size > DATA_OFFSET )
+  {
+    addr = mmap( 0, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+  }
+  ::close( fd );
+
+  if ( addr == MAP_FAILED )
+  {
+    return false;
+  }
+
+  Header* header = static_cast<Header*>( addr );
+  memoryBarrier();
+  if ( header->magic != SHM_MAGIC || header->version != SHM_VERSION ||
+      header->capacity + DATA_OFFSET > (uint64_t)st.st_size )
+  {
+    munmap( addr, st.st_size );
+    return false;
+  }
+
+  name_ = name;
+  owner_ = false;
+  mapped_size_ = st.st_size;
+  header_ = header;
+  data_ = static_cast<uint8_t*>( addr ) + DATA_OFFSET;
+  return true;
+}
+
+void ShmSegment::close()
+{
+  if ( !header_ )
+  {
+    return;
+  }
+
+  if ( owner_ )
+  {
+    header_->writer_pid = 0;
+    shm_unlink( name_.c_str() );
+  }
+  else if ( reader_slot_ >= 0 )
+  {
+    // free the slot, unless it has been taken over already
+    __sync_bool_compare_and_swap( &header_->readers[reader_slot_].heartbeat, reader_heartbeat_, 0 );
+  }
+  munmap( header_, mapped_size_ );
+
+  name_.clear();
+  owner_ = false;
+  mapped_size_ = 0;
+  header_ = 0;
+  data_ = 0;
+  reader_slot_ = -1;
+  reader_heartbeat_ = 0;
+}
+
+bool ShmSegment::isWriterAlive() const
+{
+  if ( !header_ )
+  {
+    return false;
+  }
+  pid_t pid = header_->writer_pid;
+  return pid != 0 && ( kill( pid, 0 ) == 0 || errno == EPERM );
+}
+
+std::string ShmSegment::getWriterId() const
+{
+  if ( !header_ )
+  {
+    return std::string();
+  }
+  return std::string( header_->writer_id, strnlen( header_->writer_id, MAX_WRITER_ID_LENGTH ) );
+}
+
+void ShmSegment::setWriterId( const std::string& server_id )
+{
+  if ( header_ && owner_ && header_->writer_id[0] == 0 )
+  {
+    size_t length = std::min( server_id.size(), MAX_WRITER_ID_LENGTH );
+    memcpy( header_->writer_id, server_id.data(), length );
+    header_->writer_id[length] = 0;
+  }
+}
+
+bool ShmSegment::setReaderHeartbeat()
+{
+  if ( !header_ || owner_ )
+  {
+    return false;
+  }
+
+  uint64_t now = ros::WallTime::now().toNSec();
+  if ( reader_slot_ >= 0 )
+  {
+    // fails if another reader has taken over our slot after a timeout
+    if ( __sync_bool_compare_and_swap( &header_->readers[reader_slot_].heartbeat, reader_heartbeat_, now ) )
+    {
+      reader_heartbeat_ = now;
+      return true;
+    }
+    reader_slot_ = -1;
+  }
+
+  uint64_t node_hash = hashString( ros::this_node::getName() );
+  for ( unsigned i=0; i<MAX_READERS; i++ )
+  {
+    uint64_t heartbeat = header_->readers[i].heartbeat;
+    // the writer does not count the slot while we change the node
+    if ( !isReaderAlive( heartbeat, now ) &&
+        __sync_bool_compare_and_swap( &header_->readers[i].heartbeat, heartbeat, CLAIMED_SLOT ) )
+    {
+      header_->readers[i].node_hash = node_hash;
+      memoryBarrier();
+      header_->readers[i].heartbeat = now;
+      reader_slot_ = i;
+      reader_heartbeat_ = now;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ShmSegment::hasReaders() const
+{
+  if ( !header_ )
+  {
+    return false;
+  }
+  uint64_t now = ros::WallTime::now().toNSec();
+  for ( unsigned i=0; i<MAX_READERS; i++ )
+  {
+    if ( isReaderAlive( header_->readers[i].heartbeat, now ) )
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+unsigned ShmSegment::getNumReaders( const std::string& node_name ) const
+{
+  if ( !header_ )
+  {
+    return 0;
+  }
+  uint64_t now = ros::WallTime::now().toNSec();
+  uint64_t node_hash = hashString( node_name );
+  unsigned num_readers = 0;
+  for ( unsigned i=0; i<MAX_READERS; i++ )
+  {
+    uint64_t heartbeat = header_->readers[i].heartbeat;
+    memoryBarrier();
+    if ( isReaderAlive( heartbeat, now ) && header_->readers[i].node_hash == node_hash )
+    {
+      num_readers++;
+    }
+  }
+  return num_readers;
+}
+
+void ShmSegment::clearInit()
+{
+  if ( header_ && owner_ )
+  {
+    header_->has_init = 0;
+  }
+}
+
+bool ShmSegment::write( const visualization_msgs::InteractiveMarkerInit& init )
+{
+  return write( INIT, init );
+}
+
+bool ShmSegment::write( const visualization_msgs::InteractiveMarkerUpdate& update )
+{
+  return write( UPDATE, update );
+}
+
+bool ShmSegment::writeFallback()
+{
+  uint64_t pos;
+  if ( !reserve( sizeof(RecordHeader), pos ) )
+  {
+    return false;
+  }
+
+  RecordHeader* record = reinterpret_cast<RecordHeader*>( data_ + pos % header_->capacity );
+  record->length = 0;
+  record->type = FALLBACK;
+
+  memoryBarrier();
+  header_->write_pos = pos + sizeof(RecordHeader);
+  return true;
+}
+
+bool ShmSegment::reserve( uint64_t record_size, uint64_t& pos )
+{
+  if ( !header_ || !owner_ )
+  {
+    return false;
+  }
+
+  const uint64_t capacity = header_->capacity;
+  if ( record_size > capacity / 2 )
+  {
+    return false;
+  }
+
+  pos = header_->write_pos;
+  uint64_t offset = pos % capacity;
+
+  // records are never split, so skip the rest of the buffer if needed
+  if ( offset + record_size > capacity )
+  {
+    header_->reserve_pos = pos + capacity - offset;
+    memoryBarrier();
+    RecordHeader* padding = reinterpret_cast<RecordHeader*>( data_ + offset );
+    padding->length = capacity - offset - sizeof(RecordHeader);
+    padding->type = PADDING;
+    pos += capacity - offset;
+  }
+
+  header_->reserve_pos = pos + record_size;
+  memoryBarrier();
+  return true;
+}
+
+template<class MsgT>
+bool ShmSegment::write( uint32_t type, const MsgT& msg )
+{
+  uint32_t length = ros::serialization::serializationLength( msg );
+  uint64_t pos;
+  uint64_t record_size = alignRecord( sizeof(RecordHeader) + length );
+  if ( !reserve( record_size, pos ) )
+  {
+    return false;
+  }
+
+  uint64_t offset = pos % header_->capacity;
+  RecordHeader* record = reinterpret_cast<RecordHeader*>( data_ + offset );
+  record->length = length;
+  record->type = type;
+  ros::serialization::OStream stream( data_ + offset + sizeof(RecordHeader), length );
+  ros::serialization::serialize( stream, msg );
+
+  memoryBarrier();
+  if ( type == INIT )
+  {
+    header_->init_pos = pos;
+    header_->has_init = 1;
+  }
+  header_->write_pos = pos + record_size;
+  return true;
+}
+
+bool ShmSegment::isValid( uint64_t pos ) const
+{
+  memoryBarrier();
+  return header_->reserve_pos <= pos + header_->capacity;
+}
+
+uint64_t ShmSegment::getStartPosition() const
+{
+  uint64_t write_pos = header_->write_pos;
+  memoryBarrier();
+  if ( header_->has_init )
+  {
+    uint64_t init_pos = header_->init_pos;
+    if ( isValid( init_pos ) )
+    {
+      return init_pos;
+    }
+  }
+  return write_pos;
+}
+
+ShmSegment::ReadResultT ShmSegment::read( uint64_t& pos,
+    visualization_msgs::InteractiveMarkerInitPtr* init,
+    visualization_msgs::InteractiveMarkerUpdatePtr* update ) const
+{
+  const uint64_t capacity = header_->capacity;
+  while ( true )
+  {
+    uint64_t write_pos = header_->write_pos;
+    memoryBarrier();
+    if ( pos >= write_pos )
+    {
+      return READ_NONE;
+    }
+
+    uint64_t offset = pos % capacity;
+    RecordHeader record = *reinterpret_cast<const RecordHeader*>( data_ + offset );
+    if ( !isValid( pos ) || record.length > capacity - offset - sizeof(RecordHeader) )
+    {
+      pos = getStartPosition();
+      return READ_OVERRUN;
+    }
+
+    uint64_t next_pos = pos + alignRecord( sizeof(RecordHeader) + record.length );
+    if ( record.type == FALLBACK && isValid( pos ) )
+    {
+      pos = next_pos;
+      return READ_FALLBACK;
+    }
+
+    uint8_t* payload = data_ + offset + sizeof(RecordHeader);
+    ReadResultT result = READ_NONE;
+
+    try
+    {
+      // IStream does not modify the buffer, it just is not const-correct
+      ros::serialization::IStream stream( payload, record.length );
+      if ( record.type == INIT && init )
+      {
+        *init = boost::make_shared<visualization_msgs::InteractiveMarkerInit>();
+        ros::serialization::deserialize( stream, **init );
+        result = READ_INIT;
+      }
+      else if ( record.type == UPDATE && update )
+      {
+        *update = boost::make_shared<visualization_msgs::InteractiveMarkerUpdate>();
+        ros::serialization::deserialize( stream, **update );
+        result = READ_UPDATE;
+      }
+    }
+    catch ( std::exception& e )
+    {
+      // the data has changed under our feet
+      pos = getStartPosition();
+      return READ_OVERRUN;
+    }
+
+    // the writer might have overwritten the message while we were reading it
+    if ( !isValid( pos ) )
+    {
+      pos = getStartPosition();
+      return READ_OVERRUN;
+    }
+
+    pos = next_pos;
+    if ( result != READ_NONE )
+    {
+      return result;
+    }
+  }
+}
+
+bool ShmSegment::readLatestInit( uint64_t before_pos, visualization_msgs::InteractiveMarkerInitPtr& init ) const
+{
+  if ( !header_->has_init )
+  {
+    return false;
+  }
+  uint64_t pos = header_->init_pos;
+  return pos < before_pos && read( pos, &init, 0 ) == READ_INIT;
+}
+
+ShmServerTransport::ShmServerTransport( const ros::NodeHandle& node_handle, size_t capacity )
+: node_handle_(node_handle)
+, ros_transport_(node_handle)
+, capacity_(capacity)
+, skipped_init_(false)
+{
+  ros_transport_.setSubscriberCallbacks(
+      boost::bind( &ShmServerTransport::subscriberConnected, this, _1 ),
+      boost::bind( &ShmServerTransport::subscriberDisconnected, this, _1 ) );
+}
+
+void ShmServerTransport::advertise( const std::string& topic_ns, const FeedbackCallback& feedback_cb )
+{
+  {
+    boost::mutex::scoped_lock lock( mutex_ );
+    init_topic_ = node_handle_.resolveName( topic_ns + "/update_full" );
+    if ( !segment_.create( topic_ns, capacity_ ) )
+    {
+      ROS_WARN( "Shared memory for %s is in use by another server. Publishing via ROS only.", topic_ns.c_str() );
+    }
+  }
+  ros_transport_.advertise( topic_ns, feedback_cb );
+}
+
+void ShmServerTransport::subscriberConnected( const ros::SingleSubscriberPublisher& pub )
+{
+  boost::mutex::scoped_lock lock( mutex_ );
+  if ( pub.getTopic() != init_topic_ )
+  {
+    update_subscribers_[ pub.getSubscriberName() ]++;
+    return;
+  }
+
+  unsigned& connections = init_subscribers_[ pub.getSubscriberName() ];
+  connections++;
+  // instead of latching: readers of the segment find the init message there
+  if ( last_init_ && ( !segment_.isOpen() || connections > segment_.getNumReaders( pub.getSubscriberName() ) ) )
+  {
+    pub.publish( last_init_ );
+  }
+}
+
+void ShmServerTransport::subscriberDisconnected( const ros::SingleSubscriberPublisher& pub )
+{
+  boost::mutex::scoped_lock lock( mutex_ );
+  std::map<std::string,unsigned>& subscribers =
+      pub.getTopic() == init_topic_ ? init_subscribers_ : update_subscribers_;
+  std::map<std::string,unsigned>::iterator it = subscribers.find( pub.getSubscriberName() );
+  if ( it != subscribers.end() && --it->second == 0 )
+  {
+    subscribers.erase( it );
+  }
+}
+
+bool ShmServerTransport::hasRosSubscribers( const std::map<std::string,unsigned>& subscribers ) const
+{
+  if ( !segment_.isOpen() )
+  {
+    return !subscribers.empty();
+  }
+  // readers are told apart from other subscribers by their node only
+  std::map<std::string,unsigned>::const_iterator it;
+  for ( it = subscribers.begin(); it != subscribers.end(); ++it )
+  {
+    if ( it->second > segment_.getNumReaders( it->first ) )
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ShmServerTransport::hasSegmentReaders()
+{
+  if ( !segment_.isOpen() )
+  {
+    return false;
+  }
+  if ( segment_.hasReaders() )
+  {
+    return true;
+  }
+  // readers attaching later have to wait for us to write the init message
+  if ( !skipped_init_ )
+  {
+    segment_.clearInit();
+    skipped_init_ = true;
+  }
+  return false;
+}
+
+template<class MsgT>
+void ShmServerTransport::writeSegment( const MsgT& msg )
+{
+  if ( segment_.isOpen() && !segment_.write( msg ) )
+  {
+    ROS_WARN( "Message is too large for the shared memory segment (%lu bytes). Publishing via ROS only.",
+        (unsigned long)capacity_ );
+    segment_.writeFallback();
+    segment_.close();
+  }
+}
+
+void ShmServerTransport::publish( const visualization_msgs::InteractiveMarkerInitConstPtr& init )
+{
+  boost::mutex::scoped_lock lock( mutex_ );
+  // readers need to know our id before they receive anything via ROS
+  segment_.setWriterId( init->server_id );
+  last_init_ = init;
+  if ( hasSegmentReaders() )
+  {
+    skipped_init_ = false;
+    writeSegment( *init );
+  }
+  // readers see the message in the segment before they see it in ROS
+  if ( hasRosSubscribers( init_subscribers_ ) )
+  {
+    ros_transport_.publish( init );
+  }
+}
+
+void ShmServerTransport::publish( const visualization_msgs::InteractiveMarkerUpdateConstPtr& update )
+{
+  boost::mutex::scoped_lock lock( mutex_ );
+  segment_.setWriterId( update->server_id );
+  if ( hasSegmentReaders() )
+  {
+    if ( !skipped_init_ )
+    {
+      writeSegment( *update );
+    }
+    else if ( last_init_ && last_init_->seq_num == update->seq_num )
+    {
+      // a keep-alive: the last init message is a valid starting point
+      skipped_init_ = false;
+      writeSegment( *last_init_ );
+      writeSegment( *update );
+    }
+    // otherwise, the server will publish an init message right after this update
+  }
+  if ( hasRosSubscribers( update_subscribers_ ) )
+  {
+    ros_transport_.publish( update );
+  }
+}
+
+void ShmServerTransport::setKeepAlive( double period, const KeepAliveCallback& keep_alive_cb )
+{
+  ros_transport_.setKeepAlive( period, keep_alive_cb );
+}
+
+void ShmServerTransport::shutdown()
+{
+  {
+    boost::mutex::scoped_lock lock( mutex_ );
+    segment_.close();
+    last_init_.reset();
+  }
+  ros_transport_.shutdown();
+}
+
+ShmClientTransport::ShmClientTransport( const ros::NodeHandle& node_handle, double poll_period )
+: node_handle_(node_handle)
+, ros_transport_(node_handle)
+, poll_period_(poll_period)
+, read_pos_(0)
+, deliver_latched_init_(false)
+, dropped_ros_messages_(0)
+{
+}
+
+ShmClientTransport::~ShmClientTransport()
+{
+  poll_timer_.stop();
+}
+
+void ShmClientTransport::subscribeUpdate( const std::string& topic_ns, const UpdateCallback& update_cb )
+{
+  update_cb_ = update_cb;
+  // register before subscribing, so the server does not publish to us via ROS
+  if ( segment_.open( topic_ns ) && segment_.isWriterAlive() && segment_.setReaderHeartbeat() )
+  {
+    // start with the newest init message, so it can be delivered
+    // together with all updates that follow it
+    read_pos_ = segment_.getStartPosition();
+    poll_timer_ = node_handle_.createWallTimer( ros::WallDuration( poll_period_ ),
+        boost::bind( &ShmClientTransport::poll, this ) );
+  }
+  else
+  {
+    segment_.close();
+  }
+
+  // other servers on the same namespace only publish via ROS
+  ros_transport_.subscribeUpdate( topic_ns, boost::bind( &ShmClientTransport::processRosUpdate, this, _1 ) );
+}
+
+void ShmClientTransport::subscribeInit( const std::string& topic_ns, const InitCallback& init_cb )
+{
+  init_cb_ = init_cb;
+  deliver_latched_init_ = segment_.isOpen();
+  ros_transport_.subscribeInit( topic_ns, boost::bind( &ShmClientTransport::processRosInit, this, _1 ) );
+}
+
+void ShmClientTransport::unsubscribeInit()
+{
+  init_cb_.clear();
+  deliver_latched_init_ = false;
+  ros_transport_.unsubscribeInit();
+}
+
+void ShmClientTransport::unsubscribeUpdate()
+{
+  poll_timer_.stop();
+  update_cb_.clear();
+  init_cb_.clear();
+  deliver_latched_init_ = false;
+  segment_.close();
+  ros_transport_.unsubscribeUpdate();
+}
+
+uint32_t ShmClientTransport::getNumPublishers()
+{
+  // the server writing the segment also advertises the ROS topics
+  return ros_transport_.getNumPublishers();
+}
+
+bool ShmClientTransport::isFromSegment( const std::string& server_id )
+{
+  // the server writes to the segment before publishing via ROS,
+  // so reading it first keeps the order and shows if it has fallen back to ROS
+  poll();
+  if ( segment_.isOpen() && server_id == segment_.getWriterId() )
+  {
+    // only happens while other subscribers receive the server's messages via ROS
+    dropped_ros_messages_++;
+    return true;
+  }
+  return false;
+}
+
+void ShmClientTransport::processRosInit( const visualization_msgs::InteractiveMarkerInitConstPtr& init )
+{
+  if ( !isFromSegment( init->server_id ) && init_cb_ )
+  {
+    init_cb_( init );
+  }
+}
+
+void ShmClientTransport::processRosUpdate( const visualization_msgs::InteractiveMarkerUpdateConstPtr& update )
+{
+  if ( !isFromSegment( update->server_id ) && update_cb_ )
+  {
+    update_cb_( update );
+  }
+}
+
+void ShmClientTransport::poll()
+{
+  if ( !segment_.isOpen() )
+  {
+    return;
+  }
+
+  if ( !segment_.setReaderHeartbeat() )
+  {
+    // another reader took over our slot while we were not polling
+    ROS_WARN( "No free reader slot in shared memory, receiving messages via ROS." );
+    poll_timer_.stop();
+    segment_.close();
+    return;
+  }
+
+  if ( deliver_latched_init_ && init_cb_ )
+  {
+    deliver_latched_init_ = false;
+    visualization_msgs::InteractiveMarkerInitPtr init;
+    // otherwise, it will be read from the stream below
+    if ( segment_.readLatestInit( read_pos_, init ) )
+    {
+      init_cb_( init );
+    }
+  }
+
+  visualization_msgs::InteractiveMarkerInitPtr init;
+  visualization_msgs::InteractiveMarkerUpdatePtr update;
+  while ( segment_.isOpen() )
+  {
+    // callbacks might unsubscribe, so check them every time
+    ShmSegment::ReadResultT result = segment_.read( read_pos_,
+        init_cb_ ? &init : 0, update_cb_ ? &update : 0 );
+
+    switch ( result )
+    {
+    case ShmSegment::READ_NONE:
+      if ( !segment_.isWriterAlive() )
+      {
+        // a new server with the same id would only be seen via ROS
+        poll_timer_.stop();
+        segment_.close();
+      }
+      return;
+    case ShmSegment::READ_INIT:
+      init_cb_( init );
+      break;
+    case ShmSegment::READ_UPDATE:
+      update_cb_( update );
+      break;
+    case ShmSegment::READ_OVERRUN:
+      // the client will notice the gap in sequence numbers and re-initialize
+      ROS_WARN( "Shared memory reader too slow, messages have been lost." );
+      break;
+    case ShmSegment::READ_FALLBACK:
+      ROS_INFO( "Server %s stopped using shared memory, receiving its messages via ROS.",
+          segment_.getWriterId().c_str() );
+      poll_timer_.stop();
+      segment_.close();
+      return;
+    }
+  }
+}
+
+}
@@ -31,8 +31,11 @@
 
 #include "interactive_markers/detail/single_client.h"
 
+#include <ros/serialization.h>
+
 #include <boost/bind.hpp>
 #include <boost/make_shared.hpp>
+#include <boost/unordered_set.hpp>
 
 #define DBG_MSG( ... ) ROS_DEBUG( __VA_ARGS__ );
 //#define DBG_MSG( ... ) printf("   "); printf( __VA_ARGS__ ); printf("\n");
@@ -40,13 +43,24 @@
 namespace interactive_markers
 {
 
+namespace
+{
+bool posesEqual( const geometry_msgs::Pose& a, const geometry_msgs::Pose& b )
+{
+  return a.position.x == b.position.x && a.position.y == b.position.y && a.position.z == b.position.z &&
+      a.orientation.x == b.orientation.x && a.orientation.y == b.orientation.y &&
+      a.orientation.z == b.orientation.z && a.orientation.w == b.orientation.w;
+}
+}
+
 SingleClient::SingleClient(
     const std::string& server_id,
     tf::Transformer& tf,
     const std::string& target_frame,
-    const InteractiveMarkerClient::CbCollection& callbacks
+    const InteractiveMarkerClient::CbCollection& callbacks,
+    const ClockPtr& clock
 )
-: state_(server_id,INIT)
+: state_(server_id,INIT,clock)
 , first_update_seq_num_(-1)
 , last_update_seq_num_(-1)
 , tf_(tf)
@@ -54,8 +68,14 @@ SingleClient::SingleClient(
 , callbacks_(callbacks)
 , server_id_(server_id)
 , warn_keepalive_(false)
+, differential_resync_(false)
+, scene_valid_(false)
+, resync_pending_(false)
+, clock_(clock)
+, metrics_clock_(getDefaultClock())
+, detailed_metrics_(false)
 {
-  callbacks_.statusCb( InteractiveMarkerClient::OK, server_id_, "Waiting for init message." );
+  setStatus( InteractiveMarkerClient::OK, WAITING_FOR_INIT, "Waiting for init message." );
 }
 
 SingleClient::~SingleClient()
@@ -67,6 +87,15 @@ void SingleClient::process(const visualization_msgs::InteractiveMarkerInit::Cons
 {
   DBG_MSG( "%s: received init #%lu", server_id_.c_str(), msg->seq_num );
 
+  ros::WallTime now = metrics_clock_->now();
+  metrics_.messages.add( now );
+  uint32_t msg_size = 0;
+  if ( detailed_metrics_ )
+  {
+    msg_size = ros::serialization::serializationLength( *msg );
+    metrics_.bytes.add( now, msg_size );
+  }
+
   switch (state_)
   {
   case INIT:
@@ -75,8 +104,8 @@ void SingleClient::process(const visualization_msgs::InteractiveMarkerInit::Cons
       DBG_MSG( "Init queue too large. Erasing init message with id %lu.", init_queue_.begin()->msg->seq_num );
       init_queue_.pop_back();
     }
-    init_queue_.push_front( InitMessageContext(tf_,target_frame_,msg ) );
-    callbacks_.statusCb( InteractiveMarkerClient::OK, server_id_, "Init message received." );
+    init_queue_.push_front( InitMessageContext(tf_,target_frame_,msg,&completion_cache_,getContextMetrics(),msg_size) );
+    setStatus( InteractiveMarkerClient::OK, INIT_RECEIVED, "Init message received." );
     break;
 
   case RECEIVING:
@@ -92,7 +121,15 @@ void SingleClient::process(const visualization_msgs::InteractiveMarkerUpdate::Co
     first_update_seq_num_ = msg->seq_num;
   }
 
-  last_update_time_ = ros::Time::now();
+  last_update_time_ = clock_->now();
+  ros::WallTime now = metrics_clock_->now();
+  metrics_.messages.add( now );
+  uint32_t msg_size = 0;
+  if ( detailed_metrics_ )
+  {
+    msg_size = ros::serialization::serializationLength( *msg );
+    metrics_.bytes.add( now, msg_size );
+  }
 
   if ( msg->type == msg->KEEP_ALIVE )
   {
@@ -101,7 +138,7 @@ void SingleClient::process(const visualization_msgs::InteractiveMarkerUpdate::Co
     {
       std::ostringstream s;
       s << "Sequence number of update is out of order. Expected: " << last_update_seq_num_ << " Received: " << msg->seq_num;
-      errorReset( s.str() );
+      errorReset( ClientMetrics::RESET_SEQUENCE_ERROR, s.str() );
       return;
     }
     last_update_seq_num_ = msg->seq_num;
@@ -114,7 +151,7 @@ void SingleClient::process(const visualization_msgs::InteractiveMarkerUpdate::Co
     {
       std::ostringstream s;
       s << "Sequence number of update is out of order. Expected: " << last_update_seq_num_+1 << " Received: " << msg->seq_num;
-      errorReset( s.str() );
+      errorReset( ClientMetrics::RESET_SEQUENCE_ERROR, s.str() );
       return;
     }
     last_update_seq_num_ = msg->seq_num;
@@ -128,11 +165,11 @@ void SingleClient::process(const visualization_msgs::InteractiveMarkerUpdate::Co
       DBG_MSG( "Update queue too large. Erasing update message with id %lu.", update_queue_.begin()->msg->seq_num );
       update_queue_.pop_back();
     }
-    update_queue_.push_front( UpdateMessageContext(tf_,target_frame_,msg) );
+    update_queue_.push_front( UpdateMessageContext(tf_,target_frame_,msg,&completion_cache_,getContextMetrics(),msg_size) );
     break;
 
   case RECEIVING:
-    update_queue_.push_front( UpdateMessageContext(tf_,target_frame_,msg) );
+    update_queue_.push_front( UpdateMessageContext(tf_,target_frame_,msg,&completion_cache_,getContextMetrics(),msg_size) );
     break;
 
   case TF_ERROR:
@@ -156,14 +193,14 @@ void SingleClient::update()
     checkKeepAlive();
     if ( update_queue_.size() > 100 )
     {
-      errorReset( "Update queue overflow. Resetting connection." );
+      errorReset( ClientMetrics::RESET_QUEUE_OVERFLOW, "Update queue overflow. Resetting connection." );
     }
     break;
 
   case TF_ERROR:
     if ( state_.getDuration().toSec() > 1.0 )
     {
-      callbacks_.statusCb( InteractiveMarkerClient::ERROR, server_id_, "1 second has passed. Re-initializing." );
+      setStatus( InteractiveMarkerClient::ERROR, REINITIALIZING, "1 second has passed. Re-initializing." );
       state_ = INIT;
     }
     break;
@@ -172,18 +209,21 @@ void SingleClient::update()
 
 void SingleClient::checkKeepAlive()
 {
-  double time_since_upd = (ros::Time::now() - last_update_time_).toSec();
+  double time_since_upd = (clock_->now() - last_update_time_).toSec();
   if ( time_since_upd > 2.0 )
   {
-    std::ostringstream s;
-    s << "No update received for " << round(time_since_upd) << " seconds.";
-    callbacks_.statusCb( InteractiveMarkerClient::WARN, server_id_, s.str() );
+    if ( status_.changed( InteractiveMarkerClient::WARN, NO_UPDATE_RECEIVED ) )
+    {
+      std::ostringstream s;
+      s << "No update received for " << round(time_since_upd) << " seconds.";
+      callbacks_.statusCb( InteractiveMarkerClient::WARN, server_id_, s.str() );
+    }
     warn_keepalive_ = true;
   }
   else if ( warn_keepalive_ )
   {
     warn_keepalive_ = false;
-    callbacks_.statusCb( InteractiveMarkerClient::OK, server_id_, "OK" );
+    setStatus( InteractiveMarkerClient::OK, UPDATES_OK, "OK" );
   }
 }
 
@@ -196,7 +236,7 @@ void SingleClient::checkInitFinished()
 
   if (last_update_seq_num_ == (uint64_t)-1)
   {
-    callbacks_.statusCb( InteractiveMarkerClient::OK, server_id_, "Initialization: Waiting for first update/keep-alive message." );
+    setStatus( InteractiveMarkerClient::OK, WAITING_FOR_UPDATE, "Initialization: Waiting for first update/keep-alive message." );
     return;
   }
 
@@ -208,7 +248,7 @@ void SingleClient::checkInitFinished()
 
     if ( !init_it->isReady() )
     {
-      callbacks_.statusCb( InteractiveMarkerClient::OK, server_id_, "Initialization: Waiting for tf info." );
+      setStatus( InteractiveMarkerClient::OK, WAITING_FOR_TF, "Initialization: Waiting for tf info." );
     }
     else if ( next_up_exists )
     {
@@ -221,8 +261,21 @@ void SingleClient::checkInitFinished()
 
       DBG_MSG( "%s", init_it->msg->markers[0].header.frame_id.c_str() );
 
-      callbacks_.initCb( init_it->msg );
-      callbacks_.statusCb( InteractiveMarkerClient::OK, server_id_, "Receiving updates." );
+      if ( resync_pending_ )
+      {
+        pushResyncUpdate( *init_it );
+        resync_pending_ = false;
+      }
+      else
+      {
+        callbacks_.initCb( init_it->msg );
+      }
+      if ( differential_resync_ )
+      {
+        updateScene( *init_it );
+      }
+      completion_cache_.retain( init_it->msg->markers );
+      setStatus( InteractiveMarkerClient::OK, RECEIVING_UPDATES, "Receiving updates." );
 
       init_queue_.clear();
       state_ = RECEIVING;
@@ -246,9 +299,12 @@ void SingleClient::transformInitMsgs()
     {
       // we want to notify the user, but also keep the init message
       // in case it is the only one we will receive.
-      std::ostringstream s;
-      s << "Cannot get tf info for init message with sequence number " << it->msg->seq_num << ". Error: " << e.what();
-      callbacks_.statusCb( InteractiveMarkerClient::WARN, server_id_, s.str() );
+      if ( status_.changed( InteractiveMarkerClient::WARN, INIT_TF_ERROR ) )
+      {
+        std::ostringstream s;
+        s << "Cannot get tf info for init message with sequence number " << it->msg->seq_num << ". Error: " << e.what();
+        callbacks_.statusCb( InteractiveMarkerClient::WARN, server_id_, s.str() );
+      }
     }
     ++it;
   }
@@ -267,20 +323,22 @@ void SingleClient::transformUpdateMsgs( )
     {
       std::ostringstream s;
       s << "Resetting due to tf error: " << e.what();
-      errorReset( s.str() );
+      errorReset( ClientMetrics::RESET_TF_ERROR, s.str() );
       return;
     }
     catch ( ... )
     {
       std::ostringstream s;
       s << "Resetting due to unknown exception";
-      errorReset( s.str() );
+      errorReset( ClientMetrics::RESET_UNKNOWN_ERROR, s.str() );
     }
   }
 }
 
-void SingleClient::errorReset( std::string error_msg )
+void SingleClient::errorReset( ClientMetrics::ResetCauseT cause, std::string error_msg )
 {
+  metrics_.resets[cause]++;
+
   // if we get an error here, we re-initialize everything
   state_ = TF_ERROR;
   update_queue_.clear();
@@ -289,24 +347,253 @@ void SingleClient::errorReset( std::string error_msg )
   last_update_seq_num_ = -1;
   warn_keepalive_ = false;
 
-  callbacks_.statusCb( InteractiveMarkerClient::ERROR, server_id_, error_msg );
+  StatusCodeT code = UNKNOWN_ERROR;
+  switch ( cause )
+  {
+  case ClientMetrics::RESET_SEQUENCE_ERROR:
+    code = SEQUENCE_ERROR;
+    break;
+  case ClientMetrics::RESET_TF_ERROR:
+    code = RESET_TF_ERROR;
+    break;
+  case ClientMetrics::RESET_QUEUE_OVERFLOW:
+    code = QUEUE_OVERFLOW;
+    break;
+  default:
+    break;
+  }
+  setStatus( InteractiveMarkerClient::ERROR, code, error_msg.c_str() );
+
+  // keep the consumer's state if we can bring it up to date later on
+  if ( differential_resync_ && scene_valid_ )
+  {
+    resync_pending_ = true;
+    return;
+  }
   callbacks_.resetCb( server_id_ );
 }
 
+void SingleClient::setDetailedMetrics( bool enable )
+{
+  detailed_metrics_ = enable;
+}
+
+ClientMetrics* SingleClient::getContextMetrics()
+{
+  return detailed_metrics_ ? &metrics_ : NULL;
+}
+
+void SingleClient::setDifferentialResync( bool enable )
+{
+  differential_resync_ = enable;
+  if ( !enable )
+  {
+    scene_.clear();
+    scene_valid_ = false;
+    if ( resync_pending_ )
+    {
+      resync_pending_ = false;
+      callbacks_.resetCb( server_id_ );
+    }
+  }
+}
+
+void SingleClient::setClock( const ClockPtr& clock )
+{
+  clock_ = clock;
+  state_.setClock( clock );
+  last_update_time_ = clock_->now();
+}
+
+void SingleClient::pushResyncUpdate( const InitMessageContext& init_context )
+{
+  const visualization_msgs::InteractiveMarkerInit& init = *init_context.msg;
+
+  visualization_msgs::InteractiveMarkerUpdatePtr update( new visualization_msgs::InteractiveMarkerUpdate() );
+  update->server_id = init.server_id;
+  update->seq_num = init.seq_num;
+  update->type = visualization_msgs::InteractiveMarkerUpdate::UPDATE;
+
+  boost::unordered_set< std::string > in_init;
+  bool have_hashes = init_context.marker_hashes.size() == init.markers.size();
+
+  for ( size_t i=0; i<init.markers.size(); i++ )
+  {
+    const visualization_msgs::InteractiveMarker& marker = init.markers[i];
+    in_init.insert( marker.name );
+
+    M_SceneEntry::const_iterator scene_it = scene_.find( marker.name );
+    if ( scene_it == scene_.end() || !have_hashes || scene_it->second.hash != init_context.marker_hashes[i] )
+    {
+      // new or changed marker
+      update->markers.push_back( marker );
+    }
+    else if ( scene_it->second.header.frame_id != marker.header.frame_id ||
+        scene_it->second.header.stamp != marker.header.stamp ||
+        !posesEqual( scene_it->second.pose, marker.pose ) )
+    {
+      visualization_msgs::InteractiveMarkerPose pose_update;
+      pose_update.header = marker.header;
+      pose_update.pose = marker.pose;
+      pose_update.name = marker.name;
+      update->poses.push_back( pose_update );
+    }
+  }
+
+  M_SceneEntry::const_iterator scene_it;
+  for ( scene_it = scene_.begin(); scene_it != scene_.end(); ++scene_it )
+  {
+    if ( in_init.find( scene_it->first ) == in_init.end() )
+    {
+      update->erases.push_back( scene_it->first );
+    }
+  }
+
+  DBG_MSG( "%s: re-synchronized using init #%lu: %lu markers, %lu poses, %lu erases.", server_id_.c_str(),
+      init.seq_num, update->markers.size(), update->poses.size(), update->erases.size() );
+
+  callbacks_.updateCb( update );
+}
+
+void SingleClient::updateScene( const InitMessageContext& init_context )
+{
+  const visualization_msgs::InteractiveMarkerInit& init = *init_context.msg;
+
+  scene_.clear();
+  scene_valid_ = false;
+
+  // the message has been received before differential resync was enabled
+  if ( init_context.marker_hashes.size() != init.markers.size() )
+  {
+    return;
+  }
+
+  for ( size_t i=0; i<init.markers.size(); i++ )
+  {
+    SceneEntry& entry = scene_[init.markers[i].name];
+    entry.hash = init_context.marker_hashes[i];
+    entry.header = init.markers[i].header;
+    entry.pose = init.markers[i].pose;
+  }
+  scene_valid_ = true;
+}
+
+void SingleClient::updateScene( const UpdateMessageContext& update_context )
+{
+  const visualization_msgs::InteractiveMarkerUpdate& update = *update_context.msg;
+
+  if ( update_context.marker_hashes.size() != update.markers.size() )
+  {
+    scene_.clear();
+    scene_valid_ = false;
+    return;
+  }
+
+  for ( size_t i=0; i<update.markers.size(); i++ )
+  {
+    SceneEntry& entry = scene_[update.markers[i].name];
+    entry.hash = update_context.marker_hashes[i];
+    entry.header = update.markers[i].header;
+    entry.pose = update.markers[i].pose;
+  }
+  for ( size_t i=0; i<update.poses.size(); i++ )
+  {
+    M_SceneEntry::iterator scene_it = scene_.find( update.poses[i].name );
+    if ( scene_it != scene_.end() )
+    {
+      scene_it->second.header = update.poses[i].header;
+      scene_it->second.pose = update.poses[i].pose;
+    }
+  }
+  for ( size_t i=0; i<update.erases.size(); i++ )
+  {
+    scene_.erase( update.erases[i] );
+  }
+}
+
 void SingleClient::pushUpdates()
 {
   if( !update_queue_.empty() && update_queue_.back().isReady() )
   {
-    callbacks_.statusCb( InteractiveMarkerClient::OK, server_id_, "OK" );
+    setStatus( InteractiveMarkerClient::OK, UPDATES_OK, "OK" );
   }
   while( !update_queue_.empty() && update_queue_.back().isReady() )
   {
     DBG_MSG("Pushing out update #%lu.", update_queue_.back().msg->seq_num );
+    if ( detailed_metrics_ )
+    {
+      addUpdateLatency( *update_queue_.back().msg );
+    }
     callbacks_.updateCb( update_queue_.back().msg );
+    if ( differential_resync_ )
+    {
+      updateScene( update_queue_.back() );
+    }
+    const std::vector<std::string>& erases = update_queue_.back().msg->erases;
+    for ( size_t i=0; i<erases.size(); i++ )
+    {
+      completion_cache_.erase( erases[i] );
+    }
     update_queue_.pop_back();
   }
 }
 
+void SingleClient::addUpdateLatency( const visualization_msgs::InteractiveMarkerUpdate& update )
+{
+  if ( !ros::Time::isValid() )
+  {
+    return;
+  }
+  ros::Time now = ros::Time::now();
+  for ( size_t i=0; i<update.markers.size(); i++ )
+  {
+    const ros::Time& stamp = update.markers[i].header.stamp;
+    if ( !stamp.isZero() && stamp <= now )
+    {
+      metrics_.update_latency.add( ros::WallDuration( (now - stamp).toSec() ) );
+    }
+  }
+  for ( size_t i=0; i<update.poses.size(); i++ )
+  {
+    const ros::Time& stamp = update.poses[i].header.stamp;
+    if ( !stamp.isZero() && stamp <= now )
+    {
+      metrics_.update_latency.add( ros::WallDuration( (now - stamp).toSec() ) );
+    }
+  }
+}
+
+ClientMetrics SingleClient::getMetrics() const
+{
+  ClientMetrics metrics = metrics_;
+  state_.getTrace( metrics.state );
+  metrics.state.state_names.resize( 3 );
+  metrics.state.state_names[INIT] = "INIT";
+  metrics.state.state_names[RECEIVING] = "RECEIVING";
+  metrics.state.state_names[TF_ERROR] = "TF_ERROR";
+  metrics.update_queue_size = update_queue_.size();
+  metrics.update_queue_bytes = 0;
+  for ( M_UpdateMessageContext::const_iterator it = update_queue_.begin(); it != update_queue_.end(); ++it )
+  {
+    metrics.update_queue_bytes += it->msg_size;
+  }
+  metrics.init_queue_size = init_queue_.size();
+  metrics.init_queue_bytes = 0;
+  for ( M_InitMessageContext::const_iterator it = init_queue_.begin(); it != init_queue_.end(); ++it )
+  {
+    metrics.init_queue_bytes += it->msg_size;
+  }
+  return metrics;
+}
+
+void SingleClient::setStatus( InteractiveMarkerClient::StatusT status, StatusCodeT code, const char* msg )
+{
+  if ( status_.changed( status, code ) )
+  {
+    callbacks_.statusCb( status, server_id_, msg );
+  }
+}
+
 bool SingleClient::isInitialized()
 {
   return (state_ != INIT);
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2012, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Measures the throughput of autoComplete() on 6-DOF markers with
+// default controls, i.e. the work a client does for every marker on re-init.
+//
+// usage: autocomplete_benchmark [num_markers] [num_iterations]
+
+#include <ros/time.h>
+
+#include <interactive_markers/tools.h>
+
+#include "benchmark_tools.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace visualization_msgs;
+using interactive_markers::make6DofMarker;
+
+int main(int argc, char** argv)
+{
+  unsigned num_markers = argc > 1 ? atoi( argv[1] ) : 1000;
+  unsigned num_iterations = argc > 2 ? atoi( argv[2] ) : 10;
+
+  std::vector<InteractiveMarker> templates;
+  templates.reserve( num_markers );
+  for ( unsigned i=0; i<num_markers; i++ )
+  {
+    templates.push_back( make6DofMarker( i ) );
+  }
+
+  // warm up
+  std::vector<InteractiveMarker> markers = templates;
+  for ( unsigned i=0; i<num_markers; i++ )
+  {
+    interactive_markers::autoComplete( markers[i] );
+  }
+
+  double total = 0;
+  for ( unsigned it=0; it<num_iterations; it++ )
+  {
+    markers = templates;
+
+    ros::WallTime start = ros::WallTime::now();
+    for ( unsigned i=0; i<num_markers; i++ )
+    {
+      interactive_markers::autoComplete( markers[i] );
+    }
+    total += ( ros::WallTime::now() - start ).toSec();
+  }
+
+  double total_batch = 0;
+  for ( unsigned it=0; it<num_iterations; it++ )
+  {
+    markers = templates;
+
+    ros::WallTime start = ros::WallTime::now();
+    interactive_markers::autoComplete( markers );
+    total_batch += ( ros::WallTime::now() - start ).toSec();
+  }
+
+  double per_marker_us = total / double(num_markers*num_iterations) * 1e6;
+  double per_marker_batch_us = total_batch / double(num_markers*num_iterations) * 1e6;
+
+  printf( "markers: %u iterations: %u\n", num_markers, num_iterations );
+  printf( "autoComplete: %.2f us/marker, %.0f markers/s\n",
+      per_marker_us, 1e6 / per_marker_us );
+  printf( "autoComplete (batch): %.2f us/marker, %.0f markers/s\n",
+      per_marker_batch_us, 1e6 / per_marker_batch_us );
+
+  return 0;
+}
@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2012, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Helpers shared by the benchmarks and load generators in this directory
+
+#ifndef INTERACTIVE_MARKERS_BENCHMARK_TOOLS
+#define INTERACTIVE_MARKERS_BENCHMARK_TOOLS
+
+#include <visualization_msgs/InteractiveMarker.h>
+
+#include <boost/lexical_cast.hpp>
+
+#include <sys/resource.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <string>
+
+namespace interactive_markers
+{
+
+/// @return user and system CPU time of this process in seconds
+inline double getCpuTime()
+{
+  struct rusage usage;
+  getrusage( RUSAGE_SELF, &usage );
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6 +
+      usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+}
+
+/// @return resident memory of this process in bytes
+inline uint64_t getResidentMemory()
+{
+  unsigned long size = 0, resident = 0;
+  FILE* f = fopen( "/proc/self/statm", "r" );
+  if ( f )
+  {
+    if ( fscanf( f, "%lu %lu", &size, &resident ) != 2 )
+    {
+      resident = 0;
+    }
+    fclose( f );
+  }
+  return (uint64_t)resident * sysconf( _SC_PAGESIZE );
+}
+
+inline std::string getMarkerName( unsigned index )
+{
+  return "marker_" + boost::lexical_cast<std::string>( index );
+}
+
+/// Markers on a grid with the given number of columns,
+/// each bobbing up and down with its own phase
+inline geometry_msgs::Pose getGridPose( unsigned index, unsigned columns, double t )
+{
+  geometry_msgs::Pose pose;
+  pose.position.x = index % columns;
+  pose.position.y = index / columns;
+  pose.position.z = 0.2 * sin( t + index );
+  pose.orientation.w = 1;
+  return pose;
+}
+
+inline visualization_msgs::Marker makeBox( float scale )
+{
+  visualization_msgs::Marker marker;
+  marker.type = visualization_msgs::Marker::CUBE;
+  marker.scale.x = marker.scale.y = marker.scale.z = scale * 0.45;
+  marker.color.r = marker.color.g = marker.color.b = 0.5;
+  marker.color.a = 1.0;
+  return marker;
+}
+
+/// Triangle fan around the origin, standing in for a mesh
+inline visualization_msgs::Marker makeTriangleFan( float radius, unsigned num_triangles )
+{
+  visualization_msgs::Marker marker;
+  marker.type = visualization_msgs::Marker::TRIANGLE_LIST;
+  marker.scale.x = marker.scale.y = marker.scale.z = 1;
+  marker.color.r = marker.color.g = marker.color.b = 0.5;
+  marker.color.a = 1.0;
+
+  for ( unsigned i=0; i<num_triangles; i++ )
+  {
+    double a0 = 2 * M_PI * i / num_triangles;
+    double a1 = 2 * M_PI * (i+1) / num_triangles;
+    geometry_msgs::Point p;
+    marker.points.push_back( p );
+    p.x = radius * cos(a0);
+    p.y = radius * sin(a0);
+    marker.points.push_back( p );
+    p.x = radius * cos(a1);
+    p.y = radius * sin(a1);
+    marker.points.push_back( p );
+  }
+  return marker;
+}
+
+/// Add move and rotate controls for all three axes
+inline void add6DofControls( visualization_msgs::InteractiveMarker &int_marker )
+{
+  const char* axes[] = { "x", "z", "y" };
+  for ( int i=0; i<3; i++ )
+  {
+    visualization_msgs::InteractiveMarkerControl control;
+    control.orientation.w = 1;
+    control.orientation.x = i == 0;
+    control.orientation.y = i == 1;
+    control.orientation.z = i == 2;
+    control.name = std::string( "rotate_" ) + axes[i];
+    control.interaction_mode = visualization_msgs::InteractiveMarkerControl::ROTATE_AXIS;
+    int_marker.controls.push_back( control );
+    control.name = std::string( "move_" ) + axes[i];
+    control.interaction_mode = visualization_msgs::InteractiveMarkerControl::MOVE_AXIS;
+    int_marker.controls.push_back( control );
+  }
+}
+
+/// Marker with 6-DOF controls only, placed along the x axis by index
+inline visualization_msgs::InteractiveMarker make6DofMarker( unsigned index,
+    const std::string& frame_id = "/base_link" )
+{
+  visualization_msgs::InteractiveMarker int_marker;
+  int_marker.header.frame_id = frame_id;
+  int_marker.name = getMarkerName( index );
+  int_marker.description = "6-DOF";
+  int_marker.pose.orientation.w = 1;
+  int_marker.pose.position.x = index;
+
+  add6DofControls( int_marker );
+
+  return int_marker;
+}
+
+}
+
+#endif
@@ -0,0 +1,320 @@
+/*
+ * Copyright (c) 2012, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Microbenchmarks for the hot paths of server and client.
+// Results are written to stdout as one JSON object, so they can be
+// compared across builds.
+//
+// usage: interactive_markers_benchmarks [num_markers] [num_iterations]
+
+#include <ros/ros.h>
+
+#include <interactive_markers/interactive_marker_server.h>
+#include <interactive_markers/menu_handler.h>
+#include <interactive_markers/detail/message_context.h>
+#include <interactive_markers/tools.h>
+#include <interactive_markers/metrics.h>
+
+#include "benchmark_tools.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <deque>
+#include <sstream>
+
+using namespace visualization_msgs;
+using interactive_markers::DurationStats;
+using interactive_markers::InteractiveMarkerServer;
+using interactive_markers::make6DofMarker;
+
+typedef interactive_markers::MessageContext<InteractiveMarkerUpdate> UpdateMessageContext;
+
+namespace
+{
+
+const char* MARKER_FRAME = "/marker_frame";
+const char* TARGET_FRAME = "/base_link";
+
+struct Result
+{
+  std::string name;
+  // number of markers or messages processed in each measurement
+  unsigned batch_size;
+  DurationStats stats;
+};
+
+// a deque, so references stay valid while results are added
+std::deque<Result> results;
+
+Result& addResult( const std::string& name, unsigned batch_size )
+{
+  results.push_back( Result() );
+  results.back().name = name;
+  results.back().batch_size = batch_size;
+  return results.back();
+}
+
+void printResults( unsigned num_markers, unsigned num_iterations )
+{
+  printf( "{\n  \"num_markers\": %u,\n  \"num_iterations\": %u,\n  \"results\": [\n",
+      num_markers, num_iterations );
+  for ( size_t i=0; i<results.size(); i++ )
+  {
+    const Result& result = results[i];
+    double mean_us = result.stats.mean() * 1e6;
+    printf( "    { \"name\": \"%s\", \"count\": %lu, \"batch_size\": %u, "
+        "\"mean_us\": %.3f, \"max_us\": %.3f, \"per_item_us\": %.3f }%s\n",
+        result.name.c_str(), (unsigned long)result.stats.count, result.batch_size,
+        mean_us, result.stats.max.toSec() * 1e6,
+        result.batch_size > 0 ? mean_us / result.batch_size : mean_us,
+        i+1 < results.size() ? "," : "" );
+  }
+  printf( "  ]\n}\n" );
+}
+
+void noopFeedback( const InteractiveMarkerServer::FeedbackConstPtr& )
+{
+}
+
+void benchmarkApplyChanges( unsigned num_markers, unsigned num_iterations )
+{
+  std::vector<InteractiveMarker> markers;
+  for ( unsigned i=0; i<num_markers; i++ )
+  {
+    markers.push_back( make6DofMarker( i ) );
+  }
+
+  // full updates, i.e. all markers are re-inserted
+  {
+    InteractiveMarkerServer server( "benchmark_full" );
+    Result& result = addResult( "apply_changes_full", num_markers );
+    for ( unsigned it=0; it<num_iterations; it++ )
+    {
+      for ( unsigned i=0; i<num_markers; i++ )
+      {
+        markers[i].pose.position.y = it;
+        server.insert( markers[i] );
+      }
+      ros::WallTime start = ros::WallTime::now();
+      server.applyChanges();
+      result.stats.add( ros::WallTime::now() - start );
+    }
+
+    // applyChanges() publishes the full state on the init topic every time
+    Result& init_result = addResult( "publish_init", num_markers );
+    init_result.stats = server.getMetrics().publish_init;
+  }
+
+  // pose updates only
+  {
+    InteractiveMarkerServer server( "benchmark_pose" );
+    for ( unsigned i=0; i<num_markers; i++ )
+    {
+      server.insert( markers[i] );
+    }
+    server.applyChanges();
+
+    Result& result = addResult( "apply_changes_pose", num_markers );
+    geometry_msgs::Pose pose;
+    pose.orientation.w = 1;
+    for ( unsigned it=0; it<num_iterations; it++ )
+    {
+      pose.position.z = it+1;
+      for ( unsigned i=0; i<num_markers; i++ )
+      {
+        server.setPose( markers[i].name, pose );
+      }
+      ros::WallTime start = ros::WallTime::now();
+      server.applyChanges();
+      result.stats.add( ros::WallTime::now() - start );
+    }
+  }
+}
+
+void benchmarkProcessFeedback( unsigned num_markers, unsigned num_iterations )
+{
+  InteractiveMarkerServer server( "benchmark_feedback" );
+  std::vector<InteractiveMarkerFeedbackPtr> feedback;
+  for ( unsigned i=0; i<num_markers; i++ )
+  {
+    InteractiveMarker int_marker = make6DofMarker( i );
+    server.insert( int_marker, &noopFeedback );
+
+    InteractiveMarkerFeedbackPtr msg( new InteractiveMarkerFeedback() );
+    msg->client_id = "benchmark";
+    msg->marker_name = int_marker.name;
+    msg->event_type = InteractiveMarkerFeedback::POSE_UPDATE;
+    msg->header = int_marker.header;
+    msg->pose = int_marker.pose;
+    feedback.push_back( msg );
+  }
+  server.applyChanges();
+
+  Result& result = addResult( "process_feedback", num_markers );
+  for ( unsigned it=0; it<num_iterations; it++ )
+  {
+    ros::WallTime start = ros::WallTime::now();
+    for ( unsigned i=0; i<num_markers; i++ )
+    {
+      server.processFeedback( feedback[i], interactive_markers::getDefaultClock()->now() );
+    }
+    result.stats.add( ros::WallTime::now() - start );
+    server.applyChanges();
+  }
+}
+
+void benchmarkMessageContext( unsigned num_markers, unsigned num_iterations )
+{
+  // markers are stamped between two transforms, so they need interpolation
+  tf::Transformer tf;
+  tf::StampedTransform transform( tf::Transform( tf::Quaternion( 0, 0, 0, 1 ), tf::Vector3( 1, 0, 0 ) ),
+      ros::Time( 9 ), TARGET_FRAME, MARKER_FRAME );
+  tf.setTransform( transform );
+  transform.stamp_ = ros::Time( 11 );
+  tf.setTransform( transform );
+
+  InteractiveMarkerUpdatePtr update( new InteractiveMarkerUpdate() );
+  update->server_id = "benchmark";
+  update->type = InteractiveMarkerUpdate::UPDATE;
+  for ( unsigned i=0; i<num_markers; i++ )
+  {
+    update->markers.push_back( make6DofMarker( i, MARKER_FRAME ) );
+    update->markers.back().header.stamp = ros::Time( 10 );
+  }
+
+  Result& construct_result = addResult( "message_context_construct", num_markers );
+  Result& tf_result = addResult( "message_context_get_tf_transforms", num_markers );
+  for ( unsigned it=0; it<num_iterations; it++ )
+  {
+    ros::WallTime start = ros::WallTime::now();
+    UpdateMessageContext context( tf, TARGET_FRAME, update );
+    construct_result.stats.add( ros::WallTime::now() - start );
+
+    start = ros::WallTime::now();
+    context.getTfTransforms();
+    tf_result.stats.add( ros::WallTime::now() - start );
+  }
+
+  // same markers again, as a client sees them in every init message
+  interactive_markers::AutoCompleteCache cache;
+  UpdateMessageContext warm_up( tf, TARGET_FRAME, update, &cache );
+  Result& cached_result = addResult( "message_context_construct_cached", num_markers );
+  for ( unsigned it=0; it<num_iterations; it++ )
+  {
+    ros::WallTime start = ros::WallTime::now();
+    UpdateMessageContext context( tf, TARGET_FRAME, update, &cache );
+    cached_result.stats.add( ros::WallTime::now() - start );
+  }
+}
+
+void benchmarkAutoComplete( unsigned num_markers, unsigned num_iterations )
+{
+  std::vector<InteractiveMarker> templates;
+  for ( unsigned i=0; i<num_markers; i++ )
+  {
+    templates.push_back( make6DofMarker( i ) );
+  }
+
+  Result& result = addResult( "auto_complete", num_markers );
+  Result& batch_result = addResult( "auto_complete_batch", num_markers );
+  std::vector<InteractiveMarker> markers;
+  for ( unsigned it=0; it<num_iterations; it++ )
+  {
+    markers = templates;
+    ros::WallTime start = ros::WallTime::now();
+    for ( unsigned i=0; i<num_markers; i++ )
+    {
+      interactive_markers::autoComplete( markers[i] );
+    }
+    result.stats.add( ros::WallTime::now() - start );
+
+    markers = templates;
+    start = ros::WallTime::now();
+    interactive_markers::autoComplete( markers );
+    batch_result.stats.add( ros::WallTime::now() - start );
+  }
+}
+
+void benchmarkMenuHandler( unsigned num_markers, unsigned num_iterations )
+{
+  InteractiveMarkerServer server( "benchmark_menu" );
+
+  interactive_markers::MenuHandler menu_handler;
+  menu_handler.insert( "First Entry", &noopFeedback );
+  menu_handler.insert( "Second Entry", &noopFeedback );
+  interactive_markers::MenuHandler::EntryHandle sub_menu = menu_handler.insert( "Submenu" );
+  for ( unsigned i=0; i<5; i++ )
+  {
+    std::ostringstream s;
+    s << "Sub Entry " << i;
+    menu_handler.setCheckState( menu_handler.insert( sub_menu, s.str(), &noopFeedback ),
+        interactive_markers::MenuHandler::UNCHECKED );
+  }
+
+  std::vector<std::string> names;
+  for ( unsigned i=0; i<num_markers; i++ )
+  {
+    InteractiveMarker int_marker = make6DofMarker( i );
+    server.insert( int_marker );
+    names.push_back( int_marker.name );
+  }
+  server.applyChanges();
+
+  Result& result = addResult( "menu_handler_apply", num_markers );
+  for ( unsigned it=0; it<num_iterations; it++ )
+  {
+    ros::WallTime start = ros::WallTime::now();
+    for ( unsigned i=0; i<num_markers; i++ )
+    {
+      menu_handler.apply( server, names[i] );
+    }
+    result.stats.add( ros::WallTime::now() - start );
+    server.applyChanges();
+  }
+}
+
+}
+
+int main(int argc, char** argv)
+{
+  ros::init( argc, argv, "interactive_markers_benchmarks", ros::init_options::AnonymousName );
+  ros::NodeHandle nh;
+
+  unsigned num_markers = argc > 1 ? atoi( argv[1] ) : 1000;
+  unsigned num_iterations = argc > 2 ? atoi( argv[2] ) : 10;
+
+  benchmarkApplyChanges( num_markers, num_iterations );
+  benchmarkProcessFeedback( num_markers, num_iterations );
+  benchmarkMessageContext( num_markers, num_iterations );
+  benchmarkAutoComplete( num_markers, num_iterations );
+  benchmarkMenuHandler( num_markers, num_iterations );
+
+  printResults( num_markers, num_iterations );
+  return 0;
+}
@@ -37,6 +37,8 @@
 
 #include <interactive_markers/interactive_marker_server.h>
 #include <interactive_markers/interactive_marker_client.h>
+#include <interactive_markers/marker_store.h>
+#include <interactive_markers/clock.h>
 
 #define DBG_MSG( ... ) printf( __VA_ARGS__ ); printf("\n");
 #define DBG_MSG_STREAM( ... )  std::cout << __VA_ARGS__ << std::endl;
@@ -912,6 +914,442 @@ TEST(InteractiveMarkerClient, init_twoservers)
   t.test(seq);
 }
 
+struct ResyncRecorder
+{
+  std::vector<visualization_msgs::InteractiveMarkerInit> init_msgs;
+  std::vector<visualization_msgs::InteractiveMarkerUpdate> update_msgs;
+  std::vector<std::string> reset_calls;
+  std::vector<std::string> status_msgs;
+
+  void initCb( const visualization_msgs::InteractiveMarkerInitConstPtr& msg ) { init_msgs.push_back( *msg ); }
+  void updateCb( const visualization_msgs::InteractiveMarkerUpdateConstPtr& msg ) { update_msgs.push_back( *msg ); }
+  void resetCb( const std::string& server_id ) { reset_calls.push_back( server_id ); }
+  void statusCb( InteractiveMarkerClient::StatusT, const std::string& server_id, const std::string& msg )
+  {
+    status_msgs.push_back( server_id + ": " + msg );
+  }
+
+  void clear()
+  {
+    init_msgs.clear();
+    update_msgs.clear();
+    reset_calls.clear();
+    status_msgs.clear();
+  }
+};
+
+visualization_msgs::InteractiveMarker makeResyncMarker( std::string name, std::string description, double x )
+{
+  visualization_msgs::InteractiveMarker int_marker;
+  int_marker.header.frame_id = target_frame;
+  int_marker.name = name;
+  int_marker.description = description;
+  int_marker.pose.orientation.w = 1;
+  int_marker.pose.position.x = x;
+
+  visualization_msgs::InteractiveMarkerControl control;
+  control.interaction_mode = visualization_msgs::InteractiveMarkerControl::MOVE_AXIS;
+  int_marker.controls.push_back( control );
+  return int_marker;
+}
+
+visualization_msgs::InteractiveMarkerUpdatePtr makeKeepAlive( uint64_t seq_num )
+{
+  visualization_msgs::InteractiveMarkerUpdatePtr update( new visualization_msgs::InteractiveMarkerUpdate() );
+  update->server_id = "server1";
+  update->type = visualization_msgs::InteractiveMarkerUpdate::KEEP_ALIVE;
+  update->seq_num = seq_num;
+  return update;
+}
+
+TEST(InteractiveMarkerClient, differential_resync)
+{
+  tf::Transformer tf;
+  interactive_markers::InteractiveMarkerClient client( tf, target_frame, "im_client_test" );
+  client.setDifferentialResync( true );
+
+  // drive re-initialization timeouts without sleeping
+  boost::shared_ptr<interactive_markers::ManualClock> clock( new interactive_markers::ManualClock() );
+  client.setClock( clock );
+
+  ResyncRecorder recorder;
+  client.setInitCb( boost::bind( &ResyncRecorder::initCb, &recorder, _1 ) );
+  client.setUpdateCb( boost::bind( &ResyncRecorder::updateCb, &recorder, _1 ) );
+  client.setResetCb( boost::bind( &ResyncRecorder::resetCb, &recorder, _1 ) );
+
+  // initial state: a, b, c, d
+  visualization_msgs::InteractiveMarkerInitPtr init( new visualization_msgs::InteractiveMarkerInit() );
+  init->server_id = "server1";
+  init->seq_num = 0;
+  init->markers.push_back( makeResyncMarker( "a", "", 0 ) );
+  init->markers.push_back( makeResyncMarker( "b", "", 0 ) );
+  init->markers.push_back( makeResyncMarker( "c", "", 0 ) );
+  init->markers.push_back( makeResyncMarker( "d", "", 0 ) );
+  client.processInit( init );
+  client.processUpdate( makeKeepAlive( 0 ) );
+  client.update();
+
+  ASSERT_EQ( 1u, recorder.init_msgs.size() );
+  ASSERT_EQ( 0u, recorder.reset_calls.size() );
+  recorder.clear();
+
+  // sequence error -> no reset
+  client.processUpdate( makeKeepAlive( 1 ) );
+  client.update();
+  ASSERT_EQ( 0u, recorder.reset_calls.size() );
+
+  // wait for re-initialization
+  clock->advance( ros::WallDuration(1.1) );
+  client.update();
+
+  // new state: a removed, b changed, c unchanged, d moved, e added
+  init.reset( new visualization_msgs::InteractiveMarkerInit() );
+  init->server_id = "server1";
+  init->seq_num = 5;
+  init->markers.push_back( makeResyncMarker( "b", "changed", 0 ) );
+  init->markers.push_back( makeResyncMarker( "c", "", 0 ) );
+  init->markers.push_back( makeResyncMarker( "d", "", 1 ) );
+  init->markers.push_back( makeResyncMarker( "e", "", 0 ) );
+  client.processInit( init );
+  client.processUpdate( makeKeepAlive( 5 ) );
+  client.update();
+
+  ASSERT_EQ( 0u, recorder.init_msgs.size() );
+  ASSERT_EQ( 0u, recorder.reset_calls.size() );
+  ASSERT_EQ( 1u, recorder.update_msgs.size() );
+
+  const visualization_msgs::InteractiveMarkerUpdate& update = recorder.update_msgs[0];
+  ASSERT_EQ( 5u, update.seq_num );
+  ASSERT_EQ( 2u, update.markers.size() );
+  ASSERT_EQ( "b", update.markers[0].name );
+  ASSERT_EQ( "e", update.markers[1].name );
+  ASSERT_EQ( 1u, update.poses.size() );
+  ASSERT_EQ( "d", update.poses[0].name );
+  ASSERT_EQ( 1u, update.erases.size() );
+  ASSERT_EQ( "a", update.erases[0] );
+}
+
+
+TEST(InteractiveMarkerClient, reuse_completed_markers)
+{
+  tf::Transformer tf;
+  interactive_markers::InteractiveMarkerClient client( tf, target_frame, "im_client_test" );
+
+  ResyncRecorder recorder;
+  client.setInitCb( boost::bind( &ResyncRecorder::initCb, &recorder, _1 ) );
+  client.setUpdateCb( boost::bind( &ResyncRecorder::updateCb, &recorder, _1 ) );
+
+  visualization_msgs::InteractiveMarkerInitPtr init( new visualization_msgs::InteractiveMarkerInit() );
+  init->server_id = "server1";
+  init->seq_num = 0;
+  init->markers.push_back( makeResyncMarker( "a", "", 0 ) );
+  client.processInit( init );
+  client.processUpdate( makeKeepAlive( 0 ) );
+  client.update();
+
+  // send the same marker again at a different pose
+  visualization_msgs::InteractiveMarkerUpdatePtr update( new visualization_msgs::InteractiveMarkerUpdate() );
+  update->server_id = "server1";
+  update->type = visualization_msgs::InteractiveMarkerUpdate::UPDATE;
+  update->seq_num = 1;
+  update->markers.push_back( makeResyncMarker( "a", "", 2 ) );
+  client.processUpdate( update );
+  client.update();
+
+  ASSERT_EQ( 1u, recorder.init_msgs.size() );
+  ASSERT_EQ( 1u, recorder.update_msgs.size() );
+
+  const visualization_msgs::InteractiveMarker& first = recorder.init_msgs[0].markers[0];
+  const visualization_msgs::InteractiveMarker& second = recorder.update_msgs[0].markers[0];
+
+  // the completed controls are reused, the pose is taken from the new message
+  ASSERT_EQ( 1u, second.controls.size() );
+  ASSERT_EQ( 2u, second.controls[0].markers.size() );
+  ASSERT_EQ( first.controls[0].markers[0].id, second.controls[0].markers[0].id );
+  ASSERT_EQ( first.controls[0].markers[1].id, second.controls[0].markers[1].id );
+  ASSERT_EQ( 2.0, second.pose.position.x );
+}
+
+TEST(MarkerStore, events)
+{
+  interactive_markers::MarkerStore store( 4 );
+
+  visualization_msgs::InteractiveMarkerInitPtr init( new visualization_msgs::InteractiveMarkerInit() );
+  init->server_id = "server1";
+  init->markers.push_back( makeResyncMarker( "a", "", 0 ) );
+  init->markers.push_back( makeResyncMarker( "b", "", 0 ) );
+  store.applyInit( init );
+  ASSERT_EQ( 2u, store.getVersion() );
+
+  visualization_msgs::InteractiveMarkerUpdatePtr update( new visualization_msgs::InteractiveMarkerUpdate() );
+  update->server_id = "server1";
+  update->type = visualization_msgs::InteractiveMarkerUpdate::UPDATE;
+  visualization_msgs::InteractiveMarkerPose pose;
+  pose.name = "a";
+  pose.pose.position.x = 3;
+  update->poses.push_back( pose );
+  update->erases.push_back( "b" );
+  store.applyUpdate( update );
+  ASSERT_EQ( 4u, store.getVersion() );
+
+  std::vector<interactive_markers::MarkerStore::Event> events;
+  ASSERT_TRUE( store.getChangesSince( 2, events ) );
+  ASSERT_EQ( 2u, events.size() );
+  ASSERT_EQ( interactive_markers::MarkerStore::POSE_CHANGED, events[0].type );
+  ASSERT_EQ( "a", events[0].name );
+  ASSERT_EQ( 3.0, events[0].pose.position.x );
+  ASSERT_EQ( interactive_markers::MarkerStore::ERASED, events[1].type );
+  ASSERT_EQ( "b", events[1].name );
+
+  // marker definitions are shared with the message
+  interactive_markers::MarkerStore::Entry entry;
+  ASSERT_TRUE( store.getMarker( "server1", "a", entry ) );
+  ASSERT_EQ( &init->markers[0], entry.marker.get() );
+  ASSERT_EQ( 3.0, entry.pose.position.x );
+  ASSERT_EQ( 3u, entry.version );
+
+  // only the last 4 events are kept
+  store.applyReset( "server1" );
+  events.clear();
+  ASSERT_FALSE( store.getChangesSince( 0, events ) );
+  ASSERT_TRUE( store.getChangesSince( 1, events ) );
+  ASSERT_EQ( 4u, events.size() );
+
+  std::vector<interactive_markers::MarkerStore::Entry> entries;
+  ASSERT_EQ( 5u, store.getMarkers( entries ) );
+  ASSERT_EQ( 0u, entries.size() );
+}
+
+TEST(InteractiveMarkerClient, status_transitions_only)
+{
+  tf::Transformer tf;
+  interactive_markers::InteractiveMarkerClient client( tf, target_frame, "im_client_test" );
+
+  ResyncRecorder recorder;
+  client.setUpdateCb( boost::bind( &ResyncRecorder::updateCb, &recorder, _1 ) );
+  client.setStatusCb( boost::bind( &ResyncRecorder::statusCb, &recorder, _1, _2, _3 ) );
+
+  visualization_msgs::InteractiveMarkerInitPtr init( new visualization_msgs::InteractiveMarkerInit() );
+  init->server_id = "server1";
+  init->seq_num = 0;
+  init->markers.push_back( makeResyncMarker( "a", "", 0 ) );
+  client.processInit( init );
+  client.processUpdate( makeKeepAlive( 0 ) );
+  client.update();
+  recorder.clear();
+
+  for ( uint64_t i=1; i<=20; i++ )
+  {
+    visualization_msgs::InteractiveMarkerUpdatePtr update( new visualization_msgs::InteractiveMarkerUpdate() );
+    update->server_id = "server1";
+    update->type = visualization_msgs::InteractiveMarkerUpdate::UPDATE;
+    update->seq_num = i;
+    update->markers.push_back( makeResyncMarker( "a", "", i ) );
+    client.processUpdate( update );
+    client.update();
+  }
+
+  // only the transition from "Receiving updates." to "OK" is reported
+  ASSERT_EQ( 20u, recorder.update_msgs.size() );
+  ASSERT_EQ( 1u, recorder.status_msgs.size() );
+  ASSERT_EQ( "server1: OK", recorder.status_msgs[0] );
+}
+
+TEST(InteractiveMarkerClient, status_reset_causes)
+{
+  tf::Transformer tf;
+  interactive_markers::InteractiveMarkerClient client( tf, target_frame, "im_client_test" );
+
+  ResyncRecorder recorder;
+  client.setStatusCb( boost::bind( &ResyncRecorder::statusCb, &recorder, _1, _2, _3 ) );
+
+  visualization_msgs::InteractiveMarkerInitPtr init( new visualization_msgs::InteractiveMarkerInit() );
+  init->server_id = "server1";
+  init->seq_num = 0;
+  init->markers.push_back( makeResyncMarker( "a", "", 0 ) );
+  client.processInit( init );
+  client.processUpdate( makeKeepAlive( 0 ) );
+  client.update();
+  recorder.clear();
+
+  // tf error
+  visualization_msgs::InteractiveMarkerUpdatePtr update( new visualization_msgs::InteractiveMarkerUpdate() );
+  update->server_id = "server1";
+  update->type = visualization_msgs::InteractiveMarkerUpdate::UPDATE;
+  update->seq_num = 1;
+  update->markers.push_back( makeResyncMarker( "a", "", 1 ) );
+  update->markers[0].header.frame_id = "missing_frame";
+  client.processUpdate( update );
+  client.update();
+
+  // sequence error while still recovering from the tf error
+  client.processUpdate( makeKeepAlive( 5 ) );
+  client.processUpdate( makeKeepAlive( 7 ) );
+
+  // a second sequence error is not reported again
+  client.processUpdate( makeKeepAlive( 9 ) );
+  client.processUpdate( makeKeepAlive( 11 ) );
+
+  ASSERT_EQ( 2u, recorder.status_msgs.size() );
+  ASSERT_EQ( 0u, recorder.status_msgs[0].find( "server1: Resetting due to tf error" ) );
+  ASSERT_EQ( 0u, recorder.status_msgs[1].find( "server1: Sequence number" ) );
+}
+
+visualization_msgs::InteractiveMarkerUpdateConstPtr last_update_ptr;
+
+void storeUpdatePtr( const visualization_msgs::InteractiveMarkerUpdateConstPtr& msg )
+{
+  last_update_ptr = msg;
+}
+
+TEST(InteractiveMarkerClient, pose_update_without_copy)
+{
+  tf::Transformer tf;
+  interactive_markers::InteractiveMarkerClient client( tf, target_frame, "im_client_test" );
+  client.setUpdateCb( &storeUpdatePtr );
+
+  visualization_msgs::InteractiveMarkerInitPtr init( new visualization_msgs::InteractiveMarkerInit() );
+  init->server_id = "server1";
+  init->seq_num = 0;
+  init->markers.push_back( makeResyncMarker( "a", "", 0 ) );
+  client.processInit( init );
+  client.processUpdate( makeKeepAlive( 0 ) );
+  client.update();
+
+  // nothing to transform or complete -> the message is passed on as is
+  visualization_msgs::InteractiveMarkerUpdatePtr update( new visualization_msgs::InteractiveMarkerUpdate() );
+  update->server_id = "server1";
+  update->type = visualization_msgs::InteractiveMarkerUpdate::UPDATE;
+  update->seq_num = 1;
+  visualization_msgs::InteractiveMarkerPose pose;
+  pose.name = "a";
+  pose.header.frame_id = target_frame;
+  pose.pose.orientation.w = 1;
+  update->poses.push_back( pose );
+  client.processUpdate( update );
+  client.update();
+
+  ASSERT_EQ( update.get(), last_update_ptr.get() );
+
+  // the empty orientation needs to be corrected in a copy
+  update.reset( new visualization_msgs::InteractiveMarkerUpdate( *update ) );
+  update->seq_num = 2;
+  update->poses[0].pose.orientation.w = 0;
+  client.processUpdate( update );
+  client.update();
+
+  ASSERT_NE( update.get(), last_update_ptr.get() );
+  ASSERT_EQ( 0.0, update->poses[0].pose.orientation.w );
+  ASSERT_EQ( 1.0, last_update_ptr->poses[0].pose.orientation.w );
+  last_update_ptr.reset();
+}
+
+TEST(InteractiveMarkerClient, metrics)
+{
+  using interactive_markers::ClientMetrics;
+
+  tf::Transformer tf;
+  interactive_markers::InteractiveMarkerClient client( tf, target_frame, "im_client_test" );
+  client.setDetailedMetrics( true );
+
+  visualization_msgs::InteractiveMarkerInitPtr init( new visualization_msgs::InteractiveMarkerInit() );
+  init->server_id = "server1";
+  init->seq_num = 0;
+  init->markers.push_back( makeResyncMarker( "a", "", 0 ) );
+  client.processInit( init );
+  client.update();
+
+  // the init message waits for the first update
+  interactive_markers::InteractiveMarkerClient::M_ClientMetrics metrics;
+  client.getMetrics( metrics );
+  ASSERT_EQ( 1u, metrics.size() );
+  ClientMetrics& m1 = metrics["server1"];
+  ASSERT_EQ( 1u, m1.init_queue_size );
+  ASSERT_EQ( ros::serialization::serializationLength( *init ), m1.init_queue_bytes );
+  ASSERT_EQ( 1u, m1.messages.count );
+  ASSERT_EQ( 1u, m1.tf_wait[target_frame].stats.count );
+
+  client.processUpdate( makeKeepAlive( 0 ) );
+  client.update();
+
+  client.getMetrics( metrics );
+  ClientMetrics& m2 = metrics["server1"];
+  ASSERT_EQ( 0u, m2.init_queue_size );
+  ASSERT_EQ( 0u, m2.update_queue_size );
+  ASSERT_EQ( 2u, m2.messages.count );
+  ASSERT_EQ( 0u, m2.resets[ClientMetrics::RESET_SEQUENCE_ERROR] );
+
+  // skip a sequence number
+  client.processUpdate( makeKeepAlive( 2 ) );
+  client.update();
+
+  client.getMetrics( metrics );
+  ClientMetrics& m3 = metrics["server1"];
+  ASSERT_EQ( 3u, m3.messages.count );
+  ASSERT_EQ( 1u, m3.resets[ClientMetrics::RESET_SEQUENCE_ERROR] );
+  ASSERT_EQ( 0u, m3.resets[ClientMetrics::RESET_TF_ERROR] );
+
+  // sizes are not measured by default
+  interactive_markers::InteractiveMarkerClient plain_client( tf, target_frame, "im_client_test" );
+  plain_client.processInit( init );
+  plain_client.getMetrics( metrics );
+  ASSERT_EQ( 1u, metrics["server1"].messages.count );
+  ASSERT_EQ( 0u, metrics["server1"].bytes.count );
+  ASSERT_EQ( 0u, metrics["server1"].init_queue_bytes );
+}
+
+TEST(InteractiveMarkerClient, state_trace)
+{
+  using interactive_markers::ClientMetrics;
+
+  tf::Transformer tf;
+  interactive_markers::InteractiveMarkerClient client( tf, target_frame, "im_client_test" );
+  boost::shared_ptr<interactive_markers::ManualClock> clock( new interactive_markers::ManualClock() );
+  client.setClock( clock );
+
+  visualization_msgs::InteractiveMarkerInitPtr init( new visualization_msgs::InteractiveMarkerInit() );
+  init->server_id = "server1";
+  init->seq_num = 0;
+  init->markers.push_back( makeResyncMarker( "a", "", 0 ) );
+  client.processInit( init );
+  clock->advance( ros::WallDuration(1.0) );
+  client.processUpdate( makeKeepAlive( 0 ) );
+  client.update();
+
+  // sequence error after two seconds of receiving
+  clock->advance( ros::WallDuration(2.0) );
+  client.processUpdate( makeKeepAlive( 2 ) );
+  client.update();
+  clock->advance( ros::WallDuration(0.5) );
+
+  interactive_markers::InteractiveMarkerClient::M_ClientMetrics metrics;
+  client.getMetrics( metrics );
+  const interactive_markers::StateTrace& trace = metrics["server1"].state;
+
+  // INIT -> RECEIVING -> TF_ERROR
+  ASSERT_EQ( 2u, trace.num_transitions );
+  ASSERT_EQ( 2u, trace.transitions.size() );
+  ASSERT_EQ( "INIT", trace.getStateName( trace.transitions[0].from ) );
+  ASSERT_EQ( "RECEIVING", trace.getStateName( trace.transitions[0].to ) );
+  ASSERT_EQ( "RECEIVING", trace.getStateName( trace.transitions[1].from ) );
+  ASSERT_EQ( "TF_ERROR", trace.getStateName( trace.transitions[1].to ) );
+  ASSERT_EQ( "TF_ERROR", trace.getStateName( trace.state ) );
+  ASSERT_EQ( 3u, trace.durations.size() );
+  ASSERT_NEAR( 1.0, trace.durations[0].toSec(), 1e-6 );
+  ASSERT_NEAR( 2.0, trace.durations[1].toSec(), 1e-6 );
+  ASSERT_NEAR( 0.5, trace.durations[2].toSec(), 1e-6 );
+
+  // re-initialize
+  clock->advance( ros::WallDuration(1.0) );
+  client.update();
+  client.getMetrics( metrics );
+  ASSERT_EQ( 3u, metrics["server1"].state.num_transitions );
+  ASSERT_EQ( "INIT", trace.getStateName( metrics["server1"].state.state ) );
+
+  interactive_markers::StateTrace client_trace = client.getStateTrace();
+  ASSERT_EQ( 3u, client_trace.state_names.size() );
+  ASSERT_EQ( client_trace.num_transitions, client_trace.transitions.size() );
+}
 
 // Run all the tests that were declared with TEST()
 int main(int argc, char **argv)
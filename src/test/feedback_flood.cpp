@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2012, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Floods a server with feedback from a number of simulated clients and
+// reports, as JSON, how much of it was dropped by the subscriber queue,
+// rejected by the multi-client conflict check and how long it took to
+// reach the user callback.
+//
+// Each client publishes from its own thread with its own client_id.
+// The send time is carried in the header stamp of the feedback, which
+// the server ignores for markers inserted without a stamp.
+//
+// Parameters (private namespace):
+//   ~num_clients     simulated clients (4)
+//   ~num_markers     markers on the server (10)
+//   ~rate            feedback messages per second and client (100)
+//   ~pose_fraction   fraction of POSE_UPDATE events (0.8)
+//   ~menu_fraction   fraction of MENU_SELECT events (0.1), the rest are BUTTON_CLICKs
+//   ~shared_markers  all clients address all markers (true), otherwise
+//                    each client uses its own subset of markers
+//   ~duration        seconds to send feedback for (10)
+
+#include <ros/ros.h>
+
+#include <interactive_markers/interactive_marker_server.h>
+#include <interactive_markers/metrics.h>
+
+#include <boost/thread.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include "benchmark_tools.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace visualization_msgs;
+using namespace interactive_markers;
+
+int num_clients;
+int num_markers;
+double rate;
+double pose_fraction;
+double menu_fraction;
+bool shared_markers;
+double duration;
+
+class FeedbackSink
+{
+public:
+  FeedbackSink() : num_callbacks_(0) {}
+
+  void processFeedback( const InteractiveMarkerFeedbackConstPtr& feedback )
+  {
+    ros::WallTime sent( feedback->header.stamp.sec, feedback->header.stamp.nsec );
+    boost::mutex::scoped_lock lock( mutex_ );
+    latency_.add( ros::WallTime::now() - sent );
+    num_callbacks_++;
+  }
+
+  DurationHistogram getLatency()
+  {
+    boost::mutex::scoped_lock lock( mutex_ );
+    return latency_;
+  }
+
+  uint64_t getNumCallbacks()
+  {
+    boost::mutex::scoped_lock lock( mutex_ );
+    return num_callbacks_;
+  }
+
+private:
+  boost::mutex mutex_;
+  DurationHistogram latency_;
+  uint64_t num_callbacks_;
+};
+
+class FloodClient
+{
+public:
+  FloodClient( ros::NodeHandle& nh, const std::string& topic_ns, unsigned index )
+  : index_( index )
+  , client_id_( "/flood_client_" + boost::lexical_cast<std::string>( index ) )
+  , seed_( index + 1 )
+  , num_sent_(0)
+  {
+    pub_ = nh.advertise<InteractiveMarkerFeedback>( topic_ns + "/feedback", 100 );
+  }
+
+  void run( ros::WallTime end_time )
+  {
+    ros::WallRate loop_rate( rate );
+    while ( ros::ok() && ros::WallTime::now() < end_time )
+    {
+      publishFeedback();
+      loop_rate.sleep();
+    }
+  }
+
+  uint64_t getNumSent() const
+  {
+    return num_sent_;
+  }
+
+private:
+  unsigned pickMarker()
+  {
+    if ( shared_markers )
+    {
+      return rand_r( &seed_ ) % num_markers;
+    }
+    // markers index, index + num_clients, ...
+    if ( index_ >= (unsigned)num_markers )
+    {
+      return index_ % num_markers;
+    }
+    unsigned num_own = ( num_markers - index_ + num_clients - 1 ) / num_clients;
+    return index_ + ( rand_r( &seed_ ) % num_own ) * num_clients;
+  }
+
+  void publishFeedback()
+  {
+    InteractiveMarkerFeedbackPtr feedback( new InteractiveMarkerFeedback() );
+    feedback->client_id = client_id_;
+    feedback->marker_name = getMarkerName( pickMarker() );
+    feedback->pose.orientation.w = 1;
+
+    double r = rand_r( &seed_ ) / ( RAND_MAX + 1.0 );
+    if ( r < pose_fraction )
+    {
+      feedback->event_type = InteractiveMarkerFeedback::POSE_UPDATE;
+    }
+    else if ( r < pose_fraction + menu_fraction )
+    {
+      feedback->event_type = InteractiveMarkerFeedback::MENU_SELECT;
+      feedback->menu_entry_id = 1;
+    }
+    else
+    {
+      feedback->event_type = InteractiveMarkerFeedback::BUTTON_CLICK;
+    }
+
+    ros::WallTime now = ros::WallTime::now();
+    feedback->header.stamp = ros::Time( now.sec, now.nsec );
+
+    pub_.publish( feedback );
+    num_sent_++;
+  }
+
+  ros::Publisher pub_;
+  unsigned index_;
+  std::string client_id_;
+  unsigned seed_;
+  uint64_t num_sent_;
+};
+
+int main(int argc, char** argv)
+{
+  ros::init( argc, argv, "feedback_flood", ros::init_options::AnonymousName );
+  ros::NodeHandle nh;
+  ros::NodeHandle pn("~");
+
+  pn.param( "num_clients", num_clients, 4 );
+  pn.param( "num_markers", num_markers, 10 );
+  pn.param( "rate", rate, 100.0 );
+  pn.param( "pose_fraction", pose_fraction, 0.8 );
+  pn.param( "menu_fraction", menu_fraction, 0.1 );
+  pn.param( "shared_markers", shared_markers, true );
+  pn.param( "duration", duration, 10.0 );
+
+  if ( num_clients <= 0 || num_markers <= 0 || rate <= 0 )
+  {
+    ROS_ERROR( "num_clients, num_markers and rate must be positive." );
+    return 1;
+  }
+
+  std::string topic_ns = ros::this_node::getName();
+
+  FeedbackSink sink;
+  InteractiveMarkerServer server( topic_ns, "", true );
+  for ( int i=0; i<num_markers; i++ )
+  {
+    InteractiveMarker int_marker;
+    int_marker.header.frame_id = "/base_link";
+    int_marker.name = getMarkerName( i );
+    server.insert( int_marker, boost::bind( &FeedbackSink::processFeedback, &sink, _1 ) );
+  }
+  server.applyChanges();
+
+  std::vector< boost::shared_ptr<FloodClient> > clients;
+  for ( int i=0; i<num_clients; i++ )
+  {
+    clients.push_back( boost::shared_ptr<FloodClient>( new FloodClient( nh, topic_ns, i ) ) );
+  }
+
+  // give the publishers time to connect
+  ros::WallDuration( 1.0 ).sleep();
+
+  ros::WallTime start_time = ros::WallTime::now();
+  ros::WallTime end_time = start_time + ros::WallDuration( duration );
+
+  boost::thread_group threads;
+  for ( int i=0; i<num_clients; i++ )
+  {
+    threads.create_thread( boost::bind( &FloodClient::run, clients[i].get(), end_time ) );
+  }
+  threads.join_all();
+
+  // let the server work off its queue
+  ros::WallDuration( 1.0 ).sleep();
+
+  uint64_t sent = 0;
+  for ( int i=0; i<num_clients; i++ )
+  {
+    sent += clients[i]->getNumSent();
+  }
+
+  ServerMetrics metrics = server.getMetrics();
+  DurationHistogram latency = sink.getLatency();
+  uint64_t received = metrics.feedback.count;
+
+  printf( "{\n" );
+  printf( "  \"num_clients\": %d,\n", num_clients );
+  printf( "  \"num_markers\": %d,\n", num_markers );
+  printf( "  \"rate_per_client\": %.1f,\n", rate );
+  printf( "  \"shared_markers\": %s,\n", shared_markers ? "true" : "false" );
+  printf( "  \"sent\": %lu,\n", (unsigned long)sent );
+  printf( "  \"received\": %lu,\n", (unsigned long)received );
+  printf( "  \"dropped\": %lu,\n", (unsigned long)( sent > received ? sent - received : 0 ) );
+  printf( "  \"rejected\": %lu,\n", (unsigned long)metrics.feedback_rejected );
+  printf( "  \"callbacks\": %lu,\n", (unsigned long)sink.getNumCallbacks() );
+  printf( "  \"feedback_latency\": { \"mean_us\": %.3f, \"max_us\": %.3f },\n",
+      metrics.feedback_latency.mean() * 1e6, metrics.feedback_latency.max.toSec() * 1e6 );
+  printf( "  \"callback_latency\": { \"count\": %lu, \"mean_us\": %.3f, \"max_us\": %.3f, \"buckets\": [",
+      (unsigned long)latency.stats.count, latency.stats.mean() * 1e6, latency.stats.max.toSec() * 1e6 );
+  for ( unsigned i=0; i<DurationHistogram::NUM_BUCKETS; i++ )
+  {
+    printf( "%s%lu", i > 0 ? ", " : " ", (unsigned long)latency.buckets[i] );
+  }
+  printf( " ] }\n}\n" );
+
+  return 0;
+}
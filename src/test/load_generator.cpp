@@ -0,0 +1,281 @@
+/*
+ * Copyright (c) 2012, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Synthetic load for sizing deployments. Runs a number of servers with
+// a configurable number of markers each and moves them at a fixed rate
+// while a tf frame is published in bursts. Periodically reports the
+// achieved publish rate and the CPU time spent per marker.
+//
+// Parameters (private namespace):
+//   ~num_servers      number of server instances (1)
+//   ~num_markers      markers per server (100)
+//   ~six_dof          add 6-DOF move/rotate controls (true)
+//   ~menu             attach a context menu (false)
+//   ~mesh_triangles   triangles in a TRIANGLE_LIST marker per interactive marker (0)
+//   ~update_rate      pose update rate in Hz (10)
+//   ~moving_fraction  fraction of markers moved on each update (1.0)
+//   ~churn_rate       markers re-inserted per second and server (0)
+//   ~tf_rate          rate of the tf frame the markers live in (10)
+//   ~tf_burst         seconds during which the frame is published (1)
+//   ~tf_gap           seconds during which it is not (0)
+//   ~report_period    seconds between reports (5)
+
+#include <ros/ros.h>
+
+#include <tf/transform_broadcaster.h>
+#include <tf/tf.h>
+
+#include <interactive_markers/interactive_marker_server.h>
+#include <interactive_markers/menu_handler.h>
+
+#include <boost/lexical_cast.hpp>
+
+#include "benchmark_tools.h"
+
+#include <math.h>
+
+using namespace visualization_msgs;
+using namespace interactive_markers;
+
+typedef boost::shared_ptr<InteractiveMarkerServer> InteractiveMarkerServerPtr;
+
+std::vector<InteractiveMarkerServerPtr> servers;
+MenuHandler menu_handler;
+
+int num_markers;
+bool six_dof;
+bool menu;
+int mesh_triangles;
+double update_rate;
+double moving_fraction;
+double churn_rate;
+double tf_burst;
+double tf_gap;
+
+// fractional number of markers to re-insert on the next update
+double churn_credit = 0;
+unsigned churn_index = 0;
+
+ros::WallTime report_time;
+double report_cpu_time;
+std::vector<uint64_t> report_updates;
+std::vector<uint64_t> report_poses;
+std::vector<uint64_t> report_bytes;
+
+void processFeedback( const InteractiveMarkerFeedbackConstPtr& )
+{
+}
+
+geometry_msgs::Pose getPose( unsigned index, double t )
+{
+  unsigned columns = ceil( sqrt( (double)num_markers ) );
+  return getGridPose( index, columns, t );
+}
+
+void insertMarker( InteractiveMarkerServer &server, unsigned index )
+{
+  InteractiveMarker int_marker;
+  int_marker.header.frame_id = "/load_frame";
+  int_marker.name = getMarkerName( index );
+  int_marker.description = int_marker.name;
+  int_marker.scale = 0.5;
+  int_marker.pose = getPose( index, ros::Time::now().toSec() );
+
+  InteractiveMarkerControl control;
+  control.always_visible = true;
+  control.interaction_mode = menu ? (uint8_t)InteractiveMarkerControl::MENU : (uint8_t)InteractiveMarkerControl::BUTTON;
+
+  control.markers.push_back( makeBox( int_marker.scale ) );
+
+  if ( mesh_triangles > 0 )
+  {
+    control.markers.push_back( makeTriangleFan( int_marker.scale, mesh_triangles ) );
+  }
+  int_marker.controls.push_back( control );
+
+  if ( six_dof )
+  {
+    add6DofControls( int_marker );
+  }
+
+  server.insert( int_marker, &processFeedback );
+
+  if ( menu )
+  {
+    menu_handler.apply( server, int_marker.name );
+  }
+}
+
+void updateCallback( const ros::TimerEvent& )
+{
+  ros::Time now = ros::Time::now();
+
+  std_msgs::Header header;
+  header.frame_id = "/load_frame";
+  header.stamp = now;
+
+  unsigned num_moving = num_markers * moving_fraction + 0.5;
+
+  // re-inserting a marker makes the server send it in full
+  churn_credit += churn_rate / update_rate;
+  unsigned num_churn = churn_credit;
+  churn_credit -= num_churn;
+
+  for ( unsigned s=0; s<servers.size(); s++ )
+  {
+    for ( unsigned i=0; i<num_moving; i++ )
+    {
+      servers[s]->setPose( getMarkerName(i), getPose( i, now.toSec() ), header );
+    }
+    for ( unsigned i=0; i<num_churn; i++ )
+    {
+      insertMarker( *servers[s], ( churn_index + i ) % num_markers );
+    }
+    servers[s]->applyChanges();
+  }
+
+  churn_index = ( churn_index + num_churn ) % num_markers;
+}
+
+void frameCallback( const ros::TimerEvent& )
+{
+  static tf::TransformBroadcaster br;
+
+  ros::Time time = ros::Time::now();
+
+  if ( tf_gap > 0 && fmod( time.toSec(), tf_burst + tf_gap ) >= tf_burst )
+  {
+    return;
+  }
+
+  tf::Transform t;
+  t.setOrigin( tf::Vector3( 0.0, 0.0, 1.0 ) );
+  t.setRotation( tf::Quaternion( 0.0, 0.0, 0.0, 1.0 ) );
+  br.sendTransform( tf::StampedTransform( t, time, "base_link", "load_frame" ) );
+}
+
+void reportCallback( const ros::WallTimerEvent& )
+{
+  ros::WallTime now = ros::WallTime::now();
+  double cpu_time = getCpuTime();
+  double elapsed = ( now - report_time ).toSec();
+
+  uint64_t updates = 0;
+  uint64_t poses = 0;
+  uint64_t bytes = 0;
+  for ( unsigned s=0; s<servers.size(); s++ )
+  {
+    ServerMetrics metrics = servers[s]->getMetrics();
+    updates += metrics.updates - report_updates[s];
+    poses += metrics.poses - report_poses[s];
+    bytes += metrics.update_bytes - report_bytes[s];
+    report_updates[s] = metrics.updates;
+    report_poses[s] = metrics.poses;
+    report_bytes[s] = metrics.update_bytes;
+  }
+
+  unsigned total_markers = servers.size() * num_markers;
+  double cpu_load = ( cpu_time - report_cpu_time ) / elapsed;
+
+  ROS_INFO( "%u markers on %u servers: %.1f updates/s, %.0f poses/s, %.3f MB/s, "
+      "cpu %.1f%% (%.3f ms/s per marker)",
+      total_markers, (unsigned)servers.size(),
+      updates / elapsed, poses / elapsed, bytes / elapsed / 1e6,
+      cpu_load * 100, total_markers > 0 ? cpu_load * 1e3 / total_markers : 0.0 );
+
+  report_time = now;
+  report_cpu_time = cpu_time;
+}
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "load_generator");
+  ros::NodeHandle n;
+  ros::NodeHandle pn("~");
+
+  int num_servers;
+  double tf_rate;
+  double report_period;
+
+  pn.param( "num_servers", num_servers, 1 );
+  pn.param( "num_markers", num_markers, 100 );
+  pn.param( "six_dof", six_dof, true );
+  pn.param( "menu", menu, false );
+  pn.param( "mesh_triangles", mesh_triangles, 0 );
+  pn.param( "update_rate", update_rate, 10.0 );
+  pn.param( "moving_fraction", moving_fraction, 1.0 );
+  pn.param( "churn_rate", churn_rate, 0.0 );
+  pn.param( "tf_rate", tf_rate, 10.0 );
+  pn.param( "tf_burst", tf_burst, 1.0 );
+  pn.param( "tf_gap", tf_gap, 0.0 );
+  pn.param( "report_period", report_period, 5.0 );
+
+  if ( num_markers <= 0 || update_rate <= 0 || tf_rate <= 0 || report_period <= 0 )
+  {
+    ROS_ERROR( "num_markers, update_rate, tf_rate and report_period must be positive." );
+    return 1;
+  }
+
+  if ( menu )
+  {
+    menu_handler.insert( "First Entry", &processFeedback );
+    menu_handler.insert( "Second Entry", &processFeedback );
+    MenuHandler::EntryHandle sub_menu = menu_handler.insert( "Submenu" );
+    menu_handler.insert( sub_menu, "First Entry", &processFeedback );
+    menu_handler.insert( sub_menu, "Second Entry", &processFeedback );
+  }
+
+  for ( int s=0; s<num_servers; s++ )
+  {
+    std::string topic_ns = "load_generator/server_" + boost::lexical_cast<std::string>( s );
+    InteractiveMarkerServerPtr server( new InteractiveMarkerServer( topic_ns, "", false ) );
+    // needed for the byte rate in the report
+    server->setDetailedMetrics( true );
+    for ( int i=0; i<num_markers; i++ )
+    {
+      insertMarker( *server, i );
+    }
+    server->applyChanges();
+    servers.push_back( server );
+  }
+
+  report_updates.resize( servers.size(), 0 );
+  report_poses.resize( servers.size(), 0 );
+  report_bytes.resize( servers.size(), 0 );
+  report_time = ros::WallTime::now();
+  report_cpu_time = getCpuTime();
+
+  ros::Timer update_timer = n.createTimer( ros::Duration( 1.0 / update_rate ), updateCallback );
+  ros::Timer frame_timer = n.createTimer( ros::Duration( 1.0 / tf_rate ), frameCallback );
+  ros::WallTimer report_timer = n.createWallTimer( ros::WallDuration( report_period ), reportCallback );
+
+  ros::spin();
+
+  servers.clear();
+}
@@ -0,0 +1,848 @@
+/*
+ * Copyright (c) 2012, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// End-to-end scale benchmark. Runs real servers and clients over ROS
+// topics for every combination of the configured dimensions and scenes
+// and writes one JSON record per run, containing
+// - the time from starting the servers until every client has received
+//   the init message of every server
+// - CPU load and resident memory of the server and of the client process
+//   while all markers are moving
+// - bytes sent by the servers and received by the clients per second
+//
+// For each run, the servers and the clients are started in two new
+// processes (this executable with --server or --client), so messages are
+// serialized and sent through TCPROS, and memory does not depend on
+// earlier runs. The processes are controlled through their stdin and
+// report through their stdout.
+//
+// Parameters (private namespace), lists are comma-separated:
+//   ~servers          number of servers ("1")
+//   ~markers          total number of markers, split across servers ("10")
+//   ~clients          number of clients ("1")
+//   ~update_rates     pose update rates in Hz ("10")
+//   ~scenes           any of 6dof, buttons, mesh, menu ("6dof,buttons,mesh,menu")
+//   ~steady_duration  seconds to measure steady state for (2)
+//   ~init_timeout     seconds to wait for the clients to initialize (30)
+//   ~output           file to write the results to, stdout if empty ("")
+
+#include <ros/ros.h>
+
+#include <gtest/gtest.h>
+
+#include <tf/tf.h>
+
+#include <interactive_markers/interactive_marker_server.h>
+#include <interactive_markers/interactive_marker_client.h>
+#include <interactive_markers/menu_handler.h>
+#include <interactive_markers/metrics.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/bind.hpp>
+
+#include "benchmark_tools.h"
+
+#include <set>
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace visualization_msgs;
+using namespace interactive_markers;
+
+typedef boost::shared_ptr<InteractiveMarkerServer> InteractiveMarkerServerPtr;
+typedef boost::shared_ptr<InteractiveMarkerClient> InteractiveMarkerClientPtr;
+
+// number of triangles in each marker of the mesh scene
+const int MESH_TRIANGLES = 1000;
+
+struct RunConfig
+{
+  int servers;
+  int markers;
+  int clients;
+  double update_rate;
+  std::string scene;
+};
+
+struct RunResult
+{
+  RunResult()
+  : initialized(false)
+  , measured(false)
+  , time_to_init(0)
+  , server_cpu_load(0)
+  , server_memory_bytes(0)
+  , server_bytes_per_s(0)
+  , client_cpu_load(0)
+  , client_memory_bytes(0)
+  , client_bytes_per_s(0)
+  , client_msgs_per_s(0)
+  , client_resets(0)
+  {}
+
+  bool initialized;
+  bool measured;
+  double time_to_init;
+  double server_cpu_load;
+  unsigned long server_memory_bytes;
+  double server_bytes_per_s;
+  double client_cpu_load;
+  unsigned long client_memory_bytes;
+  double client_bytes_per_s;
+  double client_msgs_per_s;
+  unsigned long client_resets;
+};
+
+void emptyFeedback( const InteractiveMarkerFeedbackConstPtr& )
+{
+}
+
+template<class T>
+std::vector<T> getList( ros::NodeHandle& nh, const std::string& name, const std::string& default_value )
+{
+  std::string value;
+  nh.param( name, value, default_value );
+
+  std::vector<std::string> tokens;
+  boost::split( tokens, value, boost::is_any_of( ", " ), boost::token_compress_on );
+
+  std::vector<T> list;
+  for ( size_t i=0; i<tokens.size(); i++ )
+  {
+    if ( !tokens[i].empty() )
+    {
+      list.push_back( boost::lexical_cast<T>( tokens[i] ) );
+    }
+  }
+  return list;
+}
+
+geometry_msgs::Pose getPose( unsigned index, double t )
+{
+  return getGridPose( index, 100, t );
+}
+
+// Build one marker of the given canonical scene
+InteractiveMarker makeMarker( const std::string &scene, unsigned index )
+{
+  InteractiveMarker int_marker;
+  int_marker.header.frame_id = "/base_link";
+  int_marker.name = getMarkerName( index );
+  int_marker.description = int_marker.name;
+  int_marker.scale = 0.5;
+  int_marker.pose = getPose( index, 0 );
+
+  InteractiveMarkerControl control;
+  control.always_visible = true;
+
+  if ( scene == "6dof" )
+  {
+    control.markers.push_back( makeBox( int_marker.scale ) );
+    int_marker.controls.push_back( control );
+    add6DofControls( int_marker );
+  }
+  else if ( scene == "buttons" )
+  {
+    control.interaction_mode = InteractiveMarkerControl::BUTTON;
+    control.markers.push_back( makeBox( int_marker.scale ) );
+    int_marker.controls.push_back( control );
+  }
+  else if ( scene == "mesh" )
+  {
+    control.interaction_mode = InteractiveMarkerControl::BUTTON;
+    control.markers.push_back( makeTriangleFan( int_marker.scale, MESH_TRIANGLES ) );
+    int_marker.controls.push_back( control );
+  }
+  else if ( scene == "menu" )
+  {
+    control.interaction_mode = InteractiveMarkerControl::MENU;
+    control.markers.push_back( makeBox( int_marker.scale ) );
+    int_marker.controls.push_back( control );
+  }
+  return int_marker;
+}
+
+void makeMenu( MenuHandler &menu_handler )
+{
+  for ( int i=0; i<5; i++ )
+  {
+    std::string title = "Entry " + boost::lexical_cast<std::string>( i );
+    MenuHandler::EntryHandle entry = menu_handler.insert( title, &emptyFeedback );
+    for ( int j=0; j<5; j++ )
+    {
+      menu_handler.insert( entry, title + "." + boost::lexical_cast<std::string>( j ), &emptyFeedback );
+    }
+  }
+}
+
+// Reads lines from a pipe, waiting at most the given time for each one
+class LineReader
+{
+public:
+  LineReader( int fd = -1 )
+  : fd_(fd)
+  , eof_(false)
+  {
+  }
+
+  bool readLine( std::string& line, double timeout )
+  {
+    ros::WallTime end_time = ros::WallTime::now() + ros::WallDuration( timeout );
+    while ( true )
+    {
+      size_t newline = buffer_.find( '\n' );
+      if ( newline != std::string::npos )
+      {
+        line = buffer_.substr( 0, newline );
+        buffer_.erase( 0, newline + 1 );
+        return true;
+      }
+      if ( eof_ )
+      {
+        return false;
+      }
+
+      double remaining = ( end_time - ros::WallTime::now() ).toSec();
+      struct pollfd poll_fd;
+      poll_fd.fd = fd_;
+      poll_fd.events = POLLIN;
+      poll_fd.revents = 0;
+      int ready = poll( &poll_fd, 1, remaining > 0 ? (int)( remaining * 1000 ) : 0 );
+      if ( ready < 0 && errno == EINTR )
+      {
+        continue;
+      }
+      if ( ready <= 0 )
+      {
+        return false;
+      }
+
+      char buffer[256];
+      ssize_t length = read( fd_, buffer, sizeof(buffer) );
+      if ( length < 0 && errno == EINTR )
+      {
+        continue;
+      }
+      if ( length <= 0 )
+      {
+        eof_ = true;
+        continue;
+      }
+      buffer_.append( buffer, length );
+    }
+  }
+
+  bool isEof() const { return eof_ && buffer_.find( '\n' ) == std::string::npos; }
+
+private:
+  int fd_;
+  bool eof_;
+  std::string buffer_;
+};
+
+// Runs all servers of one benchmark run. Moves the markers until
+// stdin is closed and measures while told to by the benchmark.
+class ServerProcess
+{
+public:
+  ServerProcess( const RunConfig& config, const std::string& topic_ns )
+  : config_( config )
+  , topic_ns_( topic_ns )
+  {
+    if ( config_.scene == "menu" )
+    {
+      makeMenu( menu_handler_ );
+    }
+  }
+
+  void run()
+  {
+    createServers();
+
+    LineReader commands( STDIN_FILENO );
+    std::string command;
+    ros::WallDuration period( 1.0 / config_.update_rate );
+    ros::WallTime next_update = ros::WallTime::now();
+
+    double cpu_start = 0;
+    uint64_t bytes_start = 0;
+    ros::WallTime measure_start = ros::WallTime::now();
+
+    while ( ros::ok() && !commands.isEof() )
+    {
+      if ( ros::WallTime::now() >= next_update )
+      {
+        moveMarkers();
+        next_update += period;
+      }
+
+      // also waits for the next iteration
+      if ( !commands.readLine( command, 0.001 ) )
+      {
+        continue;
+      }
+      if ( command == "measure" )
+      {
+        cpu_start = getCpuTime();
+        bytes_start = getServerBytes();
+        measure_start = ros::WallTime::now();
+      }
+      else if ( command == "stop" )
+      {
+        double elapsed = ( ros::WallTime::now() - measure_start ).toSec();
+        printf( "result %.6f %lu %.3f\n", ( getCpuTime() - cpu_start ) / elapsed,
+            (unsigned long)getResidentMemory(), ( getServerBytes() - bytes_start ) / elapsed );
+        fflush( stdout );
+        break;
+      }
+    }
+
+    servers_.clear();
+  }
+
+private:
+  void createServers()
+  {
+    for ( int s=0; s<config_.servers; s++ )
+    {
+      std::string server_id = "server_" + boost::lexical_cast<std::string>( s );
+      InteractiveMarkerServerPtr server( new InteractiveMarkerServer( topic_ns_, server_id, true ) );
+      server->setDetailedMetrics( true );
+      // markers s, s + servers, ...
+      for ( int i=s; i<config_.markers; i+=config_.servers )
+      {
+        server->insert( makeMarker( config_.scene, i ), &emptyFeedback );
+        if ( config_.scene == "menu" )
+        {
+          menu_handler_.apply( *server, getMarkerName( i ) );
+        }
+      }
+      server->applyChanges();
+      servers_.push_back( server );
+    }
+  }
+
+  void moveMarkers()
+  {
+    std_msgs::Header header;
+    header.frame_id = "/base_link";
+    double t = ros::WallTime::now().toSec();
+
+    for ( int s=0; s<config_.servers; s++ )
+    {
+      for ( int i=s; i<config_.markers; i+=config_.servers )
+      {
+        servers_[s]->setPose( getMarkerName( i ), getPose( i, t ), header );
+      }
+      servers_[s]->applyChanges();
+    }
+  }
+
+  uint64_t getServerBytes()
+  {
+    uint64_t bytes = 0;
+    for ( size_t s=0; s<servers_.size(); s++ )
+    {
+      bytes += servers_[s]->getMetrics().update_bytes;
+    }
+    return bytes;
+  }
+
+  RunConfig config_;
+  std::string topic_ns_;
+  MenuHandler menu_handler_;
+  std::vector<InteractiveMarkerServerPtr> servers_;
+};
+
+// Runs all clients of one benchmark run. Reports when all of them are
+// initialized and measures while told to by the benchmark.
+class ClientProcess
+{
+public:
+  ClientProcess( const RunConfig& config, const std::string& topic_ns )
+  : config_( config )
+  {
+    for ( int c=0; c<config_.clients; c++ )
+    {
+      InteractiveMarkerClientPtr client( new InteractiveMarkerClient( tf_, "/base_link", topic_ns ) );
+      client->setInitCb( boost::bind( &ClientProcess::initCb, this, c, _1 ) );
+      client->setDetailedMetrics( true );
+      clients_.push_back( client );
+    }
+    initialized_servers_.resize( config_.clients );
+  }
+
+  void run()
+  {
+    printf( "ready\n" );
+    fflush( stdout );
+
+    LineReader commands( STDIN_FILENO );
+    std::string command;
+    bool initialized = false;
+
+    double cpu_start = 0;
+    ClientTotals totals_start;
+    ros::WallTime measure_start = ros::WallTime::now();
+
+    while ( ros::ok() && !commands.isEof() )
+    {
+      ros::spinOnce();
+      for ( size_t c=0; c<clients_.size(); c++ )
+      {
+        clients_[c]->update();
+      }
+
+      if ( !initialized && isInitialized() )
+      {
+        initialized = true;
+        printf( "initialized\n" );
+        fflush( stdout );
+      }
+
+      // also waits for the next iteration
+      if ( !commands.readLine( command, 0.001 ) )
+      {
+        continue;
+      }
+      if ( command == "measure" )
+      {
+        cpu_start = getCpuTime();
+        totals_start = getClientTotals();
+        measure_start = ros::WallTime::now();
+      }
+      else if ( command == "stop" )
+      {
+        double elapsed = ( ros::WallTime::now() - measure_start ).toSec();
+        ClientTotals totals = getClientTotals();
+        printf( "result %.6f %lu %.3f %.3f %lu\n", ( getCpuTime() - cpu_start ) / elapsed,
+            (unsigned long)getResidentMemory(),
+            ( totals.bytes - totals_start.bytes ) / elapsed,
+            ( totals.messages - totals_start.messages ) / elapsed,
+            (unsigned long)totals.resets );
+        fflush( stdout );
+        break;
+      }
+    }
+
+    clients_.clear();
+  }
+
+private:
+  struct ClientTotals
+  {
+    ClientTotals() : messages(0), bytes(0), resets(0) {}
+    uint64_t messages;
+    uint64_t bytes;
+    uint64_t resets;
+  };
+
+  void initCb( int client_index, const InteractiveMarkerClient::InitConstPtr& msg )
+  {
+    initialized_servers_[client_index].insert( msg->server_id );
+  }
+
+  bool isInitialized()
+  {
+    for ( size_t c=0; c<initialized_servers_.size(); c++ )
+    {
+      if ( initialized_servers_[c].size() < (size_t)config_.servers )
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  ClientTotals getClientTotals()
+  {
+    ClientTotals totals;
+    for ( size_t c=0; c<clients_.size(); c++ )
+    {
+      InteractiveMarkerClient::M_ClientMetrics metrics;
+      clients_[c]->getMetrics( metrics );
+      for ( InteractiveMarkerClient::M_ClientMetrics::iterator it = metrics.begin(); it != metrics.end(); ++it )
+      {
+        totals.messages += it->second.messages.count;
+        totals.bytes += it->second.bytes.count;
+        for ( unsigned i=0; i<ClientMetrics::NUM_RESET_CAUSES; i++ )
+        {
+          totals.resets += it->second.resets[i];
+        }
+      }
+    }
+    return totals;
+  }
+
+  RunConfig config_;
+  tf::Transformer tf_;
+  std::vector<InteractiveMarkerClientPtr> clients_;
+  std::vector< std::set<std::string> > initialized_servers_;
+};
+
+// This executable, started as a server or client process
+class ChildProcess
+{
+public:
+  ChildProcess()
+  : pid_(-1)
+  , stdin_fd_(-1)
+  , stdout_fd_(-1)
+  {
+  }
+
+  ~ChildProcess()
+  {
+    stop();
+  }
+
+  // @param role  "server" or "client"
+  bool start( const std::string& role, const RunConfig& config, const std::string& topic_ns )
+  {
+    role_ = role;
+    std::vector<std::string> args;
+    args.push_back( "scale_benchmark" );
+    args.push_back( "--" + role );
+    args.push_back( topic_ns );
+    args.push_back( config.scene );
+    args.push_back( boost::lexical_cast<std::string>( config.servers ) );
+    args.push_back( boost::lexical_cast<std::string>( config.markers ) );
+    args.push_back( boost::lexical_cast<std::string>( config.clients ) );
+    args.push_back( boost::lexical_cast<std::string>( config.update_rate ) );
+
+    // only async-signal-safe calls are allowed after fork()
+    std::vector<char*> argv;
+    for ( size_t i=0; i<args.size(); i++ )
+    {
+      argv.push_back( const_cast<char*>( args[i].c_str() ) );
+    }
+    argv.push_back( 0 );
+
+    int in_pipe[2], out_pipe[2];
+    if ( pipe( in_pipe ) != 0 )
+    {
+      return false;
+    }
+    if ( pipe( out_pipe ) != 0 )
+    {
+      close( in_pipe[0] );
+      close( in_pipe[1] );
+      return false;
+    }
+
+    pid_ = fork();
+    if ( pid_ == 0 )
+    {
+      dup2( in_pipe[0], STDIN_FILENO );
+      dup2( out_pipe[1], STDOUT_FILENO );
+      close( in_pipe[0] );
+      close( in_pipe[1] );
+      close( out_pipe[0] );
+      close( out_pipe[1] );
+      execv( "/proc/self/exe", &argv[0] );
+      _exit( 127 );
+    }
+
+    close( in_pipe[0] );
+    close( out_pipe[1] );
+    if ( pid_ < 0 )
+    {
+      close( in_pipe[1] );
+      close( out_pipe[0] );
+      return false;
+    }
+    stdin_fd_ = in_pipe[1];
+    stdout_fd_ = out_pipe[0];
+    reader_ = LineReader( stdout_fd_ );
+    return true;
+  }
+
+  void send( const std::string& command )
+  {
+    std::string line = command + "\n";
+    if ( stdin_fd_ < 0 || write( stdin_fd_, line.c_str(), line.size() ) != (ssize_t)line.size() )
+    {
+      ROS_ERROR( "Cannot send '%s' to the %s process.", command.c_str(), role_.c_str() );
+    }
+  }
+
+  // Wait for a line starting with the given word and return the rest of it.
+  // Other output of the process is passed on to stderr.
+  bool waitFor( const std::string& word, std::string& rest, double timeout )
+  {
+    ros::WallTime end_time = ros::WallTime::now() + ros::WallDuration( timeout );
+    std::string line;
+    while ( reader_.readLine( line, ( end_time - ros::WallTime::now() ).toSec() ) )
+    {
+      if ( line.compare( 0, word.size(), word ) == 0 )
+      {
+        rest = line.substr( word.size() );
+        return true;
+      }
+      fprintf( stderr, "%s\n", line.c_str() );
+    }
+    return false;
+  }
+
+  // Close stdin, which makes the process exit, and kill it if it does not.
+  void stop()
+  {
+    if ( stdin_fd_ >= 0 )
+    {
+      close( stdin_fd_ );
+      stdin_fd_ = -1;
+    }
+    if ( pid_ > 0 )
+    {
+      int status;
+      ros::WallTime end_time = ros::WallTime::now() + ros::WallDuration( 5.0 );
+      while ( waitpid( pid_, &status, WNOHANG ) == 0 )
+      {
+        if ( ros::WallTime::now() > end_time )
+        {
+          kill( pid_, SIGKILL );
+          waitpid( pid_, &status, 0 );
+          break;
+        }
+        ros::WallDuration( 0.01 ).sleep();
+      }
+      pid_ = -1;
+    }
+    if ( stdout_fd_ >= 0 )
+    {
+      close( stdout_fd_ );
+      stdout_fd_ = -1;
+    }
+  }
+
+private:
+  pid_t pid_;
+  int stdin_fd_;
+  int stdout_fd_;
+  std::string role_;
+  LineReader reader_;
+};
+
+RunResult runScale( const RunConfig& config, unsigned run_index, double steady_duration, double init_timeout )
+{
+  RunResult result;
+  std::string topic_ns = "scale_benchmark/run_" + boost::lexical_cast<std::string>( run_index );
+  std::string rest;
+
+  ChildProcess client;
+  if ( !client.start( "client", config, topic_ns ) || !client.waitFor( "ready", rest, init_timeout ) )
+  {
+    ROS_ERROR( "Cannot start the client process." );
+    return result;
+  }
+
+  // the time to init includes starting the server process,
+  // building and publishing all markers
+  ChildProcess server;
+  ros::WallTime start_time = ros::WallTime::now();
+  if ( !server.start( "server", config, topic_ns ) )
+  {
+    ROS_ERROR( "Cannot start the server process." );
+    return result;
+  }
+
+  result.initialized = client.waitFor( "initialized", rest, init_timeout );
+  result.time_to_init = ( ros::WallTime::now() - start_time ).toSec();
+  if ( !result.initialized )
+  {
+    return result;
+  }
+
+  // settle, then measure steady state while all markers are moving
+  ros::WallDuration( 0.5 ).sleep();
+  server.send( "measure" );
+  client.send( "measure" );
+  ros::WallDuration( steady_duration ).sleep();
+  server.send( "stop" );
+  client.send( "stop" );
+
+  std::string server_result, client_result;
+  result.measured =
+      server.waitFor( "result", server_result, 10.0 ) &&
+      client.waitFor( "result", client_result, 10.0 ) &&
+      sscanf( server_result.c_str(), "%lf %lu %lf",
+          &result.server_cpu_load, &result.server_memory_bytes, &result.server_bytes_per_s ) == 3 &&
+      sscanf( client_result.c_str(), "%lf %lu %lf %lf %lu",
+          &result.client_cpu_load, &result.client_memory_bytes, &result.client_bytes_per_s,
+          &result.client_msgs_per_s, &result.client_resets ) == 5;
+  return result;
+}
+
+void printResult( FILE* out, const RunConfig& config, const RunResult& result, bool first )
+{
+  fprintf( out, "%s  {\n", first ? "" : ",\n" );
+  fprintf( out, "    \"scene\": \"%s\",\n", config.scene.c_str() );
+  fprintf( out, "    \"servers\": %d,\n", config.servers );
+  fprintf( out, "    \"markers\": %d,\n", config.markers );
+  fprintf( out, "    \"clients\": %d,\n", config.clients );
+  fprintf( out, "    \"update_rate\": %.3f,\n", config.update_rate );
+  fprintf( out, "    \"initialized\": %s,\n", result.initialized ? "true" : "false" );
+  fprintf( out, "    \"time_to_init_s\": %.6f,\n", result.time_to_init );
+  fprintf( out, "    \"server_cpu_load\": %.4f,\n", result.server_cpu_load );
+  fprintf( out, "    \"server_memory_bytes\": %lu,\n", result.server_memory_bytes );
+  fprintf( out, "    \"server_bytes_per_s\": %.1f,\n", result.server_bytes_per_s );
+  fprintf( out, "    \"client_cpu_load\": %.4f,\n", result.client_cpu_load );
+  fprintf( out, "    \"client_memory_bytes\": %lu,\n", result.client_memory_bytes );
+  fprintf( out, "    \"client_bytes_per_s\": %.1f,\n", result.client_bytes_per_s );
+  fprintf( out, "    \"client_msgs_per_s\": %.1f,\n", result.client_msgs_per_s );
+  fprintf( out, "    \"client_resets\": %lu\n", result.client_resets );
+  fprintf( out, "  }" );
+  fflush( out );
+}
+
+TEST(ScaleBenchmark, matrix)
+{
+  ros::NodeHandle pn("~");
+
+  std::vector<int> servers = getList<int>( pn, "servers", "1" );
+  std::vector<int> markers = getList<int>( pn, "markers", "10" );
+  std::vector<int> clients = getList<int>( pn, "clients", "1" );
+  std::vector<double> update_rates = getList<double>( pn, "update_rates", "10" );
+  std::vector<std::string> scenes = getList<std::string>( pn, "scenes", "6dof,buttons,mesh,menu" );
+
+  double steady_duration;
+  double init_timeout;
+  std::string output;
+  pn.param( "steady_duration", steady_duration, 2.0 );
+  pn.param( "init_timeout", init_timeout, 30.0 );
+  pn.param( "output", output, std::string() );
+
+  FILE* out = stdout;
+  if ( !output.empty() )
+  {
+    out = fopen( output.c_str(), "w" );
+    ASSERT_TRUE( out != NULL );
+  }
+
+  fprintf( out, "[\n" );
+
+  unsigned run_index = 0;
+  for ( size_t sc=0; sc<scenes.size(); sc++ )
+  {
+    ASSERT_TRUE( scenes[sc] == "6dof" || scenes[sc] == "buttons" ||
+        scenes[sc] == "mesh" || scenes[sc] == "menu" );
+
+    for ( size_t s=0; s<servers.size(); s++ )
+    for ( size_t m=0; m<markers.size(); m++ )
+    for ( size_t c=0; c<clients.size(); c++ )
+    for ( size_t r=0; r<update_rates.size(); r++ )
+    {
+      RunConfig config;
+      config.scene = scenes[sc];
+      config.servers = servers[s];
+      config.markers = markers[m];
+      config.clients = clients[c];
+      config.update_rate = update_rates[r];
+
+      RunResult result = runScale( config, run_index, steady_duration, init_timeout );
+      printResult( out, config, result, run_index == 0 );
+      run_index++;
+
+      if ( !result.initialized )
+      {
+        ROS_ERROR( "%s: %d servers, %d markers, %d clients did not initialize.",
+            config.scene.c_str(), config.servers, config.markers, config.clients );
+      }
+      else if ( !result.measured )
+      {
+        ROS_ERROR( "%s: %d servers, %d markers, %d clients did not report results.",
+            config.scene.c_str(), config.servers, config.markers, config.clients );
+      }
+      EXPECT_TRUE( result.initialized );
+      EXPECT_TRUE( result.measured );
+    }
+  }
+
+  fprintf( out, "\n]\n" );
+  if ( out != stdout )
+  {
+    fclose( out );
+  }
+}
+
+// usage: scale_benchmark --server|--client topic_ns scene servers markers clients update_rate
+int runChild( int argc, char **argv )
+{
+  std::string role = argv[1];
+  if ( argc < 8 )
+  {
+    fprintf( stderr, "usage: scale_benchmark %s topic_ns scene servers markers clients update_rate\n", role.c_str() );
+    return 1;
+  }
+
+  std::string topic_ns = argv[2];
+  RunConfig config;
+  config.scene = argv[3];
+  config.servers = atoi( argv[4] );
+  config.markers = atoi( argv[5] );
+  config.clients = atoi( argv[6] );
+  config.update_rate = atof( argv[7] );
+
+  ros::init( argc, argv, "scale_benchmark_" + role.substr( 2 ), ros::init_options::AnonymousName );
+  ros::NodeHandle nh;
+
+  if ( role == "--server" )
+  {
+    ServerProcess server( config, topic_ns );
+    server.run();
+  }
+  else
+  {
+    ClientProcess client( config, topic_ns );
+    client.run();
+  }
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  if ( argc > 1 && ( std::string( argv[1] ) == "--server" || std::string( argv[1] ) == "--client" ) )
+  {
+    return runChild( argc, argv );
+  }
+
+  // the processes of a run may exit before we stop them
+  signal( SIGPIPE, SIG_IGN );
+
+  ros::init(argc, argv, "scale_benchmark");
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -37,6 +37,8 @@
 
 #include <interactive_markers/interactive_marker_server.h>
 #include <interactive_markers/interactive_marker_client.h>
+#include <interactive_markers/loopback_transport.h>
+#include <interactive_markers/shm_transport.h>
 
 #define DBG_MSG( ... ) printf( __VA_ARGS__ ); printf("\n");
 #define DBG_MSG_STREAM( ... )  std::cout << __VA_ARGS__ << std::endl;
@@ -241,6 +243,271 @@ TEST(InteractiveMarkerServerAndClient, connect_tf_error)
 }
 
 
+int feedback_calls;
+
+void feedbackCb( const visualization_msgs::InteractiveMarkerFeedbackConstPtr& )
+{
+  feedback_calls++;
+}
+
+void transportFeedbackCb( const visualization_msgs::InteractiveMarkerFeedbackConstPtr&, const ros::WallTime& )
+{
+}
+
+TEST(InteractiveMarkerServerAndClient, loopback)
+{
+  tf::Transformer tf;
+  LoopbackTransport transport;
+
+  boost::scoped_ptr<InteractiveMarkerServer> server(
+      new InteractiveMarkerServer( "im_loopback_test", transport.createServerTransport(), "test_server" ) );
+
+  resetReceivedMsgs();
+
+  InteractiveMarkerClient client( tf, transport.createClientTransport(), "valid_frame", "im_loopback_test" );
+  client.setInitCb( &initCb );
+  client.setStatusCb( &statusCb );
+  client.setResetCb( &resetCb );
+  client.setUpdateCb( &updateCb );
+
+  visualization_msgs::InteractiveMarker int_marker;
+  int_marker.name = "marker1";
+  int_marker.header.frame_id = "valid_frame";
+  server->insert( int_marker, &feedbackCb );
+  server->applyChanges();
+
+  // nothing is delivered before spinning
+  client.update();
+  ASSERT_EQ( 0, init_calls );
+
+  // latched init #0, update #1 and init #1
+  ASSERT_EQ( 3u, transport.spinOnce() );
+  client.update();
+
+  ASSERT_EQ( 1, init_calls );
+  ASSERT_EQ( 0, update_calls );
+  ASSERT_TRUE( init_msg );
+  ASSERT_EQ( 1u, init_msg->markers.size() );
+  ASSERT_EQ( "marker1", init_msg->markers[0].name );
+
+  // feedback from a GUI moves the marker
+  resetReceivedMsgs();
+  feedback_calls = 0;
+
+  visualization_msgs::InteractiveMarkerFeedbackPtr feedback( new visualization_msgs::InteractiveMarkerFeedback() );
+  feedback->client_id = "gui";
+  feedback->marker_name = "marker1";
+  feedback->event_type = visualization_msgs::InteractiveMarkerFeedback::POSE_UPDATE;
+  feedback->pose.orientation.w = 1;
+  feedback->pose.position.x = 1;
+  transport.publishFeedback( "im_loopback_test", feedback );
+  transport.publishFeedback( "other_ns", feedback );
+  ASSERT_EQ( 1u, transport.spinOnce() );
+  ASSERT_EQ( 1, feedback_calls );
+
+  server->applyChanges();
+  transport.spinOnce();
+  client.update();
+
+  ASSERT_EQ( 1, update_calls );
+  ASSERT_TRUE( update_msg );
+  ASSERT_EQ( 1u, update_msg->poses.size() );
+  ASSERT_EQ( 1.0, update_msg->poses[0].pose.position.x );
+
+  // the client notices the server going away
+  resetReceivedMsgs();
+  server.reset();
+  transport.spinOnce();
+  client.update();
+  ASSERT_EQ( 1, reset_calls );
+}
+
+TEST(InteractiveMarkerServerAndClient, shared_memory)
+{
+  tf::Transformer tf;
+
+  boost::shared_ptr<ShmServerTransport> server_transport( new ShmServerTransport() );
+  boost::scoped_ptr<InteractiveMarkerServer> server(
+      new InteractiveMarkerServer( "im_shm_test", server_transport, "test_server" ) );
+  ASSERT_TRUE( server_transport->isUsingSharedMemory() );
+
+  // only one server can own the segment
+  ShmServerTransport second_transport;
+  second_transport.advertise( "im_shm_test", &transportFeedbackCb );
+  ASSERT_FALSE( second_transport.isUsingSharedMemory() );
+  second_transport.shutdown();
+
+  resetReceivedMsgs();
+
+  boost::shared_ptr<ShmClientTransport> client_transport( new ShmClientTransport() );
+  InteractiveMarkerClient client( tf, client_transport, "valid_frame", "im_shm_test" );
+  client.setInitCb( &initCb );
+  client.setStatusCb( &statusCb );
+  client.setResetCb( &resetCb );
+  client.setUpdateCb( &updateCb );
+  ASSERT_TRUE( client_transport->isUsingSharedMemory() );
+
+  visualization_msgs::InteractiveMarker int_marker;
+  int_marker.name = "marker1";
+  int_marker.header.frame_id = "valid_frame";
+  server->insert( int_marker );
+  server->applyChanges();
+
+  for ( int i=0; i<100 && init_calls == 0; i++ )
+  {
+    waitMsg();
+    client.update();
+  }
+
+  ASSERT_EQ( 1, init_calls );
+  ASSERT_EQ( 0, reset_calls );
+  ASSERT_TRUE( init_msg );
+  ASSERT_EQ( 1u, init_msg->markers.size() );
+  ASSERT_EQ( "marker1", init_msg->markers[0].name );
+
+  int_marker.pose.position.x = 1;
+  server->setPose( "marker1", int_marker.pose );
+  server->applyChanges();
+
+  for ( int i=0; i<100 && update_calls == 0; i++ )
+  {
+    waitMsg();
+    client.update();
+  }
+
+  ASSERT_EQ( 1, update_calls );
+  ASSERT_TRUE( update_msg );
+  ASSERT_EQ( 1u, update_msg->poses.size() );
+  ASSERT_EQ( 1.0, update_msg->poses[0].pose.position.x );
+
+  // the server does not publish via ROS while all subscribers read the segment
+  ASSERT_EQ( 0u, client_transport->getNumDroppedRosMessages() );
+
+  // servers which do not own the segment are received via ROS
+  resetReceivedMsgs();
+  InteractiveMarkerServer ros_server( "im_shm_test", "ros_server" );
+  int_marker.name = "marker2";
+  ros_server.insert( int_marker );
+  ros_server.applyChanges();
+
+  for ( int i=0; i<100 && init_calls == 0; i++ )
+  {
+    waitMsg();
+    client.update();
+  }
+
+  ASSERT_EQ( 1, init_calls );
+  ASSERT_EQ( 0, reset_calls );
+  ASSERT_EQ( "marker2", init_msg->markers[0].name );
+  ASSERT_TRUE( client_transport->isUsingSharedMemory() );
+  ASSERT_EQ( 0u, client_transport->getNumDroppedRosMessages() );
+
+  // the client notices the server going away
+  server.reset();
+  for ( int i=0; i<100 && reset_calls == 0; i++ )
+  {
+    waitMsg();
+    client.update();
+  }
+  ASSERT_EQ( 1, reset_calls );
+}
+
+TEST(InteractiveMarkerServerAndClient, shared_memory_ros_client)
+{
+  tf::Transformer tf;
+
+  boost::shared_ptr<ShmServerTransport> server_transport( new ShmServerTransport() );
+  InteractiveMarkerServer server( "im_shm_ros_test", server_transport, "test_server" );
+  ASSERT_TRUE( server_transport->isUsingSharedMemory() );
+
+  visualization_msgs::InteractiveMarker int_marker;
+  int_marker.name = "marker1";
+  int_marker.header.frame_id = "valid_frame";
+  server.insert( int_marker );
+  server.applyChanges();
+
+  resetReceivedMsgs();
+
+  // the init message has not been latched, it is sent when the client connects
+  InteractiveMarkerClient client( tf, "valid_frame", "im_shm_ros_test" );
+  client.setInitCb( &initCb );
+  client.setStatusCb( &statusCb );
+  client.setResetCb( &resetCb );
+  client.setUpdateCb( &updateCb );
+
+  for ( int i=0; i<100 && init_calls == 0; i++ )
+  {
+    waitMsg();
+    client.update();
+  }
+
+  ASSERT_EQ( 1, init_calls );
+  ASSERT_EQ( 0, reset_calls );
+  ASSERT_TRUE( init_msg );
+  ASSERT_EQ( 1u, init_msg->markers.size() );
+  ASSERT_EQ( "marker1", init_msg->markers[0].name );
+
+  int_marker.pose.position.x = 1;
+  server.setPose( "marker1", int_marker.pose );
+  server.applyChanges();
+
+  for ( int i=0; i<100 && update_calls == 0; i++ )
+  {
+    waitMsg();
+    client.update();
+  }
+
+  ASSERT_EQ( 1, update_calls );
+  ASSERT_EQ( 1u, update_msg->poses.size() );
+}
+
+TEST(InteractiveMarkerServerAndClient, shared_memory_fallback)
+{
+  tf::Transformer tf;
+
+  boost::shared_ptr<ShmServerTransport> server_transport( new ShmServerTransport( ros::NodeHandle(), 4096 ) );
+  InteractiveMarkerServer server( "im_shm_fallback_test", server_transport, "test_server" );
+
+  resetReceivedMsgs();
+
+  boost::shared_ptr<ShmClientTransport> client_transport( new ShmClientTransport() );
+  InteractiveMarkerClient client( tf, client_transport, "valid_frame", "im_shm_fallback_test" );
+  client.setInitCb( &initCb );
+  client.setStatusCb( &statusCb );
+  client.setResetCb( &resetCb );
+  client.setUpdateCb( &updateCb );
+  ASSERT_TRUE( client_transport->isUsingSharedMemory() );
+
+  for ( int i=0; i<100 && init_calls == 0; i++ )
+  {
+    waitMsg();
+    client.update();
+  }
+  ASSERT_EQ( 1, init_calls );
+
+  // does not fit into half of the segment
+  visualization_msgs::InteractiveMarker int_marker;
+  int_marker.name = "marker1";
+  int_marker.header.frame_id = "valid_frame";
+  int_marker.description = std::string( 4096, 'x' );
+  server.insert( int_marker );
+  server.applyChanges();
+
+  for ( int i=0; i<100 && update_calls == 0; i++ )
+  {
+    waitMsg();
+    client.update();
+  }
+
+  ASSERT_FALSE( server_transport->isUsingSharedMemory() );
+  ASSERT_FALSE( client_transport->isUsingSharedMemory() );
+  ASSERT_EQ( 1, update_calls );
+  ASSERT_EQ( 0, reset_calls );
+  ASSERT_TRUE( update_msg );
+  ASSERT_EQ( 1u, update_msg->markers.size() );
+  ASSERT_EQ( "marker1", update_msg->markers[0].name );
+}
+
 // Run all the tests that were declared with TEST()
 int main(int argc, char **argv)
 {
@@ -33,6 +33,7 @@
 #include <gtest/gtest.h>
 
 #include <interactive_markers/interactive_marker_server.h>
+#include <interactive_markers/menu_handler.h>
 
 TEST(InteractiveMarkerServer, addRemove)
 {
@@ -84,6 +85,266 @@ TEST(InteractiveMarkerServer, addRemove)
   usleep(1000);
 }
 
+TEST(InteractiveMarkerServer, setMenuEntries)
+{
+  interactive_markers::InteractiveMarkerServer server("im_server_test");
+
+  visualization_msgs::InteractiveMarker int_marker;
+  int_marker.name = "marker1";
+  int_marker.description = "description";
+
+  std::vector<visualization_msgs::MenuEntry> menu_entries(1);
+  menu_entries[0].id = 1;
+  menu_entries[0].title = "entry";
+
+  // unknown marker
+  ASSERT_FALSE( server.setMenuEntries( "marker1", menu_entries ) );
+
+  server.insert(int_marker);
+  server.applyChanges();
+
+  // menu only
+  ASSERT_TRUE( server.setMenuEntries( "marker1", menu_entries ) );
+  ASSERT_TRUE( server.get("marker1", int_marker) );
+  ASSERT_EQ( 1u, int_marker.menu_entries.size() );
+  ASSERT_EQ( "description", int_marker.description );
+
+  server.applyChanges();
+  ASSERT_TRUE( server.get("marker1", int_marker) );
+  ASSERT_EQ( 1u, int_marker.menu_entries.size() );
+
+  // menu and pose
+  geometry_msgs::Pose pose;
+  pose.position.x = 1;
+  menu_entries.push_back( menu_entries[0] );
+  menu_entries[1].id = 2;
+  ASSERT_TRUE( server.setMenuEntries( "marker1", menu_entries ) );
+  ASSERT_TRUE( server.setPose( "marker1", pose ) );
+  ASSERT_TRUE( server.get("marker1", int_marker) );
+  ASSERT_EQ( 2u, int_marker.menu_entries.size() );
+  ASSERT_EQ( 1.0, int_marker.pose.position.x );
+
+  server.applyChanges();
+  ASSERT_TRUE( server.get("marker1", int_marker) );
+  ASSERT_EQ( 2u, int_marker.menu_entries.size() );
+  ASSERT_EQ( 1.0, int_marker.pose.position.x );
+  ASSERT_EQ( "description", int_marker.description );
+
+  // erased marker
+  server.erase( "marker1" );
+  ASSERT_FALSE( server.setMenuEntries( "marker1", menu_entries ) );
+  server.applyChanges();
+
+  //avoid subscriber destruction warning
+  usleep(1000);
+}
+TEST(InteractiveMarkerServer, metrics)
+{
+  interactive_markers::InteractiveMarkerServer server("im_server_test");
+  server.setDetailedMetrics( true );
+
+  visualization_msgs::InteractiveMarker int_marker;
+  int_marker.name = "marker1";
+  server.insert( int_marker );
+  int_marker.name = "marker2";
+  server.insert( int_marker );
+
+  interactive_markers::ServerMetrics metrics = server.getMetrics();
+  ASSERT_EQ( 2u, metrics.pending_updates );
+  ASSERT_EQ( 0u, metrics.apply_changes.count );
+
+  server.applyChanges();
+  server.setPose( "marker1", geometry_msgs::Pose() );
+  server.erase( "marker2" );
+  server.applyChanges();
+
+  metrics = server.getMetrics();
+  ASSERT_EQ( 0u, metrics.pending_updates );
+  ASSERT_EQ( 1u, metrics.markers_published );
+  ASSERT_EQ( 2u, metrics.apply_changes.count );
+  ASSERT_EQ( 2u, metrics.publish_init.count );
+  ASSERT_EQ( 2u, metrics.inits );
+  ASSERT_EQ( 2u, metrics.markers );
+  ASSERT_EQ( 1u, metrics.poses );
+  ASSERT_EQ( 1u, metrics.erases );
+  ASSERT_EQ( 0u, metrics.last_update_markers );
+  ASSERT_EQ( 1u, metrics.last_update_poses );
+  ASSERT_EQ( 1u, metrics.last_update_erases );
+  ASSERT_LT( 0u, metrics.last_update_bytes );
+  ASSERT_LT( 0u, metrics.last_init_bytes );
+  ASSERT_LT( 0u, metrics.lock_wait.count );
+  // the lock taken by getMetrics() has not been released yet
+  ASSERT_EQ( metrics.lock_wait.count, metrics.lock_hold.count + 1 );
+
+  //avoid subscriber destruction warning
+  usleep(1000);
+}
+
+TEST(InteractiveMarkerServer, feedbackConflicts)
+{
+  interactive_markers::InteractiveMarkerServer server("im_server_test");
+  boost::shared_ptr<interactive_markers::ManualClock> clock( new interactive_markers::ManualClock( ros::WallTime( 100 ) ) );
+  server.setClock( clock );
+
+  visualization_msgs::InteractiveMarker int_marker;
+  int_marker.name = "marker1";
+  server.insert( int_marker );
+  server.applyChanges();
+
+  visualization_msgs::InteractiveMarkerFeedbackPtr feedback( new visualization_msgs::InteractiveMarkerFeedback() );
+  feedback->marker_name = "marker1";
+  feedback->event_type = visualization_msgs::InteractiveMarkerFeedback::POSE_UPDATE;
+
+  feedback->client_id = "client1";
+  server.processFeedback( feedback, interactive_markers::getDefaultClock()->now() );
+  server.processFeedback( feedback, interactive_markers::getDefaultClock()->now() );
+
+  // a second client is locked out for one second
+  feedback->client_id = "client2";
+  server.processFeedback( feedback, interactive_markers::getDefaultClock()->now() );
+  clock->advance( ros::WallDuration( 0.5 ) );
+  server.processFeedback( feedback, interactive_markers::getDefaultClock()->now() );
+  clock->advance( ros::WallDuration( 0.6 ) );
+  server.processFeedback( feedback, interactive_markers::getDefaultClock()->now() );
+
+  feedback->marker_name = "marker2";
+  server.processFeedback( feedback, interactive_markers::getDefaultClock()->now() );
+
+  interactive_markers::ServerMetrics metrics = server.getMetrics();
+  ASSERT_EQ( 6u, metrics.feedback.count );
+  ASSERT_EQ( 2u, metrics.feedback_rejected );
+  ASSERT_EQ( 1u, metrics.feedback_unknown );
+
+  //avoid subscriber destruction warning
+  usleep(1000);
+}
+
+TEST(MenuHandler, entries)
+{
+  interactive_markers::MenuHandler menu_handler;
+  interactive_markers::MenuHandler::CheckState check_state;
+  std::string title;
+
+  interactive_markers::MenuHandler::EntryHandle top = menu_handler.insert( "top" );
+  interactive_markers::MenuHandler::EntryHandle sub = menu_handler.insert( top, "sub" );
+
+  ASSERT_TRUE( menu_handler.getTitle( sub, title ) );
+  ASSERT_EQ( "sub", title );
+  ASSERT_TRUE( menu_handler.setCheckState( sub, interactive_markers::MenuHandler::CHECKED ) );
+  ASSERT_TRUE( menu_handler.getCheckState( sub, check_state ) );
+  ASSERT_EQ( interactive_markers::MenuHandler::CHECKED, check_state );
+
+  // invalid handles
+  ASSERT_FALSE( menu_handler.getTitle( 0, title ) );
+  ASSERT_FALSE( menu_handler.getTitle( sub+1, title ) );
+  ASSERT_FALSE( menu_handler.setVisible( sub+1, false ) );
+  ASSERT_FALSE( menu_handler.getCheckState( sub+1, check_state ) );
+  ASSERT_EQ( interactive_markers::MenuHandler::NO_CHECKBOX, check_state );
+}
+
+TEST(MenuHandler, reApply)
+{
+  interactive_markers::InteractiveMarkerServer server("im_server_test");
+  interactive_markers::MenuHandler menu_handler;
+
+  interactive_markers::MenuHandler::EntryHandle entry = menu_handler.insert( "entry" );
+  menu_handler.setCheckState( entry, interactive_markers::MenuHandler::UNCHECKED );
+
+  visualization_msgs::InteractiveMarker int_marker;
+  const char* names[] = { "marker1", "marker2", "marker3" };
+  for ( unsigned i=0; i<3; i++ )
+  {
+    int_marker.name = names[i];
+    server.insert( int_marker );
+    ASSERT_TRUE( menu_handler.apply( server, names[i] ) );
+  }
+  server.applyChanges();
+
+  ASSERT_TRUE( server.get( "marker1", int_marker ) );
+  ASSERT_EQ( 1u, int_marker.menu_entries.size() );
+  ASSERT_EQ( "[ ] entry", int_marker.menu_entries[0].title );
+
+  server.erase( "marker2" );
+  server.applyChanges();
+
+  menu_handler.setCheckState( entry, interactive_markers::MenuHandler::CHECKED );
+  ASSERT_FALSE( menu_handler.reApply( server ) );
+  server.applyChanges();
+
+  ASSERT_TRUE( server.get( "marker1", int_marker ) );
+  ASSERT_EQ( "[x] entry", int_marker.menu_entries[0].title );
+  ASSERT_TRUE( server.get( "marker3", int_marker ) );
+  ASSERT_EQ( "[x] entry", int_marker.menu_entries[0].title );
+
+  // the erased marker is no longer managed
+  ASSERT_TRUE( menu_handler.reApply( server ) );
+  server.applyChanges();
+
+  //avoid subscriber destruction warning
+  usleep(1000);
+}
+TEST(MenuHandler, overrides)
+{
+  interactive_markers::InteractiveMarkerServer server("im_server_test");
+  interactive_markers::MenuHandler menu_handler;
+  interactive_markers::MenuHandler::CheckState check_state;
+
+  interactive_markers::MenuHandler::EntryHandle check = menu_handler.insert( "check" );
+  interactive_markers::MenuHandler::EntryHandle hide = menu_handler.insert( "hide" );
+  menu_handler.setCheckState( check, interactive_markers::MenuHandler::UNCHECKED );
+
+  visualization_msgs::InteractiveMarker int_marker;
+  int_marker.name = "marker1";
+  server.insert( int_marker );
+  int_marker.name = "marker2";
+  server.insert( int_marker );
+  int_marker.name = "marker3";
+  server.insert( int_marker );
+  menu_handler.apply( server, "marker1" );
+  menu_handler.apply( server, "marker2" );
+  menu_handler.apply( server, "marker3" );
+  server.applyChanges();
+
+  ASSERT_TRUE( menu_handler.setCheckState( "marker1", check, interactive_markers::MenuHandler::CHECKED ) );
+  ASSERT_TRUE( menu_handler.setVisible( "marker2", hide, false ) );
+  ASSERT_FALSE( menu_handler.setVisible( "marker2", hide+1, false ) );
+  // same overrides as marker1, set in a different order
+  ASSERT_TRUE( menu_handler.setVisible( "marker3", hide, false ) );
+  ASSERT_TRUE( menu_handler.setCheckState( "marker3", check, interactive_markers::MenuHandler::CHECKED ) );
+  ASSERT_TRUE( menu_handler.setVisible( "marker3", hide, true ) );
+  ASSERT_TRUE( menu_handler.reApply( server ) );
+  server.applyChanges();
+
+  ASSERT_TRUE( menu_handler.getCheckState( "marker1", check, check_state ) );
+  ASSERT_EQ( interactive_markers::MenuHandler::CHECKED, check_state );
+  ASSERT_TRUE( menu_handler.getCheckState( "marker2", check, check_state ) );
+  ASSERT_EQ( interactive_markers::MenuHandler::UNCHECKED, check_state );
+
+  ASSERT_TRUE( server.get( "marker1", int_marker ) );
+  ASSERT_EQ( 2u, int_marker.menu_entries.size() );
+  ASSERT_EQ( "[x] check", int_marker.menu_entries[0].title );
+  ASSERT_TRUE( server.get( "marker2", int_marker ) );
+  ASSERT_EQ( 1u, int_marker.menu_entries.size() );
+  ASSERT_EQ( "[ ] check", int_marker.menu_entries[0].title );
+  ASSERT_TRUE( server.get( "marker3", int_marker ) );
+  ASSERT_EQ( 2u, int_marker.menu_entries.size() );
+  ASSERT_EQ( "[x] check", int_marker.menu_entries[0].title );
+
+  // changes to the shared menu still apply to markers with overrides
+  menu_handler.setCheckState( check, interactive_markers::MenuHandler::NO_CHECKBOX );
+  menu_handler.clearOverrides( "marker1" );
+  menu_handler.reApply( server );
+  server.applyChanges();
+
+  ASSERT_TRUE( server.get( "marker1", int_marker ) );
+  ASSERT_EQ( "check", int_marker.menu_entries[0].title );
+  ASSERT_TRUE( server.get( "marker2", int_marker ) );
+  ASSERT_EQ( 1u, int_marker.menu_entries.size() );
+  ASSERT_EQ( "check", int_marker.menu_entries[0].title );
+
+  //avoid subscriber destruction warning
+  usleep(1000);
+}
 
 // Run all the tests that were declared with TEST()
 int main(int argc, char **argv)
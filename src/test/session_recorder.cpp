@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2012, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Records the init, update and feedback streams of the interactive
+// marker servers on one topic namespace, together with tf, into a bag
+// file which can be replayed with session_replay.
+//
+// usage: session_recorder <topic_ns> <bag_file>
+
+#include <ros/ros.h>
+#include <rosbag/bag.h>
+
+#include <tf/tfMessage.h>
+
+#include <visualization_msgs/InteractiveMarkerInit.h>
+#include <visualization_msgs/InteractiveMarkerUpdate.h>
+#include <visualization_msgs/InteractiveMarkerFeedback.h>
+
+#include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
+
+class SessionRecorder
+{
+public:
+  SessionRecorder( const std::string& topic_ns, const std::string& bag_file )
+  : num_messages_(0)
+  {
+    bag_.open( bag_file, rosbag::bagmode::Write );
+
+    // the init topic is latched, so we get the current state right away
+    subscribe<visualization_msgs::InteractiveMarkerInit>( topic_ns + "/update_full" );
+    subscribe<visualization_msgs::InteractiveMarkerUpdate>( topic_ns + "/update" );
+    subscribe<visualization_msgs::InteractiveMarkerFeedback>( topic_ns + "/feedback" );
+    subscribe<tf::tfMessage>( "/tf" );
+  }
+
+  ~SessionRecorder()
+  {
+    boost::mutex::scoped_lock lock( mutex_ );
+    bag_.close();
+    ROS_INFO( "Recorded %lu messages.", (unsigned long)num_messages_ );
+  }
+
+private:
+  template<class MsgT>
+  void subscribe( const std::string& topic )
+  {
+    // keep a large queue, we do not want to lose anything
+    std::string resolved_topic = nh_.resolveName( topic );
+    subscribers_.push_back( nh_.subscribe<MsgT>( resolved_topic, 1000,
+        boost::bind( &SessionRecorder::record<MsgT>, this, resolved_topic, _1 ) ) );
+  }
+
+  template<class MsgT>
+  void record( const std::string& topic, const boost::shared_ptr<const MsgT>& msg )
+  {
+    boost::mutex::scoped_lock lock( mutex_ );
+    bag_.write( topic, ros::Time::now(), *msg );
+    num_messages_++;
+  }
+
+  ros::NodeHandle nh_;
+  std::vector<ros::Subscriber> subscribers_;
+
+  boost::mutex mutex_;
+  rosbag::Bag bag_;
+  uint64_t num_messages_;
+};
+
+int main(int argc, char** argv)
+{
+  ros::init( argc, argv, "session_recorder", ros::init_options::AnonymousName );
+
+  if ( argc < 3 )
+  {
+    printf( "usage: session_recorder <topic_ns> <bag_file>\n" );
+    return 1;
+  }
+
+  SessionRecorder recorder( argv[1], argv[2] );
+  ros::spin();
+  return 0;
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2012, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Replays a session recorded with session_recorder into an
+// InteractiveMarkerClient, either as fast as possible or at a multiple
+// of the recorded speed, and reports throughput and latency as JSON.
+//
+// Latency is measured from the time a message is due (i.e. published to
+// the client's loopback transport when replaying as fast as possible)
+// until the client passes it on to the init or update callback.
+//
+// usage: session_replay <bag_file> <target_frame> [speed]
+//   speed: playback speed relative to the recording, 0 for unthrottled (default)
+
+#include <ros/ros.h>
+#include <rosbag/bag.h>
+
+#include "session_replay.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace interactive_markers;
+
+int main(int argc, char** argv)
+{
+  ros::init( argc, argv, "session_replay", ros::init_options::AnonymousName );
+
+  if ( argc < 3 )
+  {
+    printf( "usage: session_replay <bag_file> <target_frame> [speed]\n" );
+    return 1;
+  }
+
+  std::string bag_file = argv[1];
+  std::string target_frame = argv[2];
+  double speed = argc > 3 ? atof( argv[3] ) : 0.0;
+
+  rosbag::Bag bag;
+  try
+  {
+    bag.open( bag_file, rosbag::bagmode::Read );
+  }
+  catch ( rosbag::BagException& e )
+  {
+    fprintf( stderr, "Cannot open %s: %s\n", bag_file.c_str(), e.what() );
+    return 1;
+  }
+
+  rosbag::View view( bag );
+
+  SessionReplay replay( target_frame );
+  replay.replay( view, speed );
+  replay.printResults( bag_file, speed );
+  return 0;
+}
@@ -0,0 +1,270 @@
+/*
+ * Copyright (c) 2012, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INTERACTIVE_MARKERS_SESSION_REPLAY
+#define INTERACTIVE_MARKERS_SESSION_REPLAY
+
+#include <ros/ros.h>
+#include <rosbag/view.h>
+
+#include <tf/tf.h>
+#include <tf/tfMessage.h>
+
+#include <interactive_markers/interactive_marker_client.h>
+#include <interactive_markers/loopback_transport.h>
+#include <interactive_markers/metrics.h>
+
+#include <boost/bind.hpp>
+
+#include <map>
+#include <stdio.h>
+
+namespace interactive_markers
+{
+
+/// Replays a recorded session into an InteractiveMarkerClient.
+/// The recorded servers are connected to the client through a
+/// LoopbackTransport, each on its own endpoint.
+class SessionReplay
+{
+public:
+  SessionReplay( const std::string& target_frame )
+  : clock_( new ManualClock() )
+  , client_( tf_, transport_.createClientTransport(), target_frame, "session_replay" )
+  , num_init_(0)
+  , num_update_(0)
+  , num_feedback_(0)
+  , num_tf_(0)
+  , num_bytes_(0)
+  , num_init_cbs_(0)
+  , num_update_cbs_(0)
+  , num_reset_cbs_(0)
+  {
+    client_.setClock( clock_ );
+    client_.setInitCb( boost::bind( &SessionReplay::initCb, this, _1 ) );
+    client_.setUpdateCb( boost::bind( &SessionReplay::updateCb, this, _1 ) );
+    client_.setResetCb( boost::bind( &SessionReplay::resetCb, this, _1 ) );
+  }
+
+  void replay( rosbag::View& view, double speed )
+  {
+    ros::Time bag_start = view.getBeginTime();
+    start_time_ = ros::WallTime::now();
+
+    for ( rosbag::View::iterator it = view.begin(); it != view.end(); ++it )
+    {
+      const rosbag::MessageInstance& m = *it;
+
+      // timeouts in the client follow the recording
+      ros::Time bag_time = m.getTime();
+      clock_->set( ros::WallTime( bag_time.sec, bag_time.nsec ) );
+
+      ros::WallTime due_time = ros::WallTime::now();
+      if ( speed > 0 )
+      {
+        due_time = start_time_ + ros::WallDuration( (bag_time - bag_start).toSec() / speed );
+        ros::WallDuration wait = due_time - ros::WallTime::now();
+        if ( wait > ros::WallDuration(0) )
+        {
+          wait.sleep();
+        }
+      }
+
+      push( m, due_time );
+      transport_.spinOnce();
+      client_.update();
+    }
+
+    end_time_ = ros::WallTime::now();
+  }
+
+  void printResults( const std::string& bag_file, double speed )
+  {
+    double duration = ( end_time_ - start_time_ ).toSec();
+    uint64_t num_messages = num_init_ + num_update_;
+
+    InteractiveMarkerClient::M_ClientMetrics metrics;
+    client_.getMetrics( metrics );
+    uint64_t resets = 0;
+    for ( InteractiveMarkerClient::M_ClientMetrics::iterator it = metrics.begin(); it != metrics.end(); ++it )
+    {
+      for ( unsigned i=0; i<ClientMetrics::NUM_RESET_CAUSES; i++ )
+      {
+        resets += it->second.resets[i];
+      }
+    }
+
+    printf( "{\n" );
+    printf( "  \"bag\": \"%s\",\n", bag_file.c_str() );
+    printf( "  \"speed\": %.3f,\n", speed );
+    printf( "  \"duration_s\": %.6f,\n", duration );
+    printf( "  \"messages\": { \"init\": %lu, \"update\": %lu, \"feedback\": %lu, \"tf\": %lu },\n",
+        (unsigned long)num_init_, (unsigned long)num_update_,
+        (unsigned long)num_feedback_, (unsigned long)num_tf_ );
+    printf( "  \"throughput\": { \"messages_per_s\": %.1f, \"mbytes_per_s\": %.3f },\n",
+        duration > 0 ? num_messages / duration : 0.0,
+        duration > 0 ? num_bytes_ / duration / 1e6 : 0.0 );
+    printf( "  \"callbacks\": { \"init\": %lu, \"update\": %lu, \"reset\": %lu },\n",
+        (unsigned long)num_init_cbs_, (unsigned long)num_update_cbs_, (unsigned long)num_reset_cbs_ );
+    printf( "  \"connection_resets\": %lu,\n", (unsigned long)resets );
+    printf( "  \"latency\": { \"count\": %lu, \"mean_us\": %.3f, \"max_us\": %.3f, \"buckets\": [",
+        (unsigned long)latency_.stats.count, latency_.stats.mean() * 1e6,
+        latency_.stats.max.toSec() * 1e6 );
+    for ( unsigned i=0; i<DurationHistogram::NUM_BUCKETS; i++ )
+    {
+      printf( "%s%lu", i > 0 ? ", " : " ", (unsigned long)latency_.buckets[i] );
+    }
+    printf( " ] }\n}\n" );
+  }
+
+  uint64_t getNumInitCbs() const { return num_init_cbs_; }
+  uint64_t getNumUpdateCbs() const { return num_update_cbs_; }
+  uint64_t getNumResetCbs() const { return num_reset_cbs_; }
+
+private:
+  typedef std::map<uint64_t, ros::WallTime> M_DueTime;
+
+  // each recorded server gets its own endpoint, so init messages
+  // are latched per server like with ROS
+  const ServerTransportPtr& getServer( const std::string& server_id )
+  {
+    ServerTransportPtr& server = servers_[server_id];
+    if ( !server )
+    {
+      server = transport_.createServerTransport();
+      server->advertise( "session_replay", boost::bind( &SessionReplay::feedbackCb, this, _1, _2 ) );
+    }
+    return server;
+  }
+
+  void push( const rosbag::MessageInstance& m, const ros::WallTime& due_time )
+  {
+    visualization_msgs::InteractiveMarkerInitConstPtr init = m.instantiate<visualization_msgs::InteractiveMarkerInit>();
+    if ( init )
+    {
+      num_init_++;
+      num_bytes_ += m.size();
+      due_times_[init->server_id].insert( std::make_pair( init->seq_num, due_time ) );
+      getServer( init->server_id )->publish( init );
+      return;
+    }
+
+    visualization_msgs::InteractiveMarkerUpdateConstPtr update = m.instantiate<visualization_msgs::InteractiveMarkerUpdate>();
+    if ( update )
+    {
+      num_update_++;
+      num_bytes_ += m.size();
+      // keep-alives have no due time, the client does not pass them on
+      if ( update->type == visualization_msgs::InteractiveMarkerUpdate::UPDATE )
+      {
+        due_times_[update->server_id].insert( std::make_pair( update->seq_num, due_time ) );
+      }
+      getServer( update->server_id )->publish( update );
+      return;
+    }
+
+    if ( m.instantiate<visualization_msgs::InteractiveMarkerFeedback>() )
+    {
+      // clients do not process feedback, it is only part of the recording
+      num_feedback_++;
+      return;
+    }
+
+    tf::tfMessageConstPtr tf_msg = m.instantiate<tf::tfMessage>();
+    if ( tf_msg )
+    {
+      num_tf_++;
+      for ( size_t i=0; i<tf_msg->transforms.size(); i++ )
+      {
+        tf::StampedTransform transform;
+        tf::transformStampedMsgToTF( tf_msg->transforms[i], transform );
+        tf_.setTransform( transform, "session_replay" );
+      }
+    }
+  }
+
+  void addLatency( const std::string& server_id, uint64_t seq_num )
+  {
+    M_DueTime& due_times = due_times_[server_id];
+    M_DueTime::iterator it = due_times.find( seq_num );
+    if ( it != due_times.end() )
+    {
+      latency_.add( ros::WallTime::now() - it->second );
+    }
+    // older messages will not be passed on anymore
+    due_times.erase( due_times.begin(), due_times.upper_bound( seq_num ) );
+  }
+
+  void feedbackCb( const visualization_msgs::InteractiveMarkerFeedbackConstPtr&, const ros::WallTime& )
+  {
+  }
+
+  void initCb( const InteractiveMarkerClient::InitConstPtr& msg )
+  {
+    num_init_cbs_++;
+    addLatency( msg->server_id, msg->seq_num );
+  }
+
+  void updateCb( const InteractiveMarkerClient::UpdateConstPtr& msg )
+  {
+    num_update_cbs_++;
+    addLatency( msg->server_id, msg->seq_num );
+  }
+
+  void resetCb( const std::string& server_id )
+  {
+    num_reset_cbs_++;
+    due_times_.erase( server_id );
+  }
+
+  tf::Transformer tf_;
+  LoopbackTransport transport_;
+  std::map<std::string, ServerTransportPtr> servers_;
+  boost::shared_ptr<ManualClock> clock_;
+  InteractiveMarkerClient client_;
+
+  std::map<std::string, M_DueTime> due_times_;
+  DurationHistogram latency_;
+
+  uint64_t num_init_;
+  uint64_t num_update_;
+  uint64_t num_feedback_;
+  uint64_t num_tf_;
+  uint64_t num_bytes_;
+  uint64_t num_init_cbs_;
+  uint64_t num_update_cbs_;
+  uint64_t num_reset_cbs_;
+
+  ros::WallTime start_time_;
+  ros::WallTime end_time_;
+};
+
+}
+
+#endif
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2012, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <ros/ros.h>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+
+#include <gtest/gtest.h>
+
+#include "session_replay.h"
+
+#include <unistd.h>
+
+using namespace interactive_markers;
+
+visualization_msgs::InteractiveMarkerUpdate makeUpdate( uint64_t seq_num, uint8_t type )
+{
+  visualization_msgs::InteractiveMarkerUpdate update;
+  update.server_id = "recorded_server";
+  update.seq_num = seq_num;
+  update.type = type;
+  return update;
+}
+
+TEST(SessionReplay, callbacks)
+{
+  std::string bag_file = "/tmp/im_session_replay_test.bag";
+
+  {
+    rosbag::Bag bag( bag_file, rosbag::bagmode::Write );
+
+    tf::tfMessage tf_msg;
+    tf_msg.transforms.resize( 1 );
+    tf_msg.transforms[0].header.frame_id = "target_frame";
+    tf_msg.transforms[0].header.stamp = ros::Time( 1 );
+    tf_msg.transforms[0].child_frame_id = "marker_frame";
+    tf_msg.transforms[0].transform.rotation.w = 1;
+    bag.write( "/tf", ros::Time( 1 ), tf_msg );
+
+    visualization_msgs::InteractiveMarkerInit init;
+    init.server_id = "recorded_server";
+    init.seq_num = 1;
+    init.markers.resize( 1 );
+    init.markers[0].name = "marker1";
+    init.markers[0].header.frame_id = "marker_frame";
+    init.markers[0].pose.orientation.w = 1;
+    bag.write( "/im/update_full", ros::Time( 2 ), init );
+
+    bag.write( "/im/update", ros::Time( 3 ), makeUpdate( 1, visualization_msgs::InteractiveMarkerUpdate::KEEP_ALIVE ) );
+
+    visualization_msgs::InteractiveMarkerUpdate update = makeUpdate( 2, visualization_msgs::InteractiveMarkerUpdate::UPDATE );
+    update.poses.resize( 1 );
+    update.poses[0].name = "marker1";
+    update.poses[0].header.frame_id = "marker_frame";
+    update.poses[0].pose.orientation.w = 1;
+    bag.write( "/im/update", ros::Time( 4 ), update );
+
+    update.seq_num = 3;
+    update.poses[0].pose.position.x = 1;
+    bag.write( "/im/update", ros::Time( 5 ), update );
+
+    bag.write( "/im/update", ros::Time( 6 ), makeUpdate( 3, visualization_msgs::InteractiveMarkerUpdate::KEEP_ALIVE ) );
+    bag.close();
+  }
+
+  rosbag::Bag bag( bag_file, rosbag::bagmode::Read );
+  rosbag::View view( bag );
+
+  SessionReplay replay( "target_frame" );
+  replay.replay( view, 0 );
+  bag.close();
+  unlink( bag_file.c_str() );
+
+  ASSERT_EQ( 1u, replay.getNumInitCbs() );
+  ASSERT_EQ( 2u, replay.getNumUpdateCbs() );
+  ASSERT_EQ( 0u, replay.getNumResetCbs() );
+}
+
+// Run all the tests that were declared with TEST()
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  ros::init(argc, argv, "im_session_replay_test");
+  return RUN_ALL_TESTS();
+}
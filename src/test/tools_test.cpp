@@ -0,0 +1,261 @@
+/*
+ * Copyright (c) 2012, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <ros/ros.h>
+
+#include <gtest/gtest.h>
+
+#include <interactive_markers/tools.h>
+
+#include <stdlib.h>
+
+#include <new>
+#include <set>
+#include <sstream>
+
+using namespace visualization_msgs;
+
+// count heap operations while enabled
+static bool count_allocations = false;
+static unsigned num_allocations = 0;
+static unsigned num_deallocations = 0;
+
+void* operator new( size_t size )
+{
+  if ( count_allocations )
+  {
+    num_allocations++;
+  }
+  void* p = malloc( size );
+  if ( !p )
+  {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete( void* p ) throw()
+{
+  if ( count_allocations && p )
+  {
+    num_deallocations++;
+  }
+  free( p );
+}
+
+InteractiveMarker makeTestMarker( const std::string& name )
+{
+  InteractiveMarker int_marker;
+  int_marker.name = name;
+
+  InteractiveMarkerControl control;
+  control.orientation.w = 1;
+  control.orientation.x = 1;
+  control.interaction_mode = InteractiveMarkerControl::ROTATE_AXIS;
+  int_marker.controls.push_back( control );
+  control.interaction_mode = InteractiveMarkerControl::MOVE_AXIS;
+  int_marker.controls.push_back( control );
+  control.orientation.x = 0;
+  control.orientation.z = 1;
+  control.interaction_mode = InteractiveMarkerControl::MOVE_ROTATE;
+  int_marker.controls.push_back( control );
+
+  return int_marker;
+}
+
+std::vector<uint8_t> serialize( const InteractiveMarker& msg )
+{
+  std::vector<uint8_t> buffer( ros::serialization::serializationLength( msg ) );
+  ros::serialization::OStream stream( &buffer[0], buffer.size() );
+  ros::serialization::serialize( stream, msg );
+  return buffer;
+}
+
+TEST(Tools, deterministicIds)
+{
+  InteractiveMarker first = makeTestMarker( "marker1" );
+  InteractiveMarker second = makeTestMarker( "marker1" );
+  interactive_markers::autoComplete( first );
+  interactive_markers::autoComplete( second );
+
+  ASSERT_EQ( first.controls.size(), second.controls.size() );
+
+  std::set<int32_t> ids;
+  unsigned num_markers = 0;
+  for ( unsigned c=0; c<first.controls.size(); c++ )
+  {
+    ASSERT_EQ( first.controls[c].markers.size(), second.controls[c].markers.size() );
+    for ( unsigned m=0; m<first.controls[c].markers.size(); m++ )
+    {
+      ASSERT_EQ( first.controls[c].markers[m].id, second.controls[c].markers[m].id );
+      ASSERT_EQ( "marker1", first.controls[c].markers[m].ns );
+      ids.insert( first.controls[c].markers[m].id );
+      num_markers++;
+    }
+  }
+
+  // ids are unique within the interactive marker
+  ASSERT_EQ( num_markers, ids.size() );
+
+  // completing a single control yields the same ids
+  InteractiveMarker third = makeTestMarker( "marker1" );
+  interactive_markers::autoComplete( third, third.controls[1] );
+  ASSERT_EQ( first.controls[1].markers[0].id, third.controls[1].markers[0].id );
+  ASSERT_EQ( first.controls[1].markers[1].id, third.controls[1].markers[1].id );
+}
+
+TEST(Tools, noTransientAllocations)
+{
+  InteractiveMarker int_marker;
+  int_marker.name = "marker1";
+  int_marker.description = "6-DOF";
+
+  const char* names[] = { "rotate_x", "move_x", "rotate_z", "move_z", "rotate_y", "move_y" };
+  for ( unsigned i=0; i<6; i++ )
+  {
+    InteractiveMarkerControl control;
+    control.name = names[i];
+    control.orientation.w = 1;
+    control.orientation.x = i<2 ? 1 : 0;
+    control.orientation.y = i>=2 && i<4 ? 1 : 0;
+    control.orientation.z = i>=4 ? 1 : 0;
+    control.interaction_mode = i%2 ? InteractiveMarkerControl::MOVE_AXIS : InteractiveMarkerControl::ROTATE_AXIS;
+    int_marker.controls.push_back( control );
+  }
+
+  // warm up the geometry cache
+  InteractiveMarker warm_up = int_marker;
+  interactive_markers::autoComplete( warm_up );
+
+  num_allocations = 0;
+  num_deallocations = 0;
+  count_allocations = true;
+  interactive_markers::autoComplete( int_marker );
+  count_allocations = false;
+
+  // everything that is allocated ends up in the message
+  ASSERT_EQ( 0u, num_deallocations );
+  ASSERT_LT( 0u, num_allocations );
+  ASSERT_EQ( 2u, int_marker.controls[1].markers.size() );
+}
+
+TEST(Tools, uniqueifyControlNames)
+{
+  InteractiveMarker int_marker;
+  InteractiveMarkerControl control;
+  const char* names[] = { "a", "a_u0", "a", "b", "a" };
+  for ( unsigned i=0; i<5; i++ )
+  {
+    control.name = names[i];
+    int_marker.controls.push_back( control );
+  }
+
+  interactive_markers::uniqueifyControlNames( int_marker );
+
+  ASSERT_EQ( "a", int_marker.controls[0].name );
+  ASSERT_EQ( "a_u0", int_marker.controls[1].name );
+  ASSERT_EQ( "a_u0_u1", int_marker.controls[2].name );
+  ASSERT_EQ( "b", int_marker.controls[3].name );
+  ASSERT_EQ( "a_u2", int_marker.controls[4].name );
+}
+
+TEST(Tools, uniqueifyControlNamesRepeated)
+{
+  InteractiveMarker int_marker;
+  InteractiveMarkerControl control;
+  control.name = "a";
+  int_marker.controls.resize( 3, control );
+
+  interactive_markers::uniqueifyControlNames( int_marker );
+
+  ASSERT_EQ( "a", int_marker.controls[0].name );
+  ASSERT_EQ( "a_u0", int_marker.controls[1].name );
+  ASSERT_EQ( "a_u1", int_marker.controls[2].name );
+}
+
+TEST(Tools, detailLevel)
+{
+  InteractiveMarker int_marker = makeTestMarker( "marker1" );
+
+  InteractiveMarker high = int_marker;
+  interactive_markers::autoComplete( high );
+  ASSERT_EQ( 216u, high.controls[0].markers[0].points.size() );
+  ASSERT_EQ( 72u, high.controls[0].markers[0].colors.size() );
+  ASSERT_EQ( 216u, high.controls[2].markers[0].points.size() );
+
+  interactive_markers::setDetailLevel( interactive_markers::DETAIL_LOW );
+  InteractiveMarker low = int_marker;
+  interactive_markers::autoComplete( low );
+  ASSERT_EQ( 72u, low.controls[0].markers[0].points.size() );
+  ASSERT_EQ( 24u, low.controls[0].markers[0].colors.size() );
+  ASSERT_EQ( 72u, low.controls[2].markers[0].points.size() );
+
+  interactive_markers::setDetailLevel( interactive_markers::DETAIL_AUTO );
+  InteractiveMarker small = int_marker;
+  small.scale = 0.1;
+  interactive_markers::autoComplete( small );
+  ASSERT_EQ( 72u, small.controls[0].markers[0].points.size() );
+  InteractiveMarker large = int_marker;
+  large.scale = 2;
+  interactive_markers::autoComplete( large );
+  ASSERT_EQ( 216u, large.controls[0].markers[0].points.size() );
+
+  interactive_markers::setDetailLevel( interactive_markers::DETAIL_HIGH );
+}
+
+TEST(Tools, batchMatchesSerial)
+{
+  std::vector<InteractiveMarker> serial;
+  for ( unsigned i=0; i<2000; i++ )
+  {
+    std::ostringstream s;
+    s << "marker" << i;
+    serial.push_back( makeTestMarker( s.str() ) );
+  }
+  std::vector<InteractiveMarker> batch = serial;
+
+  for ( unsigned i=0; i<serial.size(); i++ )
+  {
+    interactive_markers::autoComplete( serial[i] );
+  }
+  interactive_markers::autoComplete( batch );
+
+  for ( unsigned i=0; i<serial.size(); i++ )
+  {
+    ASSERT_TRUE( serialize( serial[i] ) == serialize( batch[i] ) );
+  }
+}
+
+// Run all the tests that were declared with TEST()
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  ros::init(argc, argv, "im_tools_test");
+  return RUN_ALL_TESTS();
+}
@@ -29,18 +29,45 @@
 
 #include "interactive_markers/tools.h"
 
+#include <ros/console.h>
+
 #include <tf/LinearMath/Quaternion.h>
 #include <tf/LinearMath/Matrix3x3.h>
 
 #include <math.h>
 #include <assert.h>
+#include <stdio.h>
+
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/once.hpp>
+#include <boost/thread/thread.hpp>
 
-#include <set>
-#include <sstream>
+#include <algorithm>
 
 namespace interactive_markers
 {
 
+namespace
+{
+
+// below this many markers per thread, batch completion runs serially
+const size_t MIN_BATCH_PER_THREAD = 256;
+
+void completeControl( const visualization_msgs::InteractiveMarker &msg,
+    visualization_msgs::InteractiveMarkerControl &control, unsigned control_index );
+
+void completeMarkers( visualization_msgs::InteractiveMarker* const* begin,
+    visualization_msgs::InteractiveMarker* const* end )
+{
+  for ( ; begin != end; ++begin )
+  {
+    autoComplete( **begin );
+  }
+}
+
+}
+
 void autoComplete( visualization_msgs::InteractiveMarker &msg )
 {
   // this is a 'delete' message. no need for action.
@@ -74,32 +101,108 @@ void autoComplete( visualization_msgs::InteractiveMarker &msg )
   // complete the controls
   for ( unsigned c=0; c<msg.controls.size(); c++ )
   {
-    autoComplete( msg, msg.controls[c] );
+    completeControl( msg, msg.controls[c], c );
   }
 
   uniqueifyControlNames( msg );
 }
 
+void autoComplete( std::vector<visualization_msgs::InteractiveMarker> &msgs )
+{
+  std::vector<visualization_msgs::InteractiveMarker*> ptrs( msgs.size() );
+  for ( size_t i=0; i<msgs.size(); i++ )
+  {
+    ptrs[i] = &msgs[i];
+  }
+  autoComplete( ptrs );
+}
+
+void autoComplete( const std::vector<visualization_msgs::InteractiveMarker*> &msgs )
+{
+  if ( msgs.empty() )
+  {
+    return;
+  }
+
+  size_t num_threads = boost::thread::hardware_concurrency();
+  num_threads = std::min( num_threads, msgs.size() / MIN_BATCH_PER_THREAD );
+
+  visualization_msgs::InteractiveMarker* const* begin = &msgs[0];
+
+  if ( num_threads <= 1 )
+  {
+    completeMarkers( begin, begin + msgs.size() );
+  }
+  else
+  {
+    // completing a marker only touches that marker, so the work can be
+    // split into contiguous chunks. the calling thread takes the last one.
+    boost::thread_group threads;
+    for ( size_t t=0; t<num_threads-1; t++ )
+    {
+      size_t start = msgs.size() * t / num_threads;
+      size_t end = msgs.size() * (t+1) / num_threads;
+      threads.create_thread( boost::bind( &completeMarkers, begin + start, begin + end ) );
+    }
+    completeMarkers( begin + msgs.size() * (num_threads-1) / num_threads, begin + msgs.size() );
+    threads.join_all();
+  }
+}
+
+namespace
+{
+
+// true if one of the first num_controls controls has the given name
+bool isControlNameTaken( const visualization_msgs::InteractiveMarker& msg,
+    unsigned num_controls, const std::string& name )
+{
+  for( unsigned c = 0; c < num_controls; c++ )
+  {
+    if ( msg.controls[c].name == name )
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+}
+
 void uniqueifyControlNames( visualization_msgs::InteractiveMarker& msg )
 {
+  // markers only have a handful of controls, so a linear search is
+  // cheaper than building a set of names
   int uniqueification_number = 0;
-  std::set<std::string> names;
   for( unsigned c = 0; c < msg.controls.size(); c++ )
   {
-    std::string name = msg.controls[c].name;
-    while( names.find( name ) != names.end() )
+    std::string& name = msg.controls[c].name;
+    // a suffixed name can collide again, then it gets another suffix
+    char suffix[16];
+    while( isControlNameTaken( msg, c, name ) )
     {
-      std::stringstream ss;
-      ss << name << "_u" << uniqueification_number++;
-      name = ss.str();
+      snprintf( suffix, sizeof(suffix), "_u%d", uniqueification_number++ );
+      name += suffix;
     }
-    msg.controls[c].name = name;
-    names.insert( name );
   }
 }
 
 void autoComplete( const visualization_msgs::InteractiveMarker &msg,
     visualization_msgs::InteractiveMarkerControl &control )
+{
+  // a control that is not part of msg yet is assumed to be appended to it
+  unsigned control_index = msg.controls.size();
+  if ( !msg.controls.empty() && &control >= &msg.controls.front() && &control <= &msg.controls.back() )
+  {
+    control_index = &control - &msg.controls.front();
+  }
+  completeControl( msg, control, control_index );
+}
+
+namespace
+{
+
+void completeControl( const visualization_msgs::InteractiveMarker &msg,
+    visualization_msgs::InteractiveMarkerControl &control, unsigned control_index )
 {
   // correct empty orientation
   if ( control.orientation.w == 0 && control.orientation.x == 0 &&
@@ -163,8 +266,6 @@ void autoComplete( const visualization_msgs::InteractiveMarker &msg,
       marker.scale.z = 1;
     }
 
-    marker.ns = msg.name;
-
     // correct empty orientation
     if ( marker.pose.orientation.w == 0 && marker.pose.orientation.x == 0 &&
         marker.pose.orientation.y == 0 && marker.pose.orientation.z == 0 )
@@ -183,16 +284,25 @@ void autoComplete( const visualization_msgs::InteractiveMarker &msg,
     marker.pose.orientation.z = marker_orientation.z();
     marker.pose.orientation.w = marker_orientation.w();
 
-    static volatile unsigned id = 0;
-    marker.id = id++;
+    // markers are identified by (ns,id), so this is unique within
+    // the interactive marker and independent of any other markers.
+    if ( control_index >= MAX_ID_CONTROLS || m >= MAX_ID_MARKERS )
+    {
+      ROS_WARN_ONCE( "Interactive marker '%s' has more than %u controls or more than %u markers "
+          "in one control. Marker ids will not be unique.", msg.name.c_str(), MAX_ID_CONTROLS, MAX_ID_MARKERS );
+    }
+    marker.id = makeMarkerId( control_index, m );
     marker.ns = msg.name;
   }
 }
 
+}
+
 void makeArrow( const visualization_msgs::InteractiveMarker &msg,
     visualization_msgs::InteractiveMarkerControl &control, float pos )
 {
-  visualization_msgs::Marker marker;
+  control.markers.push_back( visualization_msgs::Marker() );
+  visualization_msgs::Marker &marker = control.markers.back();
 
   // rely on the auto-completion for the correct orientation
   marker.pose.orientation = control.orientation;
@@ -213,27 +323,26 @@ void makeArrow( const visualization_msgs::InteractiveMarker &msg,
   marker.points.resize(2);
   marker.points[0].x = dir * msg.scale * inner;
   marker.points[1].x = dir * msg.scale * outer;
-
-  control.markers.push_back( marker );
 }
 
-void makeDisc( const visualization_msgs::InteractiveMarker &msg,
-    visualization_msgs::InteractiveMarkerControl &control, float width )
+namespace
 {
-  visualization_msgs::Marker marker;
-
-  // rely on the auto-completion for the correct orientation
-  marker.pose.orientation = control.orientation;
 
-  marker.type = visualization_msgs::Marker::TRIANGLE_LIST;
-  marker.scale.x = msg.scale;
-  marker.scale.y = msg.scale;
-  marker.scale.z = msg.scale;
+typedef std::vector<geometry_msgs::Point> V_Point;
+typedef boost::shared_ptr<const V_Point> V_PointConstPtr;
 
-  assignDefaultColor(marker, control.orientation);
+// the triangle layouts used by makeDisc
+enum DiscStyleT
+{
+  DISC_PLAIN,
+  DISC_ROTATE,
+  DISC_MOVE_ROTATE
+};
 
+// compute the triangles of a disc with inner radius 0.5 in the y-z plane
+V_PointConstPtr computeDiscPoints( DiscStyleT style, float width, int steps )
+{
   // compute points on a circle in the y-z plane
-  int steps = 36;
   std::vector<geometry_msgs::Point> circle1, circle2;
   circle1.reserve(steps);
   circle2.reserve(steps);
@@ -254,17 +363,11 @@ void makeDisc( const visualization_msgs::InteractiveMarker &msg,
     circle2.push_back( v2 );
   }
 
-  marker.points.resize(6*steps);
+  boost::shared_ptr<V_Point> points( new V_Point(6*steps) );
 
-  std_msgs::ColorRGBA color;
-  color.r=color.g=color.b=color.a=1;
-
-  switch ( control.interaction_mode )
+  switch ( style )
   {
-    case visualization_msgs::InteractiveMarkerControl::ROTATE_AXIS:
-    {
-      marker.colors.resize(2*steps);
-      std_msgs::ColorRGBA base_color = marker.color;
+    case DISC_ROTATE:
       for ( int i=0; i<steps; i++ )
       {
         int i1 = i;
@@ -272,31 +375,18 @@ void makeDisc( const visualization_msgs::InteractiveMarker &msg,
         int i3 = (i+2) % steps;
 
         int p = i*6;
-        int c = i*2;
-
-        marker.points[p+0] = circle1[i1];
-        marker.points[p+1] = circle2[i2];
-        marker.points[p+2] = circle1[i2];
 
-        marker.points[p+3] = circle1[i2];
-        marker.points[p+4] = circle2[i2];
-        marker.points[p+5] = circle2[i3];
+        (*points)[p+0] = circle1[i1];
+        (*points)[p+1] = circle2[i2];
+        (*points)[p+2] = circle1[i2];
 
-        float t = 0.6 + 0.4 * (i%2);
-        color.r = base_color.r * t;
-        color.g = base_color.g * t;
-        color.b = base_color.b * t;
-
-        marker.colors[c] = color;
-        marker.colors[c+1] = color;
+        (*points)[p+3] = circle1[i2];
+        (*points)[p+4] = circle2[i2];
+        (*points)[p+5] = circle2[i3];
       }
       break;
-    }
 
-    case visualization_msgs::InteractiveMarkerControl::MOVE_ROTATE:
-    {
-      marker.colors.resize(2*steps);
-      std_msgs::ColorRGBA base_color = marker.color;
+    case DISC_MOVE_ROTATE:
       for ( int i=0; i<steps-1; i+=2 )
       {
         int i1 = i;
@@ -304,39 +394,26 @@ void makeDisc( const visualization_msgs::InteractiveMarker &msg,
         int i3 = (i+2) % steps;
 
         int p = i * 6;
-        int c = i * 2;
 
-        marker.points[p+0] = circle1[i1];
-        marker.points[p+1] = circle2[i2];
-        marker.points[p+2] = circle1[i2];
+        (*points)[p+0] = circle1[i1];
+        (*points)[p+1] = circle2[i2];
+        (*points)[p+2] = circle1[i2];
 
-        marker.points[p+3] = circle1[i2];
-        marker.points[p+4] = circle2[i2];
-        marker.points[p+5] = circle1[i3];
-
-        color.r = base_color.r * 0.6;
-        color.g = base_color.g * 0.6;
-        color.b = base_color.b * 0.6;
-
-        marker.colors[c] = color;
-        marker.colors[c+1] = color;
+        (*points)[p+3] = circle1[i2];
+        (*points)[p+4] = circle2[i2];
+        (*points)[p+5] = circle1[i3];
 
         p += 6;
-        c += 2;
-
-        marker.points[p+0] = circle2[i1];
-        marker.points[p+1] = circle2[i2];
-        marker.points[p+2] = circle1[i1];
 
-        marker.points[p+3] = circle2[i2];
-        marker.points[p+4] = circle2[i3];
-        marker.points[p+5] = circle1[i3];
+        (*points)[p+0] = circle2[i1];
+        (*points)[p+1] = circle2[i2];
+        (*points)[p+2] = circle1[i1];
 
-        marker.colors[c] = base_color;
-        marker.colors[c+1] = base_color;
+        (*points)[p+3] = circle2[i2];
+        (*points)[p+4] = circle2[i3];
+        (*points)[p+5] = circle1[i3];
       }
       break;
-    }
 
     default:
       for ( int i=0; i<steps; i++ )
@@ -346,27 +423,195 @@ void makeDisc( const visualization_msgs::InteractiveMarker &msg,
 
         int p = i*6;
 
-        marker.points[p+0] = circle1[i1];
-        marker.points[p+1] = circle2[i1];
-        marker.points[p+2] = circle1[i2];
+        (*points)[p+0] = circle1[i1];
+        (*points)[p+1] = circle2[i1];
+        (*points)[p+2] = circle1[i2];
 
-        marker.points[p+3] = circle2[i1];
-        marker.points[p+4] = circle2[i2];
-        marker.points[p+5] = circle1[i2];
+        (*points)[p+3] = circle2[i1];
+        (*points)[p+4] = circle2[i2];
+        (*points)[p+5] = circle1[i2];
       }
       break;
   }
 
-  control.markers.push_back(marker);
+  return points;
+}
+
+// The disc geometry does not depend on the marker scale (that goes into
+// marker.scale). The discs for the default width and the three levels of
+// detail are computed once and then read without locking, so that the
+// threads of the batch autoComplete() do not contend for them.
+const float DEFAULT_DISC_WIDTH = 0.3;
+const int NUM_DISC_STYLES = 3;
+const int NUM_DISC_LEVELS = 3;
+
+V_PointConstPtr default_discs[NUM_DISC_STYLES][NUM_DISC_LEVELS];
+boost::once_flag default_discs_once = BOOST_ONCE_INIT;
+
+// index into default_discs for the steps returned by getDiscSteps()
+int getDiscLevelIndex( int steps )
+{
+  switch ( steps )
+  {
+    case 12:
+      return 0;
+    case 24:
+      return 1;
+    case 36:
+      return 2;
+    default:
+      return -1;
+  }
+}
+
+void computeDefaultDiscs()
+{
+  const int steps[NUM_DISC_LEVELS] = { 12, 24, 36 };
+  for ( int style=0; style<NUM_DISC_STYLES; style++ )
+  {
+    for ( int level=0; level<NUM_DISC_LEVELS; level++ )
+    {
+      default_discs[style][level] = computeDiscPoints( DiscStyleT(style), DEFAULT_DISC_WIDTH, steps[level] );
+    }
+  }
+}
+
+void assignDiscPoints( DiscStyleT style, float width, int steps, V_Point &points )
+{
+  int level = getDiscLevelIndex( steps );
+  if ( width == DEFAULT_DISC_WIDTH && level >= 0 )
+  {
+    boost::call_once( &computeDefaultDiscs, default_discs_once );
+    points = *default_discs[style][level];
+    return;
+  }
+  points = *computeDiscPoints( style, width, steps );
+}
+
+DetailLevel detail_level = DETAIL_HIGH;
+
+// number of disc segments for the given level. must be even.
+int getDiscSteps( DetailLevel level, float scale )
+{
+  if ( level == DETAIL_AUTO )
+  {
+    if ( scale >= 0.5 )
+    {
+      level = DETAIL_HIGH;
+    }
+    else if ( scale >= 0.15 )
+    {
+      level = DETAIL_MEDIUM;
+    }
+    else
+    {
+      level = DETAIL_LOW;
+    }
+  }
+
+  switch ( level )
+  {
+    case DETAIL_LOW:
+      return 12;
+    case DETAIL_MEDIUM:
+      return 24;
+    default:
+      return 36;
+  }
+}
+
+}
+
+void setDetailLevel( DetailLevel level )
+{
+  detail_level = level;
+}
+
+DetailLevel getDetailLevel()
+{
+  return detail_level;
+}
+
+void makeDisc( const visualization_msgs::InteractiveMarker &msg,
+    visualization_msgs::InteractiveMarkerControl &control, float width )
+{
+  // construct in place to avoid copying the point list
+  control.markers.push_back( visualization_msgs::Marker() );
+  visualization_msgs::Marker &marker = control.markers.back();
+
+  // rely on the auto-completion for the correct orientation
+  marker.pose.orientation = control.orientation;
+
+  marker.type = visualization_msgs::Marker::TRIANGLE_LIST;
+  marker.scale.x = msg.scale;
+  marker.scale.y = msg.scale;
+  marker.scale.z = msg.scale;
+
+  assignDefaultColor(marker, control.orientation);
+
+  const int steps = getDiscSteps( detail_level, msg.scale );
+
+  std_msgs::ColorRGBA color;
+  color.r=color.g=color.b=color.a=1;
+
+  switch ( control.interaction_mode )
+  {
+    case visualization_msgs::InteractiveMarkerControl::ROTATE_AXIS:
+    {
+      assignDiscPoints( DISC_ROTATE, width, steps, marker.points );
+      marker.colors.resize(2*steps);
+      std_msgs::ColorRGBA base_color = marker.color;
+      for ( int i=0; i<steps; i++ )
+      {
+        int c = i*2;
+
+        float t = 0.6 + 0.4 * (i%2);
+        color.r = base_color.r * t;
+        color.g = base_color.g * t;
+        color.b = base_color.b * t;
+
+        marker.colors[c] = color;
+        marker.colors[c+1] = color;
+      }
+      break;
+    }
+
+    case visualization_msgs::InteractiveMarkerControl::MOVE_ROTATE:
+    {
+      assignDiscPoints( DISC_MOVE_ROTATE, width, steps, marker.points );
+      marker.colors.resize(2*steps);
+      std_msgs::ColorRGBA base_color = marker.color;
+
+      color.r = base_color.r * 0.6;
+      color.g = base_color.g * 0.6;
+      color.b = base_color.b * 0.6;
+
+      for ( int i=0; i<steps-1; i+=2 )
+      {
+        int c = i * 2;
+
+        marker.colors[c] = color;
+        marker.colors[c+1] = color;
+        marker.colors[c+2] = base_color;
+        marker.colors[c+3] = base_color;
+      }
+      break;
+    }
+
+    default:
+      assignDiscPoints( DISC_PLAIN, width, steps, marker.points );
+      break;
+  }
 }
 
 void makeViewFacingButton( const visualization_msgs::InteractiveMarker &msg,
-    visualization_msgs::InteractiveMarkerControl &control, std::string text )
+    visualization_msgs::InteractiveMarkerControl &control, const std::string &text )
 {
   control.orientation_mode = visualization_msgs::InteractiveMarkerControl::VIEW_FACING;
   control.independent_marker_orientation = false;
 
-  visualization_msgs::Marker marker;
+  control.markers.push_back( visualization_msgs::Marker() );
+  visualization_msgs::Marker &marker = control.markers.back();
 
   float base_scale = 0.25 * msg.scale;
   float base_z = 1.2 * msg.scale;
@@ -382,8 +627,6 @@ void makeViewFacingButton( const visualization_msgs::InteractiveMarker &msg,
   marker.pose.position.x = base_scale * -0.1;
   marker.pose.position.z = base_z + base_scale * -0.1;
   marker.text = text;
-
-  control.markers.push_back( marker );
 }
 
 
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2012, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "interactive_markers/transport.h"
+#include "interactive_markers/clock.h"
+
+#include <boost/bind.hpp>
+
+namespace interactive_markers
+{
+
+RosServerTransport::RosServerTransport( const ros::NodeHandle& node_handle )
+: node_handle_(node_handle)
+{
+}
+
+void RosServerTransport::advertise( const std::string& topic_ns, const FeedbackCallback& feedback_cb )
+{
+  std::string update_topic = topic_ns + "/update";
+  std::string init_topic = update_topic + "_full";
+  std::string feedback_topic = topic_ns + "/feedback";
+
+  if ( connect_cb_ )
+  {
+    init_pub_ = node_handle_.advertise<visualization_msgs::InteractiveMarkerInit>( init_topic, 100,
+        connect_cb_, disconnect_cb_ );
+    update_pub_ = node_handle_.advertise<visualization_msgs::InteractiveMarkerUpdate>( update_topic, 100,
+        connect_cb_, disconnect_cb_ );
+  }
+  else
+  {
+    init_pub_ = node_handle_.advertise<visualization_msgs::InteractiveMarkerInit>( init_topic, 100, true );
+    update_pub_ = node_handle_.advertise<visualization_msgs::InteractiveMarkerUpdate>( update_topic, 100 );
+  }
+  feedback_cb_ = feedback_cb;
+  feedback_sub_ = node_handle_.subscribe( feedback_topic, 100, &RosServerTransport::processFeedback, this );
+}
+
+void RosServerTransport::processFeedback(
+    const ros::MessageEvent<visualization_msgs::InteractiveMarkerFeedback const>& event )
+{
+  // the receipt time is taken before the message is queued, but in ROS time
+  ros::Duration age = ros::Time::now() - event.getReceiptTime();
+  feedback_cb_( event.getMessage(), getDefaultClock()->now() - ros::WallDuration( age.toSec() ) );
+}
+
+void RosServerTransport::publish( const visualization_msgs::InteractiveMarkerInitConstPtr& init )
+{
+  init_pub_.publish( init );
+}
+
+void RosServerTransport::publish( const visualization_msgs::InteractiveMarkerUpdateConstPtr& update )
+{
+  update_pub_.publish( update );
+}
+
+void RosServerTransport::setKeepAlive( double period, const KeepAliveCallback& keep_alive_cb )
+{
+  keep_alive_timer_ = node_handle_.createTimer( ros::Duration( period ), boost::bind( keep_alive_cb ) );
+}
+
+void RosServerTransport::shutdown()
+{
+  keep_alive_timer_.stop();
+  init_pub_.shutdown();
+  update_pub_.shutdown();
+  feedback_sub_.shutdown();
+}
+
+void RosServerTransport::setSubscriberCallbacks( const ros::SubscriberStatusCallback& connect_cb,
+    const ros::SubscriberStatusCallback& disconnect_cb )
+{
+  connect_cb_ = connect_cb;
+  disconnect_cb_ = disconnect_cb;
+}
+
+RosClientTransport::RosClientTransport( const ros::NodeHandle& node_handle )
+: node_handle_(node_handle)
+{
+}
+
+void RosClientTransport::subscribeInit( const std::string& topic_ns, const InitCallback& init_cb )
+{
+  init_sub_ = node_handle_.subscribe<visualization_msgs::InteractiveMarkerInit>( topic_ns+"/update_full", 100, init_cb );
+}
+
+void RosClientTransport::subscribeUpdate( const std::string& topic_ns, const UpdateCallback& update_cb )
+{
+  update_sub_ = node_handle_.subscribe<visualization_msgs::InteractiveMarkerUpdate>( topic_ns+"/update", 100, update_cb );
+}
+
+void RosClientTransport::unsubscribeInit()
+{
+  init_sub_.shutdown();
+}
+
+void RosClientTransport::unsubscribeUpdate()
+{
+  update_sub_.shutdown();
+}
+
+uint32_t RosClientTransport::getNumPublishers()
+{
+  return update_sub_.getNumPublishers();
+}
+
+}